@@ -0,0 +1,276 @@
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "kamanri/maths/all.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/utils/thread.hpp"
+#include "kamanri/renderer/obj_model.hpp"
+#include "kamanri/renderer/tga_image.hpp"
+#include "kamanri/renderer/asset_cache.hpp"
+#include "kamanri/renderer/world/camera.hpp"
+#include "kamanri/renderer/world/blinn_phong_reflection_model.hpp"
+#include "kamanri/renderer/world/__/resources.hpp"
+#include "kamanri/renderer/world/__/triangle3d.hpp"
+#include "kamanri/renderer/world/__/bounding_box.hpp"
+using namespace Kamanri::Maths;
+using namespace Kamanri::Renderer;
+using namespace Kamanri::Renderer::World;
+using namespace Kamanri::Utils;
+
+/**
+ * Throughput of the hot paths: the vertex transform of the camera, the per triangle inverse,
+ * the bounding volume hierarchy build, the OBJ loader and the TGA decoder. The files to load are generated into the working directory and removed after.
+ * Usage: MyRendererBenchmark [transform | inverse | bvh | obj | tga]..., all of them when none is given
+ */
+
+constexpr const char* LOG_NAME = "Benchmark";
+const unsigned int WORKER_COUNT = std::thread::hardware_concurrency();
+// the best of ROUND_COUNT rounds is reported
+constexpr const int ROUND_COUNT = 5;
+constexpr const size_t TRANSFORM_VERTEX_COUNT = 1000000;
+constexpr const size_t INVERSE_COUNT = 1000000;
+// triangles of the hierarchy are 2 * (BVH_GRID_LENGTH - 1)^2
+constexpr const size_t BVH_GRID_LENGTH = 708;
+// vertices of the generated OBJ are OBJ_GRID_LENGTH * OBJ_GRID_LENGTH
+constexpr const size_t OBJ_GRID_LENGTH = 512;
+constexpr const int TGA_LENGTH = 2048;
+constexpr const char* OBJ_FILE_NAME = "benchmark.obj";
+
+
+namespace __Benchmark
+{
+	using Clock = std::chrono::steady_clock;
+
+	inline double Milliseconds(Clock::time_point from)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - from).count();
+	}
+
+	/// @brief Run the function ROUND_COUNT times and return the least milliseconds
+	template <class F>
+	double Best(F&& f)
+	{
+		double best = HUGE_VAL;
+		for (int i = 0; i < ROUND_COUNT; i++)
+		{
+			auto t = Clock::now();
+			f();
+			auto ms = Milliseconds(t);
+			if (ms < best) best = ms;
+		}
+		return best;
+	}
+
+	inline size_t FileSize(std::string const& file_name)
+	{
+		auto f = fopen(file_name.c_str(), "rb");
+		if (f == nullptr) return 0;
+		fseek(f, 0, SEEK_END);
+		auto size = (size_t)ftell(f);
+		fclose(f);
+		return size;
+	}
+
+	void Transform()
+	{
+		__::Resources resources;
+		for (size_t i = 0; i < TRANSFORM_VERTEX_COUNT; i++)
+		{
+			Vector vertex = { (double)(i % 1000) / 100 - 5, (double)(i / 1000 % 1000) / 100 - 5, -(double)(i % 777) / 100 - 2, 1 };
+			Vector normal = { 0, 1, 0, 0 };
+			resources.vertices.PushBack(vertex);
+			resources.vertex_normals.PushBack(normal);
+		}
+		resources.vertices_transformed.Resize(TRANSFORM_VERTEX_COUNT);
+		resources.vertices_model_view_transformed.Resize(TRANSFORM_VERTEX_COUNT);
+		resources.vertex_normals_model_view_transformed.Resize(TRANSFORM_VERTEX_COUNT);
+
+		BlinnPhongReflectionModel bpr_model({ BlinnPhongReflectionModel$::PointLight({ 2, 3, 4, 1 }, 800, 0xffffff) }, 100, 100);
+		Camera camera({ 0, 0.5, 5, 1 }, { 0, -0.1, -1, 0 }, { 0, 1, 0, 0 }, -1, -5, 100, 100);
+
+		camera.__SetRefs(resources, bpr_model);
+		auto ms = Best([&]() { camera.Transform(false); });
+		Log::Info(LOG_NAME, "transform: %llu vertices + normals, 1 thread: %.1f ms", TRANSFORM_VERTEX_COUNT, ms);
+
+		Thread::ThreadPool thread_pool(WORKER_COUNT);
+		camera.__SetRefs(resources, bpr_model, &thread_pool);
+		ms = Best([&]() { camera.Transform(false); });
+		Log::Info(LOG_NAME, "transform: %llu vertices + normals, %u threads: %.1f ms", TRANSFORM_VERTEX_COUNT, WORKER_COUNT, ms);
+	}
+
+	void Inverse()
+	{
+		// the 3x3 inverse is the one a triangle builds from its vertices, the 4x4 determinant is of the transformers
+		std::vector<SMatrix> matrices3;
+		std::vector<SMatrix> matrices4;
+		for (size_t i = 0; i < INVERSE_COUNT; i++)
+		{
+			double a = (double)(i % 1013) / 1013, b = (double)(i % 769) / 769, c = (double)(i % 521) / 521;
+			matrices3.push_back({ a + 1, b, c, b, c + 1, a, c, a, b + 1 });
+			matrices4.push_back({ a + 1, b, c, 0, b, c + 1, a, 0, c, a, b + 1, 0, a, b, c, 1 });
+		}
+
+		double check = 0;
+		auto ms = Best([&]()
+		{
+			for (auto const& m : matrices3) check += (-m)[0];
+		});
+		Log::Info(LOG_NAME, "inverse: 3x3 %.1f ns", ms * 1e6 / INVERSE_COUNT);
+		ms = Best([&]()
+		{
+			for (auto const& m : matrices4) check += m.Determinant();
+		});
+		Log::Info(LOG_NAME, "inverse: 4x4 determinant %.1f ns (check %g)", ms * 1e6 / INVERSE_COUNT, check);
+	}
+
+	void Bvh()
+	{
+		__::Resources resources;
+		for (size_t j = 0; j < BVH_GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i < BVH_GRID_LENGTH; i++)
+			{
+				double u = (double)i / (BVH_GRID_LENGTH - 1), v = (double)j / (BVH_GRID_LENGTH - 1);
+				resources.vertices.PushBack({ u * 4 - 2, 0.2 * sin(u * 4 * PI) * cos(v * 4 * PI) - 1, v * 4 - 2, 1 });
+				resources.vertex_normals.PushBack({ 0, 1, 0, 0 });
+				resources.vertex_textures.PushBack({ u, v, 0, 0 });
+			}
+		}
+		auto vertex_count = resources.vertices.Size();
+		resources.vertices_transformed.Resize(vertex_count);
+		resources.vertices_model_view_transformed.Resize(vertex_count);
+		resources.vertex_normals_model_view_transformed.Resize(vertex_count);
+
+		std::vector<__::Triangle3D> triangles;
+		for (size_t j = 0; j + 1 < BVH_GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i + 1 < BVH_GRID_LENGTH; i++)
+			{
+				auto v = j * BVH_GRID_LENGTH + i;
+				auto w = v + BVH_GRID_LENGTH;
+				triangles.push_back(__::Triangle3D(0, triangles.size(), v, v + 1, w, v, v + 1, w, v, v + 1, w));
+				triangles.push_back(__::Triangle3D(0, triangles.size(), v + 1, w + 1, w, v + 1, w + 1, w, v + 1, w + 1, w));
+			}
+		}
+
+		BlinnPhongReflectionModel bpr_model({ BlinnPhongReflectionModel$::PointLight({ 2, 3, 4, 1 }, 800, 0xffffff) }, 100, 100);
+		Camera camera({ 0, 0.5, 5, 1 }, { 0, -0.1, -1, 0 }, { 0, 1, 0, 0 }, -1, -5, 100, 100);
+		camera.__SetRefs(resources, bpr_model);
+		camera.Transform(false);
+		std::vector<__::Triangle3D$::SetupRecord> setups(triangles.size());
+		std::vector<__::Triangle3D$::AttributeRecord> attributes(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			triangles[i].Build(resources, setups[i], attributes[i]);
+		}
+
+		std::vector<__::BoundingBox> boxes(__::BoundingBox$::BoxSize(triangles.size()));
+		auto ms = Best([&]() { __::BoundingBox$::Build(boxes.data(), triangles, setups); });
+		Log::Info(LOG_NAME, "bvh: %llu triangles, serial: %.1f ms", triangles.size(), ms);
+		for (unsigned int worker_count = 1; worker_count <= std::max(8u, WORKER_COUNT); worker_count *= 2)
+		{
+			Thread::ThreadPool thread_pool(worker_count);
+			ms = Best([&]() { __::BoundingBox$::Build(boxes.data(), triangles, setups, &thread_pool); });
+			Log::Info(LOG_NAME, "bvh: %llu triangles, %u workers: %.1f ms", triangles.size(), worker_count, ms);
+		}
+	}
+
+	void Obj()
+	{
+		auto f = fopen(OBJ_FILE_NAME, "w");
+		if (f == nullptr)
+		{
+			Log::Error(LOG_NAME, "Cannot write %s", OBJ_FILE_NAME);
+			return;
+		}
+		for (size_t j = 0; j < OBJ_GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i < OBJ_GRID_LENGTH; i++)
+			{
+				double u = (double)i / (OBJ_GRID_LENGTH - 1), v = (double)j / (OBJ_GRID_LENGTH - 1);
+				fprintf(f, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n", u * 4 - 2, 0.2 * sin(u * 4 * PI) * cos(v * 4 * PI), v * 4 - 2, u, v, 0., 1., 0.);
+			}
+		}
+		for (size_t j = 0; j + 1 < OBJ_GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i + 1 < OBJ_GRID_LENGTH; i++)
+			{
+				auto v = j * OBJ_GRID_LENGTH + i + 1;
+				auto w = v + OBJ_GRID_LENGTH;
+				fprintf(f, "f %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu\n", v, v, v, v + 1, v + 1, v + 1, w, w, w);
+				fprintf(f, "f %llu/%llu/%llu %llu/%llu/%llu %llu/%llu/%llu\n", v + 1, v + 1, v + 1, w + 1, w + 1, w + 1, w, w, w);
+			}
+		}
+		fclose(f);
+
+		auto megabytes = FileSize(OBJ_FILE_NAME) / 1048576.;
+		for (auto worker_count : { 1u, WORKER_COUNT })
+		{
+			auto ms = Best([&]() { ObjModel model(OBJ_FILE_NAME, "", worker_count); });
+			Log::Info(LOG_NAME, "obj: %.1f MB, %u threads: %.1f ms, %.1f MB/s", megabytes, worker_count, ms, megabytes / (ms / 1000));
+		}
+		remove(OBJ_FILE_NAME);
+	}
+
+	void Tga()
+	{
+		for (int bytes_per_pixel : { 1, 3, 4 })
+		{
+			// runs of equal pixels on the left and noise on the right, so that neither RLE nor raw packets dominate
+			TGAImage image(TGA_LENGTH, TGA_LENGTH, bytes_per_pixel);
+			for (int y = 0; y < TGA_LENGTH; y++)
+			{
+				for (int x = 0; x < TGA_LENGTH; x++)
+				{
+					unsigned int c = (x % 64 < 40) ? ((x / 7 + y / 5) * 37u & 0xf0) * 0x010101u : (x * 0x9e3779b1u ^ y * 0x85ebca6bu);
+					TGAImage$::TGAColor color((std::uint8_t)c, (std::uint8_t)(c >> 8), (std::uint8_t)(c >> 16), (std::uint8_t)(c >> 24));
+					color.bytespp = bytes_per_pixel;
+					image.Set(x, y, color);
+				}
+			}
+
+			for (bool is_rle : { false, true })
+			{
+				auto file_name = "benchmark_" + std::to_string(bytes_per_pixel * 8) + (is_rle ? "_rle.tga" : "_raw.tga");
+				image.WriteTGAFile(file_name, true, is_rle);
+				auto megabytes = (double)TGA_LENGTH * TGA_LENGTH * bytes_per_pixel / 1048576;
+				auto ms = Best([&]()
+				{
+					TGAImage decoded;
+					decoded.ReadTGAFile(file_name);
+				});
+				Log::Info(LOG_NAME, "tga: %d bpp %s: %.1f ms, %.1f MB/s", bytes_per_pixel * 8, is_rle ? "rle" : "raw", ms, megabytes / (ms / 1000));
+				remove(file_name.c_str());
+			}
+		}
+	}
+} // namespace __Benchmark
+
+
+int main(int argc, char** argv)
+{
+	using namespace __Benchmark;
+	Log::SetLevel(Log$::INFO_LEVEL);
+	// measure the loaders, not the binary caches of their results
+	AssetCache::SetEnabled(false);
+
+	auto is_selected = [&](std::string const& name)
+	{
+		if (argc < 2) return true;
+		for (int i = 1; i < argc; i++)
+		{
+			if (name == argv[i]) return true;
+		}
+		return false;
+	};
+
+	if (is_selected("transform")) Transform();
+	if (is_selected("inverse")) Inverse();
+	if (is_selected("bvh")) Bvh();
+	if (is_selected("obj")) Obj();
+	if (is_selected("tga")) Tga();
+	return 0;
+}
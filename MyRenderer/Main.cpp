@@ -18,6 +18,15 @@ constexpr const bool IS_SHADOW_MAPPING = true;
 constexpr const bool IS_OFFLINE = false;
 constexpr const bool IS_USE_CUDA = true;
 constexpr const unsigned int FRAME_COUNT = 128;
+// used when IS_USE_CUDA == false
+const unsigned int WORKER_COUNT = std::thread::hardware_concurrency();
+// only supported by CPU, CUDA always queries the bounding boxes for every pixel
+constexpr const bool IS_TRIANGLE_RASTERIZATION = !IS_USE_CUDA;
+// only supported by CPU, texels of every face of the shadow cube maps is its square, 0 casts a ray for every pixel instead.
+// every light takes 6 * SHADOW_MAP_RESOLUTION^2 * 8 bytes, 48 MB at 1024
+constexpr const unsigned int SHADOW_MAP_RESOLUTION = IS_USE_CUDA ? 0 : 1024;
+// merge the corners of the same (v, vt, vn) of the models into one vertex
+constexpr const bool IS_VERTEX_WELDING = true;
 
 
 #define MODEL_DIABLO3_POSE
@@ -113,31 +122,31 @@ void StartRender(HINSTANCE hInstance)
 		BlinnPhongReflectionModel({
 			BlinnPhongReflectionModel$::PointLight({2, 3, 4, 1}, 800, 0xffffff)
 		}, WINDOW_LENGTH, WINDOW_LENGTH, 0.95, 1 / PI * 2, 0.4, IS_USE_CUDA),
-		IS_SHADOW_MAPPING, IS_USE_CUDA
+		IS_SHADOW_MAPPING, IS_USE_CUDA, WORKER_COUNT, IS_TRIANGLE_RASTERIZATION, SHADOW_MAP_RESOLUTION
 	);
 
 
 	world
 #ifdef MODEL_DIABLO3_POSE
 	.AddObjModel(
-		ObjModel(DIABLO3_POSE_OBJ, DIABLO3_POSE_TGA),
+		ObjModel(DIABLO3_POSE_OBJ, DIABLO3_POSE_TGA, WORKER_COUNT, IS_VERTEX_WELDING),
 		DIABLO3_POSE_TRANSFORMER
 	)
 #endif
 #ifdef MODEL_SHIBA
 	.AddObjModel(
-		ObjModel(SHIBA_OBJ, SHIBA_TGA),
+		ObjModel(SHIBA_OBJ, SHIBA_TGA, WORKER_COUNT, IS_VERTEX_WELDING),
 		SHIBA_TRANSFORMER
 	)
 #endif
 #ifdef MODEL_STRAWBERRY
 	.AddObjModel(
-		ObjModel(STRAWBERRY_OBJ, STRAWBERRY_TGA),
+		ObjModel(STRAWBERRY_OBJ, STRAWBERRY_TGA, WORKER_COUNT, IS_VERTEX_WELDING),
 		STRAWBERRY_TRANSFORMER
 	)
 #endif
 	.AddObjModel(
-		ObjModel(FLOOR_OBJ, FLOOR_TGA),
+		ObjModel(FLOOR_OBJ, FLOOR_TGA, WORKER_COUNT, IS_VERTEX_WELDING),
 		{
 			2, 0, 0, 0,
 			0, 2, 0, 0,
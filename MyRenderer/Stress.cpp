@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "kamanri/maths/all.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/renderer/world/camera.hpp"
+#include "kamanri/renderer/world/blinn_phong_reflection_model.hpp"
+#include "kamanri/renderer/world/__/resources.hpp"
+#include "kamanri/renderer/world/__/triangle3d.hpp"
+using namespace Kamanri::Maths;
+using namespace Kamanri::Renderer::World;
+using namespace Kamanri::Utils;
+
+/**
+ * Builds the same synthetic scene from several threads at once and checks that every thread
+ * gets the results of a serial run, so that Camera::Transform and Triangle3D::Build stay reentrant.
+ * Usage: MyRendererStress [thread count] [frame count]
+ */
+
+constexpr const char* LOG_NAME = "Stress";
+// vertices of the mesh are GRID_LENGTH * GRID_LENGTH
+constexpr const size_t GRID_LENGTH = 128;
+constexpr const unsigned int SCREEN_LENGTH = 512;
+
+
+namespace __Stress
+{
+	constexpr unsigned long long FNV_OFFSET = 1469598103934665603ULL;
+	constexpr unsigned long long FNV_PRIME = 1099511628211ULL;
+
+	inline unsigned long long Hash(unsigned long long hash, void const* bytes, size_t size)
+	{
+		auto p = static_cast<unsigned char const*>(bytes);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ p[i]) * FNV_PRIME;
+		}
+		return hash;
+	}
+
+	/// @brief A wavy grid of triangles on xOz with normals and texture coordinates
+	void BuildScene(__::Resources& resources, std::vector<__::Triangle3D>& triangles)
+	{
+		for (size_t j = 0; j < GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i < GRID_LENGTH; i++)
+			{
+				double u = (double)i / (GRID_LENGTH - 1);
+				double v = (double)j / (GRID_LENGTH - 1);
+				double y = 0.2 * sin(u * 4 * PI) * cos(v * 4 * PI);
+				resources.vertices.PushBack({ u * 4 - 2, y - 1, v * 4 - 2, 1 });
+				resources.vertex_normals.PushBack({ -0.8 * PI * cos(u * 4 * PI) * cos(v * 4 * PI), 1, 0.8 * PI * sin(u * 4 * PI) * sin(v * 4 * PI), 0 });
+				resources.vertex_textures.PushBack({ u, v, 0, 0 });
+			}
+		}
+		auto vertex_count = resources.vertices.Size();
+		resources.vertices_transformed.Resize(vertex_count);
+		resources.vertices_model_view_transformed.Resize(vertex_count);
+		resources.vertex_normals_model_view_transformed.Resize(vertex_count);
+
+		for (size_t j = 0; j + 1 < GRID_LENGTH; j++)
+		{
+			for (size_t i = 0; i + 1 < GRID_LENGTH; i++)
+			{
+				auto v = j * GRID_LENGTH + i;
+				triangles.push_back(__::Triangle3D(0, triangles.size(), v, v + 1, v + GRID_LENGTH, v, v + 1, v + GRID_LENGTH, v, v + 1, v + GRID_LENGTH));
+				triangles.push_back(__::Triangle3D(0, triangles.size(), v + 1, v + GRID_LENGTH + 1, v + GRID_LENGTH, v + 1, v + GRID_LENGTH + 1, v + GRID_LENGTH, v + 1, v + GRID_LENGTH + 1, v + GRID_LENGTH));
+			}
+		}
+	}
+
+	/// @brief Transform the scene by a camera revolving around it and build every triangle, return the hash of all frames
+	unsigned long long Run(__::Resources const& scene, std::vector<__::Triangle3D> const& scene_triangles, unsigned int frame_count)
+	{
+		// every run owns its copies, only the code is shared
+		__::Resources resources;
+		resources = scene;
+		auto triangles = scene_triangles;
+		std::vector<__::Triangle3D$::SetupRecord> setups(triangles.size());
+		std::vector<__::Triangle3D$::AttributeRecord> attributes(triangles.size());
+
+		BlinnPhongReflectionModel bpr_model({ BlinnPhongReflectionModel$::PointLight({ 2, 3, 4, 1 }, 800, 0xffffff) }, SCREEN_LENGTH, SCREEN_LENGTH);
+		Camera camera({ 0, 0.5, 5, 1 }, { 0, -0.1, -1, 0 }, { 0, 1, 0, 0 }, -1, -5, SCREEN_LENGTH, SCREEN_LENGTH);
+		camera.__SetRefs(resources, bpr_model);
+
+		double theta = PI / 16;
+		SMatrix revolve_matrix =
+		{
+			cos(theta), 0, -sin(theta), 0,
+			0, 1, 0, 0,
+			sin(theta), 0, cos(theta), 0,
+			0, 0, 0, 1
+		};
+
+		auto hash = FNV_OFFSET;
+		for (unsigned int f = 0; f < frame_count; f++)
+		{
+			Vector direction = camera.Direction();
+			camera.Transform(f == 0);
+			for (size_t i = 0; i < triangles.size(); i++)
+			{
+				triangles[i].Build(resources, setups[i], attributes[i]);
+			}
+
+			for (size_t c = 0; c < 3; c++)
+			{
+				hash = Hash(hash, resources.vertices_transformed.Component(c), resources.vertices_transformed.Size() * sizeof(double));
+			}
+			hash = Hash(hash, setups.data(), setups.size() * sizeof(__::Triangle3D$::SetupRecord));
+			hash = Hash(hash, attributes.data(), attributes.size() * sizeof(__::Triangle3D$::AttributeRecord));
+
+			revolve_matrix * camera.Direction();
+			revolve_matrix * camera.Location();
+			camera.InverseUpperByDirection(direction);
+		}
+		return hash;
+	}
+} // namespace __Stress
+
+
+int main(int argc, char** argv)
+{
+	using namespace __Stress;
+	Log::SetLevel(Log$::INFO_LEVEL);
+	auto thread_count = argc > 1 ? (unsigned int)atoi(argv[1]) : std::thread::hardware_concurrency();
+	auto frame_count = argc > 2 ? (unsigned int)atoi(argv[2]) : 8;
+	if (thread_count == 0) thread_count = 4;
+
+	__::Resources scene;
+	std::vector<__::Triangle3D> scene_triangles;
+	BuildScene(scene, scene_triangles);
+	Log::Info(LOG_NAME, "%llu vertices, %llu triangles, %u frames", scene.vertices.Size(), scene_triangles.size(), frame_count);
+
+	auto serial_hash = Run(scene, scene_triangles, frame_count);
+	Log::Info(LOG_NAME, "serial: %016llx", serial_hash);
+
+	std::vector<unsigned long long> hashes(thread_count);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < thread_count; i++)
+	{
+		threads.emplace_back([&, i]() { hashes[i] = Run(scene, scene_triangles, frame_count); });
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	size_t mismatch_count = 0;
+	for (unsigned int i = 0; i < thread_count; i++)
+	{
+		if (hashes[i] == serial_hash) continue;
+		Log::Error(LOG_NAME, "thread %u: %016llx differs from the serial run", i, hashes[i]);
+		mismatch_count++;
+	}
+	if (mismatch_count != 0) return 1;
+
+	Log::Info(LOG_NAME, "%u threads match the serial run", thread_count);
+	return 0;
+}
@@ -6,23 +6,6 @@
 namespace __SMatrix
 {
 
-	/// @brief (-1)^RON
-	/// @param v 
-	/// @return 
-	__device__ int Pow_NegativeOne_ReverseOrderNumber(size_t* list, size_t list_size)
-	{
-		int res = 1;
-		for (size_t i = 1; i < list_size; i++)
-		{
-			for (size_t j = 0; j < i; j++)
-			{
-				if (list[j] > list[i]) res *= -1;
-			}
-		}
-		return res;
-	}
-
-
 	__device__ inline Kamanri::Maths::SMatrixElemType SMGet(Kamanri::Maths::SMatrixElemType* sm, size_t n, size_t row, size_t col)
 	{
 		return sm[n * row + col];
@@ -40,28 +23,22 @@ namespace __SMatrix
 		return (SMGet(sm, n, row_1, col_1) * SMDet2(sm, n, row_2, row_3, col_2, col_3) - SMGet(sm, n, row_2, col_1) * SMDet2(sm, n, row_1, row_3, col_2, col_3) + SMGet(sm, n, row_3, col_1) * SMDet2(sm, n, row_1, row_2, col_2, col_3));
 	}
 
-	__device__ Kamanri::Maths::SMatrixElemType __Determinant(Kamanri::Maths::SMatrixElemType* psm, size_t* row_list, size_t* col_list, size_t row_count)
+	/// @brief Closed-form determinant of the whole 2 * 2, 3 * 3 or 4 * 4 matrix, expanded by the first column without any allocation
+	__device__ inline Kamanri::Maths::SMatrixElemType SMDet(Kamanri::Maths::SMatrixElemType* sm, size_t n)
 	{
-		using namespace __SMatrix;
-		Kamanri::Maths::SMatrixElemType result = 0;
-
-		if (row_count < 4)
+		switch (n)
 		{
-			if (row_count == 1) result = SMGet(psm, row_count, row_list[0], col_list[0]);
-			if (row_count == 2) result = SMDet2(psm, row_count, row_list[0], row_list[1], col_list[0], col_list[1]);
-			if (row_count == 3) result = SMDet3(psm, row_count, row_list[0], row_list[1], row_list[2], col_list[0], col_list[1], col_list[2]);
-			if (row_count == 4)
-			{
-				result = SMGet(psm, row_count, row_list[0], col_list[0]) * SMDet3(psm, row_count, 1, 2, 3, 1, 2, 3) -
-					SMGet(psm, row_count, row_list[1], col_list[0]) * SMDet3(psm, row_count, row_list[0], row_list[2], row_list[3], col_list[1], col_list[2], col_list[3]) +
-					SMGet(psm, row_count, row_list[2], col_list[0]) * SMDet3(psm, row_count, row_list[0], row_list[1], row_list[3], col_list[1], col_list[2], col_list[3]) -
-					SMGet(psm, row_count, row_list[3], col_list[0]) * SMDet3(psm, row_count, row_list[0], row_list[1], row_list[2], col_list[1], col_list[2], col_list[3]);
-			}
-			// This is to avoid the bigger index is in front of the smaller
-			result *= __SMatrix::Pow_NegativeOne_ReverseOrderNumber(row_list, row_count);
-			result *= __SMatrix::Pow_NegativeOne_ReverseOrderNumber(col_list, row_count);
-
-			return result;
+		case 2:
+			return SMDet2(sm, n, 0, 1, 0, 1);
+		case 3:
+			return SMDet3(sm, n, 0, 1, 2, 0, 1, 2);
+		case 4:
+			return SMGet(sm, n, 0, 0) * SMDet3(sm, n, 1, 2, 3, 1, 2, 3) -
+				SMGet(sm, n, 1, 0) * SMDet3(sm, n, 0, 2, 3, 1, 2, 3) +
+				SMGet(sm, n, 2, 0) * SMDet3(sm, n, 0, 1, 3, 1, 2, 3) -
+				SMGet(sm, n, 3, 0) * SMDet3(sm, n, 0, 1, 2, 1, 2, 3);
+		default:
+			return Kamanri::Maths::SMatrix$::NOT_INITIALIZED_VALUE;
 		}
 	}
 }
@@ -213,7 +190,7 @@ __device__ Kamanri::Maths::SMatrix Kamanri::Maths::SMatrix::operator-() const
 __device__ Kamanri::Maths::SMatrix Kamanri::Maths::SMatrix::operator*() const
 {
 
-	if (_N != 3 && _N != 4)
+	if (_N != 2 && _N != 3 && _N != 4)
 	{
 		Kamanri::Utils::PrintLn("operator* not allowed when _N = %llu", _N);
 		return SMatrix();
@@ -221,6 +198,16 @@ __device__ Kamanri::Maths::SMatrix Kamanri::Maths::SMatrix::operator*() const
 
 	auto p_sm = (Kamanri::Maths::SMatrixElemType*) _SM;
 
+	if (_N == 2)
+	{
+		SMatrix ret_sm =
+		{
+			p_sm[3], -p_sm[1],
+			-p_sm[2], p_sm[0]
+		};
+		return ret_sm;
+	}
+
 	if (_N == 3)
 	{
 		SMatrix ret_sm =
@@ -246,18 +233,10 @@ __device__ Kamanri::Maths::SMatrix Kamanri::Maths::SMatrix::operator*() const
 
 __device__ Kamanri::Maths::SMatrixElemType Kamanri::Maths::SMatrix::Determinant() const
 {
-	size_t row_list[4] = { 0, 1, 2, 3 };
-	size_t col_list[4] = { 0, 1, 2, 3 };
-	switch (_N)
+	if (_N < 2 || _N > 4)
 	{
-		case 2:
-			return __SMatrix::__Determinant((Kamanri::Maths::SMatrixElemType*) _SM, row_list, col_list, 2);
-		case 3:
-			return __SMatrix::__Determinant((Kamanri::Maths::SMatrixElemType*) _SM, row_list, col_list, 3);
-		case 4:
-			return __SMatrix::__Determinant((Kamanri::Maths::SMatrixElemType*) _SM, row_list, col_list, 4);
-		default:
-			Kamanri::Utils::PrintLn("Invalid dimension %d", _N);
-			break;
+		Kamanri::Utils::PrintLn("Invalid dimension %d", _N);
+		return SMatrix$::NOT_INITIALIZED_VALUE;
 	}
+	return __SMatrix::SMDet((Kamanri::Maths::SMatrixElemType*) _SM, _N);
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
 #pragma once
 #include "world/all.impl.cuh"
-#include "tga_image.impl.cuh"
\ No newline at end of file
+#include "tga_image.impl.cuh"
+#include "texture.impl.cuh"
\ No newline at end of file
@@ -0,0 +1,7 @@
+#pragma once
+#include "kamanri/renderer/texture.hpp"
+
+__device__ unsigned int Kamanri::Renderer::Texture::Sample(double u, double v, double du_dx, double dv_dx, double du_dy, double dv_dy) const
+{
+	return Texture$::Sample(_cuda_texels, _levels, _level_count, u, v, du_dx, dv_dx, du_dy, dv_dy);
+}
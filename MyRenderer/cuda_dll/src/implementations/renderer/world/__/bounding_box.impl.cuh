@@ -14,51 +14,43 @@ namespace Kamanri
 				{
 					namespace __IsThrough
 					{
-						using AxisType = size_t;
-						constexpr AxisType X_AXIS = 0;
-						constexpr AxisType Y_AXIS = 1;
-						constexpr AxisType Z_AXIS = 2;
-						__device__ inline bool IsThroughPlane(Maths::Vector const& location, Maths::Vector const& direction, BoundingBox const& box, AxisType axis_type, double value)
+						/// @brief Segment location + t * direction for t in [0, t_max], the inverse direction is computed once for all slab tests
+						class Ray
 						{
-							double x = 0, y = 0, z = 0, ratio = 0;
+							public:
+							double location[3];
+							double inverse_direction[3];
+							double t_max;
 
-							switch (axis_type)
+							__device__ Ray(Maths::Vector const& location, Maths::Vector const& direction, double t_max): t_max(t_max)
 							{
-							case X_AXIS:
-								x = value;
-								ratio = (x - location[X_AXIS]) / direction[X_AXIS];
-								y = (direction[Y_AXIS] * ratio) + location[Y_AXIS];
-								z = (direction[Z_AXIS] * ratio) + location[Z_AXIS];
-								if ((y <= box.world_max[Y_AXIS] && y >= box.world_min[Y_AXIS]) || (z <= box.world_max[Z_AXIS] && z >= box.world_min[Z_AXIS]))
+								for (size_t i = 0; i < 3; i++)
 								{
-									return true;
+									this->location[i] = location[i];
+									// a zero component gives infinity, which the slab test handles
+									inverse_direction[i] = 1 / direction[i];
 								}
-								break;
-							case Y_AXIS:
-								y = value;
-								ratio = (y - location[Y_AXIS]) / direction[Y_AXIS];
-								x = (direction[X_AXIS] * ratio) + location[X_AXIS];
-								z = (direction[Z_AXIS] * ratio) + location[Z_AXIS];
-								if ((x <= box.world_max[X_AXIS] && x >= box.world_min[X_AXIS]) || (z <= box.world_max[Z_AXIS] && z >= box.world_min[Z_AXIS]))
-								{
-									return true;
-								}
-								break;
-							case Z_AXIS:
-								z = value;
-								ratio = (z - location[Z_AXIS]) / direction[Z_AXIS];
-								x = (direction[X_AXIS] * ratio) + location[X_AXIS];
-								y = (direction[Y_AXIS] * ratio) + location[Y_AXIS];
-								if ((x <= box.world_max[X_AXIS] && x >= box.world_min[X_AXIS]) || (y <= box.world_max[Y_AXIS] && y >= box.world_min[Y_AXIS]))
-								{
-									return true;
-								}
-							default:
-								break;
 							}
+						};
 
-							return false;
-
+						/**
+						 * @brief Slab test of the ray against the box, t_near is where the ray enters the box.
+						 * NaN (a zero component of the direction on the plane of a slab) never wins a comparison, so it is ignored.
+						 */
+						__device__ inline bool IsThrough(BoundingBox const& box, Ray const& ray, double& t_near)
+						{
+							double t_min = 0, t_max = ray.t_max;
+							for (size_t i = 0; i < 3; i++)
+							{
+								double t1 = (box.world_min[i] - ray.location[i]) * ray.inverse_direction[i];
+								double t2 = (box.world_max[i] - ray.location[i]) * ray.inverse_direction[i];
+								double t_enter = t1 < t2 ? t1 : t2;
+								double t_exit = t1 < t2 ? t2 : t1;
+								t_min = t_enter > t_min ? t_enter : t_min;
+								t_max = t_exit < t_max ? t_exit : t_max;
+							}
+							t_near = t_min;
+							return t_min <= t_max;
 						}
 					}
 				}
@@ -68,91 +60,80 @@ namespace Kamanri
 }
 
 
-__device__ bool Kamanri::Renderer::World::__::__BoundingBox::IsThrough(
-	Kamanri::Renderer::World::__::BoundingBox const& box, 
-	Kamanri::Maths::Vector const& location, 
-	Kamanri::Maths::Vector const& direction)
-{
-	// TODO
-	// solve
-	// (x - x0) / dx = (y - y0) / dy = (z - z0) / dz
-	// (for example) x = box.world_min[0]
-	//
-
-	using namespace __IsThrough;
-	if (IsThroughPlane(location, direction, box, X_AXIS, box.world_min[X_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, X_AXIS, box.world_max[X_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Y_AXIS, box.world_min[Y_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Y_AXIS, box.world_max[Y_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Z_AXIS, box.world_min[Z_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Z_AXIS, box.world_max[Z_AXIS])) return true;
-
-	return false;
-	
-}
-
-__device__ void Kamanri::Renderer::World::__::BoundingBox$::MayThrough(
-	Kamanri::Renderer::World::__::BoundingBox* boxes, 
-	size_t b_i, 
-	Kamanri::Utils::List<Triangle3D> const& triangles, 
-	Kamanri::Maths::Vector const& location, 
-	Kamanri::Maths::Vector const& direction, 
-	Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem const& light_buffer_item, 
-	void (*build_per_triangle_light_pixel)(
-		Kamanri::Renderer::World::BlinnPhongReflectionModel& bpr_model, 
-		size_t x, 
-		size_t y, 
-		Kamanri::Renderer::World::__::Triangle3D& triangle, 
-		size_t point_light_index, 
-		Kamanri::Renderer::World::FrameBuffer& buffer), 
-	Kamanri::Renderer::World::BlinnPhongReflectionModel& bpr_model, 
-	size_t x, 
-	size_t y,
-	size_t point_light_index, 
-	Kamanri::Renderer::World::FrameBuffer& buffer)
+__device__ size_t Kamanri::Renderer::World::__::BoundingBox$::Occluded(
+	Kamanri::Renderer::World::__::BoundingBox const* boxes,
+	size_t b_i,
+	Kamanri::Utils::List<Triangle3D> const& triangles,
+	Kamanri::Maths::Vector const& origin,
+	Kamanri::Maths::Vector const& target,
+	size_t skip_triangle_index,
+	Kamanri::Renderer::World::__::BoundingBox$::Statistics* statistics)
 {
-	
+	using namespace __BoundingBox::__IsThrough;
+	if (statistics != nullptr) statistics->ray_query_count++;
+
+	auto direction_vector = target;
+	direction_vector -= origin;
+	Ray ray(origin, direction_vector, 1);
+	double location[3] = { origin[0], origin[1], origin[2] };
+	double direction[3] = { direction_vector[0], direction_vector[1], direction_vector[2] };
+	double t_near;
+	if (boxes[b_i].triangle_count == 0) return Triangle3D$::INEXIST_INDEX;
+	if (statistics != nullptr) statistics->ray_visited_node_count++;
+	if (!IsThrough(boxes[b_i], ray, t_near)) return Triangle3D$::INEXIST_INDEX;
+
+	// only boxes the segment passes are pushed
 	Utils::ArrayStack<size_t> stack;
 	stack.Push(b_i);
 	while (!stack.IsEmpty())
 	{
 		b_i = stack.Pop();
 
-		if (boxes[b_i].triangle_count == 0) continue;
-
-		if (!light_buffer_item.is_exposed) return;
-
-		if (!__BoundingBox::IsThrough(boxes[b_i], location, direction)) continue;
-
 		if (boxes[b_i].triangle_count == 1)
 		{
-			build_per_triangle_light_pixel(bpr_model, x, y, triangles.data[boxes[b_i].triangle_index], point_light_index, buffer);
-			if (!light_buffer_item.is_exposed) return;
+			if (statistics != nullptr) statistics->ray_visited_leaf_count++;
+			auto triangle_index = boxes[b_i].triangle_index;
+			if (triangle_index != skip_triangle_index && triangles.data[triangle_index].IsThrough(location, direction)) return triangle_index;
 			continue;
 		}
 
-		stack.Push(LeftChildIndex(b_i));
-		stack.Push(RightChildIndex(b_i));
+		// test both children, then visit the nearer one first
+		auto l_i = LeftChildIndex(b_i);
+		auto r_i = RightChildIndex(boxes, b_i);
+		double l_t_near, r_t_near;
+		if (statistics != nullptr) statistics->ray_visited_node_count += 2;
+		auto is_l_through = IsThrough(boxes[l_i], ray, l_t_near);
+		auto is_r_through = IsThrough(boxes[r_i], ray, r_t_near);
+		if (is_l_through && is_r_through)
+		{
+			auto is_l_nearer = l_t_near <= r_t_near;
+			stack.Push(is_l_nearer ? r_i : l_i);
+			stack.Push(is_l_nearer ? l_i : r_i);
+		}
+		else if (is_l_through) stack.Push(l_i);
+		else if (is_r_through) stack.Push(r_i);
 	}
+	return Triangle3D$::INEXIST_INDEX;
 }
 
 __device__ void Kamanri::Renderer::World::__::BoundingBox$::MayScreenCover(
 	BoundingBox* boxes,
 	size_t b_i,
-	Utils::List<__::Triangle3D> const& triangles,
+	Utils::List<__::Triangle3D$::SetupRecord> const& setups,
 	size_t x,
 	size_t y,
 	void (*write_to_pixel_per_triangle)(
-		__::Triangle3D& triangle, 
+		__::Triangle3D$::SetupRecord const& setup, 
 		size_t x,
 		size_t y,
-		FrameBuffer& buffer,
-		double nearest_dist,
-		Object* cuda_objects),
-	FrameBuffer& buffer,
+		VisibilitySample& sample,
+		double nearest_dist),
+	VisibilitySample& sample,
 	double nearest_dist,
-	Object* cuda_objects)
+	Statistics* statistics)
 {
+	if (statistics != nullptr) statistics->screen_query_count++;
+
 	Utils::ArrayStack<size_t> stack;
 	stack.Push(b_i);
 	while (!stack.IsEmpty())
@@ -171,12 +152,13 @@ __device__ void Kamanri::Renderer::World::__::BoundingBox$::MayScreenCover(
 
 		if (boxes[b_i].triangle_count == 1)
 		{
-			write_to_pixel_per_triangle(triangles.data[boxes[b_i].triangle_index], x, y, buffer, nearest_dist, cuda_objects);
+			if (statistics != nullptr) statistics->screen_visited_leaf_count++;
+			write_to_pixel_per_triangle(setups.data[boxes[b_i].triangle_index], x, y, sample, nearest_dist);
 			continue;
 		}
 		
 
 		stack.Push(LeftChildIndex(b_i));
-		stack.Push(RightChildIndex(b_i));
+		stack.Push(RightChildIndex(boxes, b_i));
 	}
 }
\ No newline at end of file
@@ -36,10 +36,7 @@ __device__ Kamanri::Renderer::World::FrameBuffer& Kamanri::Renderer::World::__::
 
 __device__ void Kamanri::Renderer::World::__::Buffers::InitPixel(size_t x, size_t y)
 {
-	auto& frame = GetFrame(x, y);
-	frame.location = Kamanri::Maths::Vector(4);
-	frame.location.Set(2, -DBL_MAX);
-	frame.vertex_normal = Kamanri::Maths::Vector(4);
+	GetFrame(x, y).depth = FrameBuffer$::EMPTY_DEPTH;
 	
 	auto& bitmap = GetBitmapBuffer(x, y);
 	bitmap = 0x0;
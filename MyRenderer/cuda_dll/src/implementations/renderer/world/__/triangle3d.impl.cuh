@@ -17,14 +17,16 @@ namespace Kamanri
 						return ((a00) * (a11) - (a10) * (a01));
 					}
 
-					__device__ inline double PerspectiveUndo(Maths::Vector const& areal_coordinates, double v1_factor, double v2_factor, double v3_factor)
+					/// @brief Interpolate the factors of vertices with perspective correction, q is given by the setup record
+					__device__ inline double PerspectiveCorrect(double q1, double q2, double q3, double v1_factor, double v2_factor, double v3_factor, double world_z)
 					{
-						return (1.0 / (areal_coordinates[0] / v1_factor + areal_coordinates[1] / v2_factor + areal_coordinates[2] / v3_factor));
+						return ((q1 * v1_factor + q2 * v2_factor + q3 * v3_factor) * world_z);
 					}
 
-					__device__ inline double PerspectiveCorrect(Maths::Vector const& areal_coordinates, double v1_factor, double v2_factor, double v3_factor, double c_v1_factor, double c_v2_factor, double c_v3_factor, double c_this_factor)
+					/// @brief Screen space derivative of the perspective corrected value, dq is q_dx or q_dy of the setup record
+					__device__ inline double PerspectiveDerivative(double dq1, double dq2, double dq3, double v1_factor, double v2_factor, double v3_factor, double value, double world_z)
 					{
-						return ((areal_coordinates[0] * v1_factor / c_v1_factor + areal_coordinates[1] * v2_factor / c_v2_factor + areal_coordinates[2] * v3_factor / c_v3_factor) * c_this_factor);
+						return ((dq1 * v1_factor + dq2 * v2_factor + dq3 * v3_factor - value * (dq1 + dq2 + dq3)) * world_z);
 					}
 
 					__device__ inline double Max(double x1, double x2, double x3)
@@ -49,34 +51,23 @@ namespace Kamanri
 } // namespace Kamanri
 
 
-__device__ void Kamanri::Renderer::World::__::Triangle3D::ScreenArealCoordinates(double x, double y, Maths::Vector& result) const
-{
-	result = { x, y, ScreenZ(x, y) };
-
-	// (v1, v2, v3, 0) (alpha, beta, gamma, 1)^T = target
-
-	_areal_coordinates_calculate_matrix* result;
-
-}
-
-
-__device__ bool Kamanri::Renderer::World::__::Triangle3D::IsScreenCover(double x, double y) const
+__device__ bool Kamanri::Renderer::World::__::Triangle3D$::SetupRecord::IsScreenCover(double x, double y) const
 {
 	using namespace __Triangle3D;
 	double v1_v2_xy_determinant = Determinant
 	(
-		_s_v2_x - _s_v1_x, x - _s_v1_x,
-		_s_v2_y - _s_v1_y, y - _s_v1_y
+		s_x[1] - s_x[0], x - s_x[0],
+		s_y[1] - s_y[0], y - s_y[0]
 	);
 	double v2_v3_xy_determinant = Determinant
 	(
-		_s_v3_x - _s_v2_x, x - _s_v2_x,
-		_s_v3_y - _s_v2_y, y - _s_v2_y
+		s_x[2] - s_x[1], x - s_x[1],
+		s_y[2] - s_y[1], y - s_y[1]
 	);
 	double v3_v1_xy_determinant = Determinant
 	(
-		_s_v1_x - _s_v3_x, x - _s_v3_x,
-		_s_v1_y - _s_v3_y, y - _s_v3_y
+		s_x[0] - s_x[2], x - s_x[2],
+		s_y[0] - s_y[2], y - s_y[2]
 	);
 
 	if (v1_v2_xy_determinant * v2_v3_xy_determinant >= 0 && v2_v3_xy_determinant * v3_v1_xy_determinant >= 0 && v3_v1_xy_determinant * v1_v2_xy_determinant >= 0)
@@ -87,122 +78,77 @@ __device__ bool Kamanri::Renderer::World::__::Triangle3D::IsScreenCover(double x
 	return false;
 }
 
-__device__ bool Kamanri::Renderer::World::__::Triangle3D::IsThrough(Maths::Vector& location, Maths::Vector& direction, double& output_distance)
-{
-	using namespace Maths;
-	// solve
-	// (x - x0) / dx = (y - y0) / dy = (z - z0) / dz
-	// ax + by + cz - 1 = 0
-	//
-	auto dxdy = direction[0] * direction[1];
-	auto dxdz = direction[0] * direction[2];
-	auto dydz = direction[1] * direction[2];
-	Vector conjunction =
-	{
-		location[0] * dydz - location[1] * dxdz,
-		location[0] * dydz - location[2] * dxdy,
-		1
-	};
-	SMatrix a =
-	{
-		dydz, -dxdz, 0,
-		dydz, 0, -dxdy,
-		_w_a, _w_b, _w_c
-	};
-
-	(-a)* conjunction;
-
-	// judge the cross product
-
-	Vector c_v1_v2 =
-	{
-		conjunction[0] - _w_v1_x,
-		conjunction[1] - _w_v1_y,
-		conjunction[2] - _w_v1_z,
-		1
-	};
-
-	Vector c_v2_v3 =
-	{
-		conjunction[0] - _w_v2_x,
-		conjunction[1] - _w_v2_y,
-		conjunction[2] - _w_v2_z,
-		1
-	};
-	Vector c_v3_v1 =
-	{
-		conjunction[0] - _w_v3_x,
-		conjunction[1] - _w_v3_y,
-		conjunction[2] - _w_v3_z,
-		1
-	};
-
-	c_v1_v2 *= _w_v1_v2;
-	c_v2_v3 *= _w_v2_v3;
-	c_v3_v1 *= _w_v3_v1;
-
-	if ((c_v1_v2 * c_v2_v3) >= 0 && (c_v2_v3 * c_v3_v1) >= 0 && (c_v3_v1 * c_v1_v2) >= 0)
-	{
-		Vector conjunction_4d =
-		{
-			conjunction[0], conjunction[1], conjunction[2], 1
-		};
-		output_distance = conjunction_4d - location;
-		return true;
-	}
-
-	return false;
-
-}
-
-
-__device__ void Kamanri::Renderer::World::__::Triangle3D::WriteToPixel(size_t x, size_t y, FrameBuffer& frame_buffer, double nearest_dist, Object* cuda_objects) const
+__device__ void Kamanri::Renderer::World::__::Triangle3D$::SetupRecord::WriteToPixel(size_t x, size_t y, VisibilitySample& sample, double nearest_dist) const
 {
 	using namespace __Triangle3D;
 	// pruning
-	if (x < Min(_s_v1_x, _s_v2_x, _s_v3_x) || x > Max(_s_v1_x, _s_v2_x, _s_v3_x)) return;
-	if (y < Min(_s_v1_y, _s_v2_y, _s_v3_y) || y > Max(_s_v1_y, _s_v2_y, _s_v3_y)) return;
+	if (x < Min(s_x[0], s_x[1], s_x[2]) || x > Max(s_x[0], s_x[1], s_x[2])) return;
+	if (y < Min(s_y[0], s_y[1], s_y[2]) || y > Max(s_y[0], s_y[1], s_y[2])) return;
 	if (!IsScreenCover(x, y)) return;
 
-	// get world location
-	Maths::Vector screen_areal_coordinates(3);
-	ScreenArealCoordinates(x, y, screen_areal_coordinates);
+	WriteToSample(
+		q_dx[0] * x + q_dy[0] * y + q_0[0],
+		q_dx[1] * x + q_dy[1] * y + q_0[1],
+		q_dx[2] * x + q_dy[2] * y + q_0[2],
+		sample, nearest_dist);
+}
 
-	double world_z = PerspectiveUndo(screen_areal_coordinates, _w_v1_z, _w_v2_z, _w_v3_z);
+__device__ bool Kamanri::Renderer::World::__::Triangle3D$::SetupRecord::WriteToSample(double q1, double q2, double q3, VisibilitySample& sample, double nearest_dist) const
+{
+	double world_z = 1 / (q1 + q2 + q3);
 
 	// z-buffer
-	if (world_z < frame_buffer.location[2] || world_z > nearest_dist) return;
+	if(world_z < sample.depth || world_z > nearest_dist) return false;
 
+	sample.depth = world_z;
+	sample.triangle_index = index;
+	return true;
+}
 
-	double world_x = PerspectiveCorrect(screen_areal_coordinates, _w_v1_x, _w_v2_x, _w_v3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
-	double world_y = PerspectiveCorrect(screen_areal_coordinates, _w_v1_y, _w_v2_y, _w_v3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
+__device__ void Kamanri::Renderer::World::__::Triangle3D$::AttributeRecord::Resolve(SetupRecord const& setup, size_t x, size_t y, FrameBuffer& frame_buffer, Object const* objects) const
+{
+	using namespace __Triangle3D;
+	auto& s = setup;
+	double q1 = s.q_dx[0] * x + s.q_dy[0] * y + s.q_0[0];
+	double q2 = s.q_dx[1] * x + s.q_dy[1] * y + s.q_0[1];
+	double q3 = s.q_dx[2] * x + s.q_dy[2] * y + s.q_0[2];
+	double world_z = 1 / (q1 + q2 + q3);
 
 	// *****************************************
 	// 透视矫正
 	// *****************************************
-	double img_u = PerspectiveCorrect(screen_areal_coordinates, _vt1_x, _vt2_x, _vt3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
-	double img_v = PerspectiveCorrect(screen_areal_coordinates, _vt1_y, _vt2_y, _vt3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
+	double img_u = PerspectiveCorrect(q1, q2, q3, vt_u[0], vt_u[1], vt_u[2], world_z);
+	double img_v = PerspectiveCorrect(q1, q2, q3, vt_v[0], vt_v[1], vt_v[2], world_z);
+
+	// the encoding only keeps the direction, so the normal needs no unitization
+	frame_buffer.normal = FrameBuffer$::EncodeNormal(
+		PerspectiveCorrect(q1, q2, q3, vn_x[0], vn_x[1], vn_x[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, vn_y[0], vn_y[1], vn_y[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, vn_z[0], vn_z[1], vn_z[2], world_z));
+
+	// uv footprint of the pixel selects the mip level
+	double du_dx = PerspectiveDerivative(s.q_dx[0], s.q_dx[1], s.q_dx[2], vt_u[0], vt_u[1], vt_u[2], img_u, world_z);
+	double dv_dx = PerspectiveDerivative(s.q_dx[0], s.q_dx[1], s.q_dx[2], vt_v[0], vt_v[1], vt_v[2], img_v, world_z);
+	double du_dy = PerspectiveDerivative(s.q_dy[0], s.q_dy[1], s.q_dy[2], vt_u[0], vt_u[1], vt_u[2], img_u, world_z);
+	double dv_dy = PerspectiveDerivative(s.q_dy[0], s.q_dy[1], s.q_dy[2], vt_v[0], vt_v[1], vt_v[2], img_v, world_z);
+	frame_buffer.color = FrameBuffer$::ALPHA_OPAQUE | objects[object_index].GetTexture().Sample(img_u, img_v, du_dx, dv_dx, du_dy, dv_dy);
+}
 
-	// write to buffers
-	frame_buffer.triangle_index = _index;
-	frame_buffer.location =
+__device__ void Kamanri::Renderer::World::__::Triangle3D$::AttributeRecord::Locate(SetupRecord const& setup, size_t x, size_t y, SurfacePoint& point) const
+{
+	using namespace __Triangle3D;
+	auto& s = setup;
+	double q1 = s.q_dx[0] * x + s.q_dy[0] * y + s.q_0[0];
+	double q2 = s.q_dx[1] * x + s.q_dy[1] * y + s.q_0[1];
+	double q3 = s.q_dx[2] * x + s.q_dy[2] * y + s.q_0[2];
+	double world_z = 1 / (q1 + q2 + q3);
+
+	point.triangle_index = s.index;
+	point.location = 
 	{
-		world_x,
-		world_y,
+		PerspectiveCorrect(q1, q2, q3, w_x[0], w_x[1], w_x[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, w_y[0], w_y[1], w_y[2], world_z),
 		world_z,
 		1
 	};
-
-	frame_buffer.vertex_normal =
-	{
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_x, _vn2_x, _vn3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_y, _vn2_y, _vn3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_z, _vn2_z, _vn3_z, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		0
-	};
-
-	frame_buffer.vertex_normal.Unitization();
-
-	frame_buffer.color = cuda_objects[_object_index].GetImage().Get(img_u, img_v).rgb;
-
-}
\ No newline at end of file
+}
@@ -9,16 +9,6 @@ namespace Kamanri
 		{
 			namespace __BlinnPhongReflectionModel
 			{
-				__device__ inline size_t Scan_R270(size_t height, size_t x, size_t y)
-				{
-					return ((height - (y + 1)) * height + x);
-				}
-
-				__device__ inline size_t LightBufferLoc(size_t width, size_t height, size_t index, size_t x, size_t y)
-				{
-					return (width * height * index + Scan_R270(height, x, y));
-				}
-
 				__device__ inline double SpecularTransition(double min_theta,  double theta)
 				{
 					return pow((theta - min_theta) / (1 - min_theta), 3);
@@ -38,95 +28,56 @@ namespace Kamanri
 
 
 
-__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::InitLightBufferPixel(size_t x, size_t y, FrameBuffer& buffer)
+__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::InitLightBufferPixel(BlinnPhongReflectionModel$::PointLightBufferItem* light_buffer_items)
 {
-	using namespace __BlinnPhongReflectionModel;
 	for (size_t i = 0; i < _cuda_point_lights.size; i++)
 	{
-		auto& this_item = _cuda_lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
+		auto& this_item = light_buffer_items[i];
 		this_item.distance = DBL_MAX;
-		this_item.is_exposed = true;
+		this_item.exposure = 1;
 		this_item.is_specular = false;
 	}
 
 }
 
-__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildPerTriangleLightPixel(size_t x, size_t y, __::Triangle3D& triangle, size_t point_light_index, FrameBuffer& buffer)
+__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildSpecularLightPixel(BlinnPhongReflectionModel$::PointLightBufferItem& light_buffer_item, size_t point_light_index, SurfacePoint const& point)
 {
 	using namespace __BlinnPhongReflectionModel;
-	auto& light_buffer_item = _cuda_lights_buffer[LightBufferLoc(_screen_width, _screen_height, point_light_index, x, y)];
 	auto& light_location = _cuda_point_lights.data[point_light_index].location_model_view_transformed;
-	auto light_point_distance = light_location - buffer.location;
-	if (triangle.Index() == buffer.triangle_index)
-	{
-		if (light_point_distance < light_buffer_item.distance) light_buffer_item.distance = light_point_distance;
-
-		// judge whether is specular
-		// camera is at (0, 0, 0, 1)
-		auto point_camera_add_point_light_vector = light_location;
-		point_camera_add_point_light_vector += { 0, 0, 0, 1 };
-		point_camera_add_point_light_vector -= buffer.location;
-		point_camera_add_point_light_vector -= buffer.location;
-
-		point_camera_add_point_light_vector.Unitization();
-		auto cos_theta = point_camera_add_point_light_vector * buffer.vertex_normal;
-		if (cos_theta >= _specular_min_cos)
-		{
-			light_buffer_item.is_specular = true;
-			light_buffer_item.specular_factor = SpecularTransition(_specular_min_cos, cos_theta);
-		}
-	}
-	else
+	auto light_point_distance = light_location - point.location;
+	if (light_point_distance < light_buffer_item.distance) light_buffer_item.distance = light_point_distance;
+
+	// judge whether is specular
+	// camera is at (0, 0, 0, 1)
+	auto point_camera_add_point_light_vector = light_location;
+	point_camera_add_point_light_vector += { 0, 0, 0, 1 };
+	point_camera_add_point_light_vector -= point.location;
+	point_camera_add_point_light_vector -= point.location;
+
+	point_camera_add_point_light_vector.Unitization();
+	auto cos_theta = point_camera_add_point_light_vector * point.vertex_normal;
+	if (cos_theta >= _specular_min_cos)
 	{
-		auto light_point_direction = buffer.location;
-		light_point_direction -= light_location;
-
-		double light_triangle_distance;
-		if (triangle.IsThrough(light_location, light_point_direction, light_triangle_distance))
-		{
-			if (light_triangle_distance < light_point_distance)
-			{
-				light_buffer_item.distance = light_triangle_distance;
-				light_buffer_item.is_exposed = false;
-			}
-		}
-	}
-}
-
-__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildPerTrianglePixel(size_t x, size_t y, __::Triangle3D& triangle, FrameBuffer& buffer)
-{
-	for (size_t i = 0; i < _cuda_point_lights.size; i++)
-	{
-		__BuildPerTriangleLightPixel(x, y, triangle, i, buffer);
+		light_buffer_item.is_specular = true;
+		light_buffer_item.specular_factor = SpecularTransition(_specular_min_cos, cos_theta);
 	}
-
 }
 
-__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildShadowPixel(size_t x, size_t y, Utils::List<__::Triangle3D> triangles, __::BoundingBox* boxes, FrameBuffer& buffer)
+__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildShadowPixel(BlinnPhongReflectionModel$::PointLightBufferItem* light_buffer_items, Utils::List<__::Triangle3D> triangles, __::BoundingBox* boxes, SurfacePoint& point, __::BoundingBox$::Statistics* statistics)
 {
 	// Utils::ArrayStack<size_t> triangle_index_stack;
 	using namespace __BlinnPhongReflectionModel;
 	for (size_t i = 0; i < _cuda_point_lights.size; i++)
 	{
 		auto& light_location = _cuda_point_lights.data[i].location_model_view_transformed;
-		auto& light_buffer_item = _cuda_lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
-		auto light_point_direction = buffer.location;
-		light_point_direction -= light_location;
-		__::BoundingBox$::MayThrough(
-			boxes, 
-			0, 
-			triangles, 
-			light_location, 
-			light_point_direction, 
-			light_buffer_item, 
-			[](BlinnPhongReflectionModel& bpr_model, 
-			size_t x, 
-			size_t y, 
-			__::Triangle3D& triangle, 
-			size_t point_light_index, 
-			FrameBuffer& buffer){
-				bpr_model.__BuildPerTriangleLightPixel(x, y, triangle, point_light_index, buffer);
-			}, *this, x, y, i, buffer);
+		auto& light_buffer_item = light_buffer_items[i];
+		// out of the radius, not lit anyway
+		if (light_location - point.location > _cuda_point_lights.data[i].radius) continue;
+		// the specular does not depend on the occlusion query, which skips the triangle of the point
+		__BuildSpecularLightPixel(light_buffer_item, i, point);
+
+		if (__::BoundingBox$::Occluded(boxes, 0, triangles, light_location, point.location, point.triangle_index, statistics) != __::Triangle3D$::INEXIST_INDEX)
+			light_buffer_item.exposure = 0;
 		
 	}
 	
@@ -137,53 +88,54 @@ __device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::__BuildShad
 /// @param location 
 /// @param normal 
 /// @param reflect_point 
-__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::WriteToPixel(size_t x, size_t y, FrameBuffer& buffer, DWORD& pixel)
+__device__ void Kamanri::Renderer::World::BlinnPhongReflectionModel::WriteToPixel(BlinnPhongReflectionModel$::PointLightBufferItem const* light_buffer_items, SurfacePoint& point, DWORD& pixel)
 {
 	using namespace __BlinnPhongReflectionModel;
-	buffer.r = buffer.g = buffer.b = 0;
-	buffer.power = 0;
-	buffer.specular_color = buffer.diffuse_color = buffer.ambient_color = 0;
+	// accumulators of the lights, transient
+	unsigned int specular_color = 0, diffuse_color = 0;
 	for (size_t i = 0; i < _cuda_point_lights.size; i++)
 	{
 		// Do
-		auto& light_buffer_item = _cuda_lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
-		auto distance = _cuda_point_lights.data[i].location_model_view_transformed - buffer.location;
+		auto& light_buffer_item = light_buffer_items[i];
+		auto distance = _cuda_point_lights.data[i].location_model_view_transformed - point.location;
+		if (distance > _cuda_point_lights.data[i].radius) continue;
 		auto direction = _cuda_point_lights.data[i].location_model_view_transformed;
-		direction -= buffer.location;
+		direction -= point.location;
 		direction.Unitization();
 
 		// power = theta / S * cos(theta)
-		auto cos_theta = (buffer.vertex_normal * direction);
+		auto cos_theta = (point.vertex_normal * direction);
 
 		if (cos_theta <= 0) continue;
 
 		auto power = (_cuda_point_lights.data[i].power / (4 * Maths::PI * pow(distance, 2))) * cos_theta;
-		buffer.power += power;
 
+		// reflected color of this light only, so a light out of its radius changes nothing of the others
 		auto receive_light_color = BlinnPhongReflectionModel$::RGBMul(_cuda_point_lights.data[i].color, power);
+		unsigned int r = 0, g = 0, b = 0;
 		BlinnPhongReflectionModel$::DivideRGB(
-			BlinnPhongReflectionModel$::RGBReflect(receive_light_color, buffer.color),
-			buffer.r, buffer.g, buffer.b,
+			BlinnPhongReflectionModel$::RGBReflect(receive_light_color, point.color),
+			r, g, b,
 			BlinnPhongReflectionModel$::AddHandle
 		);
 
-		buffer.specular_color += GenerizeReflection(buffer.r, buffer.g, buffer.b, power * light_buffer_item.specular_factor * light_buffer_item.is_specular * light_buffer_item.is_exposed);
-		buffer.diffuse_color += GenerizeReflection(buffer.r, buffer.g, buffer.b, power * _diffuse_factor * light_buffer_item.is_exposed);
+		specular_color += GenerizeReflection(r, g, b, power * light_buffer_item.specular_factor * light_buffer_item.is_specular * light_buffer_item.exposure);
+		diffuse_color += GenerizeReflection(r, g, b, power * _diffuse_factor * light_buffer_item.exposure);
 
-		// if(light_buffer_item.is_exposed)
+		// if(light_buffer_item.exposure != 0)
 		// {
-		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "buffer(%llu, %llu) diffuse color: %6.X", x, y, buffer.diffuse_color);
+		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "point(%llu, %llu) diffuse color: %6.X", x, y, diffuse_color);
 		// }
-		// if(light_buffer_item.is_specular && light_buffer_item.is_exposed)
+		// if(light_buffer_item.is_specular && light_buffer_item.exposure != 0)
 		// {
-		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "buffer(%llu, %llu) specular color: %6.X", x, y, buffer.specular_color);
+		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "point(%llu, %llu) specular color: %6.X", x, y, specular_color);
 		// }
 
 	}
 
-	buffer.ambient_color += BlinnPhongReflectionModel$::RGBMul(buffer.color, _ambient_factor);
+	auto ambient_color = BlinnPhongReflectionModel$::RGBMul(point.color, _ambient_factor);
 
-	pixel = BlinnPhongReflectionModel$::RGBAdd(buffer.ambient_color, buffer.diffuse_color, buffer.specular_color);
+	pixel = BlinnPhongReflectionModel$::RGBAdd(ambient_color, diffuse_color, specular_color);
 
 	// DevicePrint("%X ", pixel);
 }
@@ -1,38 +1,54 @@
 #pragma once
 #include "kamanri/renderer/world/world3d.hpp"
 
-__device__ void Kamanri::Renderer::World::World3D::__BuildForPixel(size_t x, size_t y)
+__device__ void Kamanri::Renderer::World::World3D::__BuildForPixel(size_t x, size_t y, __::BoundingBox$::Statistics* statistics)
 {
 	// set z = infinity
 	_buffers.InitPixel(x, y);
 
-	auto& buffer = _buffers.GetFrame(x, y);
-	auto& bitmap_pixel = _buffers.GetBitmapBuffer(x, y);
+	VisibilitySample sample;
+	sample.depth = -DBL_MAX;
 
 	__::BoundingBox$::MayScreenCover(
 		_environment.cuda_boxes.data,
-		0, _environment.cuda_triangles,
+		0, _environment.cuda_setups,
 		x, y,
 		[](
-			__::Triangle3D& triangle,
+			__::Triangle3D$::SetupRecord const& setup,
 			size_t x,
 			size_t y,
-			FrameBuffer& buffer,
-			double nearest_dist,
-			Object* cuda_objects)
+			VisibilitySample& sample,
+			double nearest_dist)
 	{
-		triangle.WriteToPixel(x, y, buffer, nearest_dist, cuda_objects);
-	}, buffer, _camera.NearestDist(), _environment.cuda_objects.data);
+		setup.WriteToPixel(x, y, sample, nearest_dist);
+	}, sample, _camera.NearestDist(), statistics);
+
+	if (sample.depth == -DBL_MAX) return;
 
-	if (_buffers.GetFrame(x, y).location[2] == -DBL_MAX) return;
+	auto& frame_buffer = _buffers.GetFrame(x, y);
+	frame_buffer.depth = (float)sample.depth;
+	frame_buffer.triangle_index = (std::uint32_t)sample.triangle_index;
+	auto& setup = _environment.cuda_setups.data[sample.triangle_index];
+	auto& attributes = _environment.cuda_attributes.data[sample.triangle_index];
+	attributes.Resolve(setup, x, y, frame_buffer, _environment.cuda_objects.data);
+
+	// every thread shades its pixel right after the visibility
+	auto& bitmap_pixel = _buffers.GetBitmapBuffer(x, y);
+	SurfacePoint point;
+	attributes.Locate(setup, x, y, point);
+	double normal_x, normal_y, normal_z;
+	FrameBuffer$::DecodeNormal(frame_buffer.normal, normal_x, normal_y, normal_z);
+	point.vertex_normal = { normal_x, normal_y, normal_z, 0 };
+	point.color = frame_buffer.color & ~FrameBuffer$::ALPHA_OPAQUE;
 
 	// set distance = infinity, is exposed.
-	_environment.bpr_model.InitLightBufferPixel(x, y, buffer);
+	auto light_buffer_items = _environment.bpr_model.CUDALightBufferPixel(x, y);
+	_environment.bpr_model.InitLightBufferPixel(light_buffer_items);
 
 	if(_configs.is_shadow_mapping)
-		_environment.bpr_model.__BuildShadowPixel(x, y, _environment.cuda_triangles, _environment.cuda_boxes.data, buffer);
+		_environment.bpr_model.__BuildShadowPixel(light_buffer_items, _environment.cuda_triangles, _environment.cuda_boxes.data, point, statistics);
 
-	_environment.bpr_model.WriteToPixel(x, y, buffer, bitmap_pixel);
+	_environment.bpr_model.WriteToPixel(light_buffer_items, point, bitmap_pixel);
 
 
-}
\ No newline at end of file
+}
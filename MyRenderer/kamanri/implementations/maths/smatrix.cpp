@@ -1,5 +1,4 @@
 #include <cmath>
-#include <algorithm>
 #include <vector>
 #include "kamanri/maths/smatrix.hpp"
 #include "kamanri/utils/log.hpp"
@@ -38,50 +37,14 @@ namespace Kamanri
 				return result;
 			}
 
-			bool RemoveFromList(std::vector<size_t> &list, size_t item, size_t& out_index)
-			{
-				auto size = list.size();
-				for (size_t i = 0; i < size; i++)
-				{
-					if (list[i] == item)
-					{
-						out_index = i;
-						list.erase(list.begin() + i);
-						return true;
-					}
-				}
-				return false;
-			}
-
-			/**
-			 * @brief Get the Sorted Index of object
-			 *
-			 * @param list
-			 * @param value
-			 * @return size_t
-			 */
-			size_t GetSortedIndex(std::vector<std::size_t> list, size_t value)
-			{
-				std::sort(list.begin(), list.end());
-				auto result = 0;
-				for (auto i = list.begin(); i != list.end(); i++)
-				{
-					if (*i == value)
-					{
-						return result;
-					}
-					result++;
-				}
-				return 0xFFFFFFFFFFFFFFFF;
-			}
-
 			/// @brief (-1)^RON
 			/// @param v 
+			/// @param count 
 			/// @return 
-			int Pow_NegativeOne_ReverseOrderNumber(std::vector<size_t>& v)
+			int Pow_NegativeOne_ReverseOrderNumber(size_t const* v, size_t count)
 			{
 				int res = 1;
-				for (size_t i = 1; i < v.size(); i++)
+				for (size_t i = 1; i < count; i++)
 				{
 					for (size_t j = 0; j < i; j++)
 					{
@@ -109,24 +72,45 @@ namespace Kamanri
 				return (SMGet(sm, n, row_1, col_1) * SMDet2(sm, n, row_2, row_3, col_2, col_3) - SMGet(sm, n, row_2, col_1) * SMDet2(sm, n, row_1, row_3, col_2, col_3) + SMGet(sm, n, row_3, col_1) * SMDet2(sm, n, row_1, row_2, col_2, col_3));
 			}
 
-			namespace operator_star_Vector
+			/// @brief Closed-form determinant of the whole 2 * 2, 3 * 3 or 4 * 4 matrix, expanded by the first column without any allocation
+			inline SMatrixElemType SMDet(SMatrixElemType* sm, size_t n)
 			{
-				Vector v_temp;
+				switch (n)
+				{
+				case 2:
+					return SMDet2(sm, n, 0, 1, 0, 1);
+				case 3:
+					return SMDet3(sm, n, 0, 1, 2, 0, 1, 2);
+				case 4:
+					return SMGet(sm, n, 0, 0) * SMDet3(sm, n, 1, 2, 3, 1, 2, 3) -
+						SMGet(sm, n, 1, 0) * SMDet3(sm, n, 0, 2, 3, 1, 2, 3) +
+						SMGet(sm, n, 2, 0) * SMDet3(sm, n, 0, 1, 3, 1, 2, 3) -
+						SMGet(sm, n, 3, 0) * SMDet3(sm, n, 0, 1, 2, 1, 2, 3);
+				default:
+					return SMatrix$::NOT_INITIALIZED_VALUE;
+				}
 			}
 
-			namespace Determinant
+			/// @brief Closed-form determinant of the count * count matrix picked by rows and cols in their given order, count <= 4, without any allocation
+			inline SMatrixElemType SMDet(SMatrixElemType* sm, size_t n, size_t const* rows, size_t const* cols, size_t count)
 			{
-				std::vector<std ::size_t> row_list;
-				std::vector<std ::size_t> col_list;
-			} // namespace Determinant
-
-			namespace AComplement
-			{
-				std::vector<std ::size_t> row_list;
-				std::vector<std ::size_t> col_list;
-			} // namespace AComplement
-			
-			
+				switch (count)
+				{
+				case 1:
+					return SMGet(sm, n, rows[0], cols[0]);
+				case 2:
+					return SMDet2(sm, n, rows[0], rows[1], cols[0], cols[1]);
+				case 3:
+					return SMDet3(sm, n, rows[0], rows[1], rows[2], cols[0], cols[1], cols[2]);
+				case 4:
+					return SMGet(sm, n, rows[0], cols[0]) * SMDet3(sm, n, rows[1], rows[2], rows[3], cols[1], cols[2], cols[3]) -
+						SMGet(sm, n, rows[1], cols[0]) * SMDet3(sm, n, rows[0], rows[2], rows[3], cols[1], cols[2], cols[3]) +
+						SMGet(sm, n, rows[2], cols[0]) * SMDet3(sm, n, rows[0], rows[1], rows[3], cols[1], cols[2], cols[3]) -
+						SMGet(sm, n, rows[3], cols[0]) * SMDet3(sm, n, rows[0], rows[1], rows[2], cols[1], cols[2], cols[3]);
+				default:
+					return 0;
+				}
+			}
 		}
 	}
 }
@@ -522,7 +506,6 @@ SMatrixCode SMatrix::operator*=(SMatrixElemType value)
 
 SMatrixCode SMatrix::operator*(Vector& v) const
 {
-	using namespace __SMatrix::operator_star_Vector;
 	if (_N != v.N())
 	{
 		Log::Error(__SMatrix::LOG_NAME, "Call of SMatrix::operator*: matrix and vector of unequal length: %d and %d", _N, v.N());
@@ -530,7 +513,8 @@ SMatrixCode SMatrix::operator*(Vector& v) const
 		return SMatrix$::CODE_NOT_EQUEL_N;
 	}
 	
-	v_temp = v;
+	// keep it on stack, SMatrix * Vector is used by every pixel from multiple threads
+	Vector v_temp = v;
 	
 	double value = 0;
 
@@ -653,7 +637,7 @@ SMatrixCode SMatrix::PrintMatrix(LogLevel level, const char *decimal_count) cons
 SMatrix SMatrix::operator*() const
 {
 
-	if(_N != 3 && _N != 4)
+	if(_N != 2 && _N != 3 && _N != 4)
 	{
 		Log::Error(__SMatrix::LOG_NAME, "operator* not allowed when _N = %llu", _N);
 		PRINT_LOCATION;
@@ -662,6 +646,16 @@ SMatrix SMatrix::operator*() const
 
 	auto p_sm = (SMatrixElemType*)_SM;
 
+	if(_N == 2)
+	{
+		SMatrix ret_sm = 
+		{
+			p_sm[3], -p_sm[1],
+			-p_sm[2], p_sm[0]
+		};
+		return ret_sm;
+	}
+
 	if(_N == 3)
 	{
 		SMatrix ret_sm = 
@@ -686,74 +680,6 @@ SMatrix SMatrix::operator*() const
 } 
 
 
-/**
- * @brief Calculate the determinant of matrix recursively, already checked:
- * row_count == col_count
- * 
- * @param sm 
- * @param row_from 
- * @param row_end 
- * @param col_from 
- * @param col_end 
- * @return PMyResult<SMatrixElemType>> 
- */
-SMatrixElemType SMatrix::_Determinant(SMatrixElemType* psm, std::vector<std::size_t>& row_list, std::vector<std::size_t>& col_list) const
-{
-	using namespace __SMatrix;
-	auto row_count = row_list.size();
-	SMatrixElemType result = 0;
-
-	if (row_count < 4)
-	{
-		if (row_count == 1) result = SMGet(psm, _N, row_list[0], col_list[0]);
-		if (row_count == 2) result = SMDet2(psm, _N, row_list[0], row_list[1], col_list[0], col_list[1]);
-		if (row_count == 3) result = SMDet3(psm, _N, row_list[0], row_list[1], row_list[2], col_list[0], col_list[1], col_list[2]);
-		if (row_count == 4)
-		{
-			result = SMGet(psm, _N, row_list[0], col_list[0]) * SMDet3(psm, _N, 1, 2, 3, 1, 2, 3) -
-			SMGet(psm, _N, row_list[1], col_list[0]) * SMDet3(psm, _N, row_list[0], row_list[2], row_list[3], col_list[1], col_list[2], col_list[3]) +
-			SMGet(psm, _N, row_list[2], col_list[0]) * SMDet3(psm, _N, row_list[0], row_list[1], row_list[3], col_list[1], col_list[2], col_list[3]) -
-			SMGet(psm, _N, row_list[3], col_list[0]) * SMDet3(psm, _N, row_list[0], row_list[1], row_list[2], col_list[1], col_list[2], col_list[3]);
-		}
-		// This is to avoid the bigger index is in front of the smaller
-		result *= __SMatrix::Pow_NegativeOne_ReverseOrderNumber(row_list);
-		result *= __SMatrix::Pow_NegativeOne_ReverseOrderNumber(col_list);
-
-		return result;
-	}
-	
-
-
-	/// row_count > 4
-	size_t col_first = col_list.front();
-	size_t col_first_sorted = __SMatrix::GetSortedIndex(col_list, col_first);
-	col_list.erase(col_list.begin());
-
-	for(size_t i = 0; i < row_count; i++)
-	{
-		size_t row_first = row_list[0];
-		size_t row_first_sorted = __SMatrix::GetSortedIndex(row_list, row_first);
-		row_list.erase(row_list.begin());
-		//////////////////////// calculate sub result
-		auto value = psm[_N * row_first + col_first];
-
-		// use -1^(a+b) * n * |A*_ab| to calculate
-		auto result_sub = (
-			_Determinant(psm, row_list, col_list) * 
-			value * 
-			(((row_first_sorted + col_first_sorted) % 2 == 0) ? 1.f : -1.f));
-
-		result += result_sub;
-
-		//////////////////////// calculate sub result
-		row_list.push_back(row_first);
-	}
-
-	col_list.insert(col_list.begin(), col_first);
-
-	return result;
-}
-
 // TODO: 
 // make calc determinant returns vector as
 // vector = |i, j, k...| avaliable.
@@ -786,48 +712,22 @@ SMatrixElemType SMatrix::Determinant(std::vector<std::size_t> row_list, std::vec
 	}
 	
 
-	SMatrixElemType res = _Determinant((SMatrixElemType*)_SM, row_list, col_list);
-
-	return res;
+	// the submatrix is taken in the ascending order of its rows and columns
+	return __SMatrix::SMDet((SMatrixElemType*)_SM, _N, row_list.data(), col_list.data(), row_count) *
+		__SMatrix::Pow_NegativeOne_ReverseOrderNumber(row_list.data(), row_count) *
+		__SMatrix::Pow_NegativeOne_ReverseOrderNumber(col_list.data(), col_count);
 
 }
 
 SMatrixElemType SMatrix::Determinant() const
 {
-	using namespace __SMatrix::Determinant;
-	switch (_N)
-	{
-	case 2:
-		row_list = col_list = {0, 1};
-		break;
-	case 3:
-		row_list = col_list = {0, 1, 2};
-		break;
-	case 4:
-		row_list = col_list = {0, 1, 2, 3};
-		break;
-	default:
+	if(_N < 2 || _N > 4)
+	{
 		Log::Error(__SMatrix::LOG_NAME, "Invalid dimension %d", _N);
-		break;
-	}
-	return _Determinant((SMatrixElemType*)_SM, row_list, col_list);
-}
-
-SMatrixElemType SMatrix::_AComplement(SMatrixElemType* psm, std::vector<size_t>& row_list, std::vector<size_t>& col_list, size_t row, size_t col) const
-{
-	size_t row_index, col_index;
-	if(!__SMatrix::RemoveFromList(row_list, row, row_index) || !__SMatrix::RemoveFromList(col_list, col, col_index))
-	{   
-		Log::Error(__SMatrix::LOG_NAME, "The row %d is not in row_list or the col %d is not in col_list", row, col);
 		PRINT_LOCATION;
-		return -1;
+		return SMatrix$::NOT_INITIALIZED_VALUE;
 	}
-
-	// return the determinant * -1^(a+b)
-	auto d = _Determinant(psm, row_list, col_list) * (((row + col) % 2 == 0) ? 1.f : -1.f);
-	row_list.insert(row_list.begin() + row_index, row);
-	col_list.insert(col_list.begin() + col_index, col);
-	return d;
+	return __SMatrix::SMDet((SMatrixElemType*)_SM, _N);
 }
 
 /**
@@ -846,14 +746,21 @@ SMatrixElemType SMatrix::AComplement(size_t row, size_t col) const
 		return SMatrix$::NOT_INITIALIZED_VALUE;
 	}
 
-	using namespace __SMatrix::AComplement;
-	row_list.clear();
-	col_list.clear();
-	for (size_t i= 0; i < _N; i++)
+	size_t rows[SMatrix$::MAX_SUPPORTED_DIMENSION];
+	size_t cols[SMatrix$::MAX_SUPPORTED_DIMENSION];
+	size_t count = 0;
+	for (size_t i = 0; i < _N; i++)
 	{
-		row_list.push_back(i);
-		col_list.push_back(i);
+		if (i == row) continue;
+		rows[count++] = i;
+	}
+	count = 0;
+	for (size_t i = 0; i < _N; i++)
+	{
+		if (i == col) continue;
+		cols[count++] = i;
 	}
 
-	return _AComplement((SMatrixElemType*)_SM, row_list, col_list, row, col);
+	// return the determinant * -1^(a+b)
+	return __SMatrix::SMDet((SMatrixElemType*)_SM, _N, rows, cols, count) * (((row + col) % 2 == 0) ? 1.f : -1.f);
 }
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "kamanri/renderer/asset_cache.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/utils/string.hpp"
+
+using namespace Kamanri::Utils;
+using namespace Kamanri::Renderer;
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		namespace __AssetCache
+		{
+			constexpr const char* LOG_NAME = STR(Kamanri::Renderer::AssetCache);
+
+			bool _is_enabled = true;
+			std::string _directory;
+
+			/// @brief Get the size and the last write time of the file
+			bool GetStamp(std::string const& file_name, std::uint64_t& size, std::int64_t& time)
+			{
+				std::error_code error;
+				auto file_size = std::filesystem::file_size(file_name, error);
+				if (error) return false;
+				auto file_time = std::filesystem::last_write_time(file_name, error);
+				if (error) return false;
+				size = (std::uint64_t)file_size;
+				time = (std::int64_t)file_time.time_since_epoch().count();
+				return true;
+			}
+
+			inline std::uint64_t AlignSection(std::uint64_t offset)
+			{
+				return (offset + AssetCache$::SECTION_ALIGNMENT - 1) / AssetCache$::SECTION_ALIGNMENT * AssetCache$::SECTION_ALIGNMENT;
+			}
+
+			constexpr std::uint64_t CHECKSUM_OFFSET = 1469598103934665603ULL;
+			constexpr std::uint64_t CHECKSUM_PRIME = 1099511628211ULL;
+
+			/// @brief FNV-1a over 64-bit words, the high half is folded into the low half after every word so every bit reaches the whole state
+			std::uint64_t Checksum(std::uint64_t checksum, void const* data, size_t size)
+			{
+				auto bytes = (std::uint8_t const*)data;
+				size_t i = 0;
+				for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+				{
+					std::uint64_t word;
+					memcpy(&word, bytes + i, sizeof(word));
+					checksum = (checksum ^ word) * CHECKSUM_PRIME;
+					checksum ^= checksum >> 32;
+				}
+				for (; i < size; i++)
+				{
+					checksum = (checksum ^ bytes[i]) * CHECKSUM_PRIME;
+				}
+				return checksum;
+			}
+
+			/// @brief A temporary file next to the cache, unique for every process and thread which may write the same cache at once
+			std::string TempFileName(std::string const& cache_file_name)
+			{
+#ifdef _WIN32
+				auto process_id = (unsigned long long)_getpid();
+#else
+				auto process_id = (unsigned long long)getpid();
+#endif
+				auto thread_id = (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id());
+				char suffix[64];
+				snprintf(suffix, sizeof(suffix), ".%llu.%016llx.tmp", process_id, thread_id);
+				return cache_file_name + suffix;
+			}
+		} // namespace __AssetCache
+		
+	} // namespace Renderer
+	
+} // namespace Kamanri
+
+
+bool AssetCache::IsEnabled()
+{
+	return __AssetCache::_is_enabled;
+}
+
+void AssetCache::SetEnabled(bool is_enabled)
+{
+	__AssetCache::_is_enabled = is_enabled;
+}
+
+std::string const& AssetCache::Directory()
+{
+	return __AssetCache::_directory;
+}
+
+void AssetCache::SetDirectory(std::string const& directory)
+{
+	__AssetCache::_directory = directory;
+}
+
+std::string AssetCache::PathOf(std::string const& source_file_name)
+{
+	if (__AssetCache::_directory.empty()) return source_file_name + ".cache";
+
+	// sources of the same name in different directories are told apart by the hash of the absolute path
+	std::error_code error;
+	auto source_path = std::filesystem::absolute(source_file_name, error);
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)std::hash<std::string>()(source_path.string()));
+	auto file_name = std::filesystem::path(source_file_name).filename().string() + "." + hash + ".cache";
+	return (std::filesystem::path(__AssetCache::_directory) / file_name).string();
+}
+
+AssetCache::AssetCache(P<MappedFile> file): _file(std::move(file)), _header((AssetCache$::Header const*)_file->Data()) {}
+
+P<AssetCache> AssetCache::Open(std::string const& source_file_name, std::uint32_t type)
+{
+	std::uint64_t source_size;
+	std::int64_t source_time;
+	if (!__AssetCache::GetStamp(source_file_name, source_size, source_time)) return nullptr;
+
+	auto cache_file_name = PathOf(source_file_name);
+	std::error_code error;
+	if (!std::filesystem::exists(cache_file_name, error)) return nullptr;
+
+	auto file = New<MappedFile>(cache_file_name);
+	if (!file->IsOpen() || file->Size() < sizeof(AssetCache$::Header)) return nullptr;
+
+	auto header = (AssetCache$::Header const*)file->Data();
+	if (header->magic != AssetCache$::MAGIC || header->version != AssetCache$::VERSION || header->type != type ||
+		header->section_count > AssetCache$::MAX_SECTION_COUNT)
+	{
+		Log::Debug(__AssetCache::LOG_NAME, "The cache %s is of another version or type", cache_file_name.c_str());
+		return nullptr;
+	}
+	if (header->source_size != source_size || header->source_time != source_time)
+	{
+		Log::Debug(__AssetCache::LOG_NAME, "The cache %s is stale", cache_file_name.c_str());
+		return nullptr;
+	}
+	for (std::uint32_t i = 0; i < header->section_count; i++)
+	{
+		if (header->section_offsets[i] > file->Size() || header->section_sizes[i] > file->Size() - header->section_offsets[i])
+		{
+			Log::Warn(__AssetCache::LOG_NAME, "The cache %s is truncated", cache_file_name.c_str());
+			return nullptr;
+		}
+	}
+
+	auto checksum = __AssetCache::CHECKSUM_OFFSET;
+	for (std::uint32_t i = 0; i < header->section_count; i++)
+	{
+		checksum = __AssetCache::Checksum(checksum, file->Data() + header->section_offsets[i], header->section_sizes[i]);
+	}
+	if (checksum != header->checksum)
+	{
+		Log::Warn(__AssetCache::LOG_NAME, "The cache %s is corrupt", cache_file_name.c_str());
+		return nullptr;
+	}
+
+	return P<AssetCache>(new AssetCache(std::move(file)));
+}
+
+bool AssetCache::Write(std::string const& source_file_name, std::uint32_t type, std::initializer_list<AssetCache$::Section> sections)
+{
+	AssetCache$::Header header = {};
+	if (sections.size() > AssetCache$::MAX_SECTION_COUNT || !__AssetCache::GetStamp(source_file_name, header.source_size, header.source_time))
+	{
+		return false;
+	}
+	header.magic = AssetCache$::MAGIC;
+	header.version = AssetCache$::VERSION;
+	header.type = type;
+	header.section_count = (std::uint32_t)sections.size();
+
+	header.checksum = __AssetCache::CHECKSUM_OFFSET;
+
+	std::uint64_t offset = sizeof(header);
+	size_t i = 0;
+	for (auto const& section : sections)
+	{
+		offset = __AssetCache::AlignSection(offset);
+		header.section_offsets[i] = offset;
+		header.section_sizes[i] = section.size;
+		header.checksum = __AssetCache::Checksum(header.checksum, section.data, section.size);
+		offset += section.size;
+		i++;
+	}
+
+	auto cache_file_name = PathOf(source_file_name);
+	std::error_code error;
+	if (!__AssetCache::_directory.empty()) std::filesystem::create_directories(__AssetCache::_directory, error);
+
+	// write to a temporary file of this writer only and rename it, so a cache being read is never half written
+	auto temp_file_name = __AssetCache::TempFileName(cache_file_name);
+	{
+		std::ofstream out(temp_file_name, std::ios::binary | std::ios::trunc);
+		out.write((char const*)&header, sizeof(header));
+		char const padding[AssetCache$::SECTION_ALIGNMENT] = {};
+		std::uint64_t written = sizeof(header);
+		i = 0;
+		for (auto const& section : sections)
+		{
+			out.write(padding, header.section_offsets[i] - written);
+			if (section.size != 0) out.write((char const*)section.data, section.size);
+			written = header.section_offsets[i] + section.size;
+			i++;
+		}
+		if (!out.good())
+		{
+			out.close();
+			std::filesystem::remove(temp_file_name, error);
+			Log::Warn(__AssetCache::LOG_NAME, "Cannot write the cache %s", cache_file_name.c_str());
+			return false;
+		}
+	}
+	std::filesystem::rename(temp_file_name, cache_file_name, error);
+	if (error)
+	{
+		std::filesystem::remove(temp_file_name, error);
+		Log::Warn(__AssetCache::LOG_NAME, "Cannot write the cache %s", cache_file_name.c_str());
+		return false;
+	}
+
+	Log::Debug(__AssetCache::LOG_NAME, "Cache %s written, %llu bytes", cache_file_name.c_str(), offset);
+	return true;
+}
@@ -1,12 +1,16 @@
-#include <fstream>
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include "kamanri/utils/log.hpp"
 #include "kamanri/renderer/obj_model.hpp"
+#include "kamanri/renderer/asset_cache.hpp"
+#include "kamanri/utils/mapped_file.hpp"
 #include "kamanri/utils/string.hpp"
+#include "kamanri/utils/thread.hpp"
 #include "kamanri/utils/result.hpp"
 
 using namespace Kamanri::Utils;
 using namespace Kamanri::Renderer;
-using namespace Kamanri::Utils::String;
 
 namespace Kamanri
 {
@@ -16,22 +20,223 @@ namespace Kamanri
 		namespace __ObjModel
 		{
 			constexpr const char *LOG_NAME = STR(Kamanri::Renderer::ObjModel);
-		} // namespace ObjModel$
+
+			/// @brief Sections of the mesh cache
+			namespace Cache
+			{
+				constexpr size_t VERTICES = 0;
+				constexpr size_t VERTEX_NORMALS = 1;
+				constexpr size_t VERTEX_TEXTURES = 2;
+				constexpr size_t FACE_CORNERS = 3;
+				constexpr size_t FACE_OFFSETS = 4;
+				constexpr size_t SECTION_COUNT = 5;
+			} // namespace Cache
+
+			namespace ReadObjFileAndInit
+			{
+				/// @brief Bytes of a chunk parsed by one task, the chunk is extended to the end of its last line
+				constexpr size_t CHUNK_SIZE = 1 << 20;
+
+				/// @brief The flat arrays parsed from a chunk, concatenated in order after all chunks are parsed
+				struct ChunkResult
+				{
+					std::vector<ObjModel$::Vertex> vertices;
+					std::vector<ObjModel$::Vertex> vertex_normals;
+					std::vector<ObjModel$::VertexTexture> vertex_textures;
+					std::vector<ObjModel$::FaceCorner> face_corners;
+					/// @brief The corner count of every face
+					std::vector<unsigned int> face_sizes;
+					/// @brief Positions of the negative indexes in face_corners (corner * 3 + v/vt/vn), 
+					/// they are made relative to the beginning of the chunk while parsing and absolute while concatenating
+					std::vector<size_t> relative_indexes;
+					/// @brief The first line could not be parsed, nullptr if all lines are parsed
+					char const* error_line = nullptr;
+				};
+
+				inline bool IsSpace(char c)
+				{
+					return c == ' ' || c == '\t' || c == '\r';
+				}
+
+				inline char const* SkipSpaces(char const* p, char const* end)
+				{
+					while (p != end && IsSpace(*p)) p++;
+					return p;
+				}
+
+				template <class T>
+				inline bool ParseNumber(char const*& p, char const* end, T& value)
+				{
+					// std::from_chars does not accept the leading '+'
+					if (p != end && *p == '+') p++;
+					auto result = std::from_chars(p, end, value);
+					if (result.ec != std::errc()) return false;
+					p = result.ptr;
+					return true;
+				}
+
+				/// @brief Parse at most `max_count` numbers to `out`, return the count parsed, or -1 if there is an invalid token
+				inline int ParseNumbers(char const* p, char const* end, double* out, int max_count)
+				{
+					int count = 0;
+					while ((p = SkipSpaces(p, end)) != end)
+					{
+						double value;
+						if (!ParseNumber(p, end, value) || (p != end && !IsSpace(*p))) return -1;
+						if (count < max_count) out[count] = value;
+						count++;
+					}
+					return count;
+				}
+
+				/**
+				 * @brief Parse the corners as v, v/vt, v//vn or v/vt/vn, the absent index is 0.
+				 * A negative index -n refers to the n-th last element declared before the face, 
+				 * it is turned into the index counted from the beginning of the chunk, which may be not positive.
+				 */
+				inline bool ParseFace(char const* p, char const* end, ChunkResult& result, unsigned int& face_size)
+				{
+					size_t const counts[3] = { result.vertices.size(), result.vertex_textures.size(), result.vertex_normals.size() };
+					face_size = 0;
+					while ((p = SkipSpaces(p, end)) != end)
+					{
+						int indexes[3] = { 0, 0, 0 };
+						for (int i = 0; i < 3; i++)
+						{
+							if (p != end && *p != '/' && !ParseNumber(p, end, indexes[i])) return false;
+							if (p == end || *p != '/') break;
+							p++;
+						}
+						if (p != end && !IsSpace(*p)) return false;
+						for (int i = 0; i < 3; i++)
+						{
+							if (indexes[i] >= 0) continue;
+							indexes[i] += (int)counts[i] + 1;
+							result.relative_indexes.push_back(result.face_corners.size() * 3 + i);
+						}
+						result.face_corners.push_back({ indexes[0], indexes[1], indexes[2] });
+						face_size++;
+					}
+					return true;
+				}
+
+				inline void ParseChunk(char const* begin, char const* end, ChunkResult& result)
+				{
+					for (auto line = begin; line < end;)
+					{
+						auto line_end = (char const*)memchr(line, '\n', end - line);
+						if (line_end == nullptr) line_end = end;
+
+						auto p = SkipSpaces(line, line_end);
+						auto keyword = p;
+						while (p != line_end && !IsSpace(*p)) p++;
+						auto keyword_size = p - keyword;
+
+						bool is_parsed = true;
+						double values[3] = { 0, 0, 0 };
+						if (keyword_size == 1 && *keyword == 'v')
+						{
+							is_parsed = ParseNumbers(p, line_end, values, 3) >= 3;
+							result.vertices.push_back({ values[0], values[1], values[2] });
+						}
+						else if (keyword_size == 2 && keyword[0] == 'v' && keyword[1] == 'n')
+						{
+							is_parsed = ParseNumbers(p, line_end, values, 3) >= 3;
+							result.vertex_normals.push_back({ values[0], values[1], values[2] });
+						}
+						else if (keyword_size == 2 && keyword[0] == 'v' && keyword[1] == 't')
+						{
+							is_parsed = ParseNumbers(p, line_end, values, 3) >= 1;
+							result.vertex_textures.push_back({ values[0], values[1], values[2] });
+						}
+						else if (keyword_size == 1 && *keyword == 'f')
+						{
+							unsigned int face_size;
+							is_parsed = ParseFace(p, line_end, result, face_size);
+							result.face_sizes.push_back(face_size);
+						}
+
+						if (!is_parsed)
+						{
+							result.error_line = line;
+							return;
+						}
+						line = line_end + 1;
+					}
+				}
+
+				/// @brief The v (0), vt (1) or vn (2) index of the corner
+				inline int& IndexOf(ObjModel$::FaceCorner& corner, size_t i)
+				{
+					return i == 0 ? corner.vertex_index : (i == 1 ? corner.vertex_texture_index : corner.vertex_normal_index);
+				}
+
+				template <class T>
+				inline void Append(std::vector<T>& to, std::vector<T> const& from)
+				{
+					to.insert(to.end(), from.begin(), from.end());
+				}
+
+			} // namespace ReadObjFileAndInit
+			
+			namespace Weld
+			{
+				/// @brief Count of corners hashed by one task
+				constexpr size_t CORNER_CHUNK_SIZE = 1 << 16;
+				/// @brief Corners are split into shards by their hashes, the shards are welded in parallel
+				constexpr size_t SHARD_BITS = 6;
+				constexpr size_t SHARD_COUNT = 1 << SHARD_BITS;
+				constexpr size_t EMPTY_SLOT = ~(size_t)0;
+
+				inline std::uint64_t Hash(ObjModel$::FaceCorner const& corner)
+				{
+					std::uint64_t hash = (std::uint32_t)corner.vertex_index;
+					hash = hash * 0x9e3779b97f4a7c15ull ^ (std::uint32_t)corner.vertex_texture_index;
+					hash = hash * 0x9e3779b97f4a7c15ull ^ (std::uint32_t)corner.vertex_normal_index;
+					hash *= 0xff51afd7ed558ccdull;
+					return hash ^ (hash >> 29);
+				}
+
+				inline bool IsEqual(ObjModel$::FaceCorner const& c1, ObjModel$::FaceCorner const& c2)
+				{
+					return c1.vertex_index == c2.vertex_index && c1.vertex_texture_index == c2.vertex_texture_index && c1.vertex_normal_index == c2.vertex_normal_index;
+				}
+
+				inline bool IsInBound(int index, size_t size)
+				{
+					return index >= 0 && (size_t)index <= size;
+				}
+
+				/// @brief Run func(0) ... func(count - 1) on the thread pool, or in order if there is no thread pool
+				template <class F>
+				inline void ParallelFor(Thread::ThreadPool* thread_pool, size_t count, F const& func)
+				{
+					if (thread_pool == nullptr)
+					{
+						for (size_t i = 0; i < count; i++) func(i);
+						return;
+					}
+					thread_pool->ParallelFor(count, func);
+				}
+			} // namespace Weld
+
+		} // namespace __ObjModel
 
 	} // namespace Renderer
 
 } // namespace Kamanri
 
 
-ObjModel::ObjModel(std::string const& file_name, std::string const& tga_file_name)
+ObjModel::ObjModel(std::string const& file_name, std::string const& tga_file_name, unsigned int worker_count, bool is_welding): _file_name(file_name)
 {
-	auto result = ReadObjFileAndInit(file_name);
+	auto result = ReadObjFileAndInit(file_name, worker_count);
 	if(result.IsException())
 	{
 		Log::Error(__ObjModel::LOG_NAME, "An Exception occured while initing the ObjModel:");
 		result.Print();
 		exit(result.Code());
 	}
+	if(is_welding) Weld(worker_count);
 	if(tga_file_name.empty()) return;
 	_tga_image_name = tga_file_name;
 	// if(!_img.ReadTGAFile(tga_file_name))
@@ -56,66 +261,77 @@ size_t ObjModel::GetVertexTextureSize() const
 }
 size_t ObjModel::GetFaceSize() const
 {
-	return _faces.size();
+	return _face_offsets.size() - 1;
 }
 
 Result<std::vector<double>> ObjModel::GetVertex(size_t index) const
 {
-	auto size = _vertices.size();
+	auto size = GetVertexSize();
 	if (size <= index)
 	{
 		Log::Error(__ObjModel::LOG_NAME, "Index %d out of bound %d", index, size - 1);
 		PRINT_LOCATION;
 		return RESULT_EXCEPTION(std::vector<double>, ObjModel$::CODE_INDEX_OUT_OF_BOUND, "Index out of bound");
 	}
-	return Result<std::vector<double>>(_vertices[index]);
+	auto const& vertex = _vertices[index];
+	return Result<std::vector<double>>(std::vector<double>{ vertex.x, vertex.y, vertex.z });
 }
 
 Result<std::vector<double>> ObjModel::GetVertexNormal(size_t index) const
 {
-	auto size = _vertex_normals.size();
+	auto size = GetVertexNormalSize();
 	if (size <= index)
 	{
 		Log::Error(__ObjModel::LOG_NAME, "Index %d out of bound %d", index, size - 1);
 		PRINT_LOCATION;
 		return RESULT_EXCEPTION(std::vector<double>, ObjModel$::CODE_INDEX_OUT_OF_BOUND, "Index out of bound");
 	}
-	return Result<std::vector<double>>(_vertex_normals[index]);
+	auto const& vertex_normal = _vertex_normals[index];
+	return Result<std::vector<double>>(std::vector<double>{ vertex_normal.x, vertex_normal.y, vertex_normal.z });
 }
 
 Result<std::vector<double>> ObjModel::GetVertexTexture(size_t index) const
 {
-	auto size = _vertex_textures.size();
+	auto size = GetVertexTextureSize();
 	if (size <= index)
 	{
 		Log::Error(__ObjModel::LOG_NAME, "Index %d out of bound %d", index, size - 1);
 		PRINT_LOCATION;
 		return RESULT_EXCEPTION(std::vector<double>, ObjModel$::CODE_INDEX_OUT_OF_BOUND, "Index out of bound");
 	}
-	return Result<std::vector<double>>(_vertex_textures[index]);
+	auto const& vertex_texture = _vertex_textures[index];
+	return Result<std::vector<double>>(std::vector<double>{ vertex_texture.u, vertex_texture.v, vertex_texture.w });
 }
 
 Result<ObjModel$::Face> ObjModel::GetFace(size_t index) const
 {
-	auto size = _faces.size();
+	auto size = GetFaceSize();
 	if (size <= index)
 	{
 		Log::Error(__ObjModel::LOG_NAME, "Index %d out of bound %d", index, size - 1);
 		PRINT_LOCATION;
 		return RESULT_EXCEPTION(ObjModel$::Face, ObjModel$::CODE_INDEX_OUT_OF_BOUND, "Index out of bound");
 	}
-	return Result<ObjModel$::Face>(_faces[index]);
+	ObjModel$::Face face;
+	auto corners = FaceCorners(index);
+	for (size_t i = 0; i < corners.size; i++)
+	{
+		auto const& corner = corners.data[i];
+		if (corner.vertex_index != 0) face.vertex_indexes.push_back(corner.vertex_index);
+		if (corner.vertex_texture_index != 0) face.vertex_texture_indexes.push_back(corner.vertex_texture_index);
+		if (corner.vertex_normal_index != 0) face.vertex_normal_indexes.push_back(corner.vertex_normal_index);
+	}
+	return Result<ObjModel$::Face>(face);
 }
 
 
 
 
-DefaultResult ObjModel::ReadObjFileAndInit(std::string const &file_name)
+DefaultResult ObjModel::ReadObjFileAndInit(std::string const &file_name, unsigned int worker_count)
 {
-	std::ifstream fs(file_name);
-	std::string str;
+	using namespace __ObjModel::ReadObjFileAndInit;
 
-	if (file_name.compare(file_name.length() - 4, 4, ".obj") != 0)
+	if (file_name.length() < 4 || file_name.compare(file_name.length() - 4, 4, ".obj") != 0)
 	{
 		auto message = "The file %s is not the type of .obj";
 		Log::Error(__ObjModel::LOG_NAME, message, file_name.c_str());
@@ -123,114 +339,252 @@ DefaultResult ObjModel::ReadObjFileAndInit(std::string const &file_name)
 		return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_INVALID_TYPE, message);
 	}
 
-	if (!fs.good())
+	auto start = std::chrono::steady_clock::now();
+
+	if (AssetCache::IsEnabled() && ReadCache(file_name))
+	{
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		Log::Debug(__ObjModel::LOG_NAME, "Loaded %s from the cache in %.2f ms", file_name.c_str(), seconds * 1000);
+		return DEFAULT_RESULT;
+	}
+
+	MappedFile file(file_name);
+	if (!file.IsOpen())
 	{
 		Log::Error(__ObjModel::LOG_NAME, "Cannot Open The File %s", file_name.c_str());
 		PRINT_LOCATION;
 		return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_CANNOT_READ_FILE, "Cannot Open The File");
 	}
 
-	while (std::getline(fs, str))
+	// split the file into chunks of whole lines
+	auto data = file.Data();
+	auto end = data + file.Size();
+	std::vector<char const*> chunk_begins;
+	for (auto p = data; p < end;)
 	{
-		auto splited_str_vec = Split(str, " ", true);
-		auto vec_size = splited_str_vec.size();
+		chunk_begins.push_back(p);
+		if ((size_t)(end - p) <= CHUNK_SIZE) break;
+		auto line_end = (char const*)memchr(p + CHUNK_SIZE, '\n', end - p - CHUNK_SIZE);
+		p = (line_end == nullptr) ? end : line_end + 1;
+	}
+	auto chunk_count = chunk_begins.size();
+	chunk_begins.push_back(end);
 
-		if (str.compare(0, 2, "vt") == 0)
+	std::vector<ChunkResult> results(chunk_count);
+	auto parse_chunk = [&](size_t i) { ParseChunk(chunk_begins[i], chunk_begins[i + 1], results[i]); };
+	if (worker_count > 1 && chunk_count > 1)
+	{
+		Thread::ThreadPool thread_pool(std::min<size_t>(worker_count, chunk_count));
+		thread_pool.ParallelFor(chunk_count, parse_chunk);
+	}
+	else
+	{
+		for (size_t i = 0; i < chunk_count; i++) parse_chunk(i);
+	}
+
+	size_t vertex_size = 0, vertex_normal_size = 0, vertex_texture_size = 0, corner_size = 0, face_size = 0;
+	for (auto const& result : results)
+	{
+		if (result.error_line != nullptr)
 		{
-			try
-			{
-				auto vertex_texture = std::vector<double>();
-				for (size_t i = 1; i < vec_size; i++)
-				{
-					vertex_texture.push_back(std::stod(splited_str_vec[i]));
-				}
-				_vertex_textures.push_back(vertex_texture);
-			}
-			catch (std::exception e)
-			{
-				Log::Error(__ObjModel::LOG_NAME, e.what());
-				Log::Warn(__ObjModel::LOG_NAME, "While str = '%s' and split str vec size = %d", str.c_str(), vec_size);
-				PRINT_LOCATION;
-				return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_READING_EXCEPTION, e.what());
-			}
-			continue;
+			auto line_end = (char const*)memchr(result.error_line, '\n', end - result.error_line);
+			auto line = std::string(result.error_line, line_end == nullptr ? end : line_end);
+			Log::Error(__ObjModel::LOG_NAME, "Cannot parse the line '%s' of the file %s", line.c_str(), file_name.c_str());
+			PRINT_LOCATION;
+			return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_READING_EXCEPTION, "Cannot parse the line");
 		}
-		if (str.compare(0, 2, "vn") == 0)
+		vertex_size += result.vertices.size();
+		vertex_normal_size += result.vertex_normals.size();
+		vertex_texture_size += result.vertex_textures.size();
+		corner_size += result.face_corners.size();
+		face_size += result.face_sizes.size();
+	}
+
+	_vertices.reserve(vertex_size);
+	_vertex_normals.reserve(vertex_normal_size);
+	_vertex_textures.reserve(vertex_texture_size);
+	_face_corners.reserve(corner_size);
+	_face_offsets.reserve(face_size + 1);
+	for (auto const& result : results)
+	{
+		int const bases[3] = { (int)_vertices.size(), (int)_vertex_textures.size(), (int)_vertex_normals.size() };
+		auto corner_base = _face_corners.size();
+		Append(_vertices, result.vertices);
+		Append(_vertex_normals, result.vertex_normals);
+		Append(_vertex_textures, result.vertex_textures);
+		Append(_face_corners, result.face_corners);
+		for (auto face_size : result.face_sizes) _face_offsets.push_back(_face_offsets.back() + face_size);
+
+		for (auto position : result.relative_indexes)
 		{
-			try
-			{
-				_vertex_normals.push_back({std::stod(splited_str_vec[1]),
-											std::stod(splited_str_vec[2]),
-											std::stod(splited_str_vec[3])});
-			}
-			catch (std::exception e)
-			{
-				Log::Error(__ObjModel::LOG_NAME, e.what());
-				Log::Warn(__ObjModel::LOG_NAME, "While str = '%s' and split str vec size = %d", str.c_str(), vec_size);
-				PRINT_LOCATION;
-				return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_READING_EXCEPTION, e.what());
-			}
-			continue;
+			auto& index = IndexOf(_face_corners[corner_base + position / 3], position % 3);
+			index += bases[position % 3];
+			if (index > 0) continue;
+			Log::Error(__ObjModel::LOG_NAME, "A relative index of the file %s refers to nothing", file_name.c_str());
+			PRINT_LOCATION;
+			return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_INDEX_OUT_OF_BOUND, "Relative index out of bound");
 		}
-		if (str.compare(0, 1, "v") == 0)
+	}
+
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	auto mega_bytes = file.Size() / 1048576.0;
+	Log::Debug(__ObjModel::LOG_NAME, "Parsed %s: %.2f MB, %llu chunks in %.2f ms, %.1f MB/s",
+		file_name.c_str(), mega_bytes, chunk_count, seconds * 1000, seconds > 0 ? mega_bytes / seconds : 0.0);
+
+	if (AssetCache::IsEnabled()) WriteCache(file_name);
+
+	return DEFAULT_RESULT;
+}
+
+bool ObjModel::ReadCache(std::string const& file_name)
+{
+	using namespace __ObjModel;
+
+	auto cache = AssetCache::Open(file_name, AssetCache$::TYPE_MESH);
+	if (cache == nullptr) return false;
+
+	auto is_read = cache->SectionCount() == Cache::SECTION_COUNT &&
+		cache->CopySection(Cache::VERTICES, _vertices) &&
+		cache->CopySection(Cache::VERTEX_NORMALS, _vertex_normals) &&
+		cache->CopySection(Cache::VERTEX_TEXTURES, _vertex_textures) &&
+		cache->CopySection(Cache::FACE_CORNERS, _face_corners) &&
+		cache->CopySection(Cache::FACE_OFFSETS, _face_offsets) &&
+		!_face_offsets.empty() && _face_offsets.front() == 0 && _face_offsets.back() == _face_corners.size();
+	if (is_read) return true;
+
+	Log::Warn(LOG_NAME, "The cache of %s is broken, parse the file again", file_name.c_str());
+	_vertices.clear();
+	_vertex_normals.clear();
+	_vertex_textures.clear();
+	_face_corners.clear();
+	_face_offsets = { 0 };
+	return false;
+}
+
+void ObjModel::WriteCache(std::string const& file_name) const
+{
+	AssetCache::Write(file_name, AssetCache$::TYPE_MESH, {
+		{ _vertices.data(), _vertices.size() * sizeof(ObjModel$::Vertex) },
+		{ _vertex_normals.data(), _vertex_normals.size() * sizeof(ObjModel$::Vertex) },
+		{ _vertex_textures.data(), _vertex_textures.size() * sizeof(ObjModel$::VertexTexture) },
+		{ _face_corners.data(), _face_corners.size() * sizeof(ObjModel$::FaceCorner) },
+		{ _face_offsets.data(), _face_offsets.size() * sizeof(size_t) }
+	});
+}
+
+void ObjModel::Weld(unsigned int worker_count)
+{
+	using namespace __ObjModel::Weld;
+
+	auto start = std::chrono::steady_clock::now();
+	auto corner_count = _face_corners.size();
+	for (auto const& corner : _face_corners)
+	{
+		if (corner.vertex_index == 0 || !IsInBound(corner.vertex_index, _vertices.size()) ||
+			!IsInBound(corner.vertex_texture_index, _vertex_textures.size()) ||
+			!IsInBound(corner.vertex_normal_index, _vertex_normals.size()))
 		{
-			try
-			{
-				auto vertex = std::vector<double>();
-				for (size_t i = 1; i < vec_size; i++)
-				{
-					vertex.push_back(std::stod(splited_str_vec[i]));
-				}
-				_vertices.push_back(vertex);
-			}
-			catch (std::exception e)
+			Log::Warn(__ObjModel::LOG_NAME, "%s has indexes out of bound, it is not welded", _file_name.c_str());
+			return;
+		}
+	}
+
+	P<Thread::ThreadPool> thread_pool;
+	if (worker_count > 1 && corner_count > CORNER_CHUNK_SIZE) thread_pool = New<Thread::ThreadPool>(worker_count);
+
+	// 1. hash every corner
+	std::vector<std::uint64_t> hashes(corner_count);
+	auto chunk_count = (corner_count + CORNER_CHUNK_SIZE - 1) / CORNER_CHUNK_SIZE;
+	ParallelFor(thread_pool.get(), chunk_count, [&](size_t chunk_index)
+	{
+		auto end = std::min(corner_count, (chunk_index + 1) * CORNER_CHUNK_SIZE);
+		for (auto i = chunk_index * CORNER_CHUNK_SIZE; i < end; i++) hashes[i] = Hash(_face_corners[i]);
+	});
+
+	// 2. split the corners into shards by the high bits of hashes, in order
+	std::vector<size_t> shard_offsets(SHARD_COUNT + 1, 0);
+	for (auto hash : hashes) shard_offsets[(hash >> (64 - SHARD_BITS)) + 1]++;
+	for (size_t i = 0; i < SHARD_COUNT; i++) shard_offsets[i + 1] += shard_offsets[i];
+	std::vector<size_t> shard_corners(corner_count);
+	{
+		auto shard_ends = shard_offsets;
+		for (size_t i = 0; i < corner_count; i++) shard_corners[shard_ends[hashes[i] >> (64 - SHARD_BITS)]++] = i;
+	}
+
+	// 3. find the first corner of the same key of every corner, shard by shard
+	std::vector<size_t> first_corners(corner_count);
+	ParallelFor(thread_pool.get(), SHARD_COUNT, [&](size_t shard_index)
+	{
+		// open addressing table of the first corners, at most half full
+		size_t capacity = 16;
+		while (capacity < (shard_offsets[shard_index + 1] - shard_offsets[shard_index]) * 2) capacity <<= 1;
+		std::vector<size_t> firsts(capacity, EMPTY_SLOT);
+		for (auto i = shard_offsets[shard_index]; i < shard_offsets[shard_index + 1]; i++)
+		{
+			auto corner = shard_corners[i];
+			auto slot = (size_t)hashes[corner] & (capacity - 1);
+			while (firsts[slot] != EMPTY_SLOT && !IsEqual(_face_corners[firsts[slot]], _face_corners[corner]))
 			{
-				Log::Error(__ObjModel::LOG_NAME, e.what());
-				Log::Warn(__ObjModel::LOG_NAME, "While str = '%s' and split str vec size = %d", str.c_str(), vec_size);
-				PRINT_LOCATION;
-				return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_READING_EXCEPTION, e.what());
+				slot = (slot + 1) & (capacity - 1);
 			}
+			if (firsts[slot] == EMPTY_SLOT) firsts[slot] = corner;
+			first_corners[corner] = firsts[slot];
+		}
+	});
 
+	// 4. number the welded vertices in the order they first appear
+	std::vector<size_t> welded_indexes(corner_count);
+	std::vector<size_t> welded_sources;
+	for (size_t i = 0; i < corner_count; i++)
+	{
+		if (first_corners[i] != i)
+		{
+			welded_indexes[i] = welded_indexes[first_corners[i]];
 			continue;
 		}
-		if (str.compare(0, 1, "f") == 0)
+		welded_indexes[i] = welded_sources.size();
+		welded_sources.push_back(i);
+	}
+
+	// 5. gather the welded vertices and rewrite the corners
+	auto welded_count = welded_sources.size();
+	// a model without any vt or vn still has none
+	std::vector<ObjModel$::Vertex> vertices(welded_count);
+	std::vector<ObjModel$::Vertex> vertex_normals(_vertex_normals.empty() ? 0 : welded_count);
+	std::vector<ObjModel$::VertexTexture> vertex_textures(_vertex_textures.empty() ? 0 : welded_count);
+	ParallelFor(thread_pool.get(), (welded_count + CORNER_CHUNK_SIZE - 1) / CORNER_CHUNK_SIZE, [&](size_t chunk_index)
+	{
+		auto end = std::min(welded_count, (chunk_index + 1) * CORNER_CHUNK_SIZE);
+		for (auto i = chunk_index * CORNER_CHUNK_SIZE; i < end; i++)
 		{
-			auto face = ObjModel$::Face();
-			try
+			auto const& corner = _face_corners[welded_sources[i]];
+			vertices[i] = _vertices[corner.vertex_index - 1];
+			if (!vertex_textures.empty())
 			{
-				for (size_t i = 1; i < vec_size; i++)
-				{
-					auto about_vertex_indexes = Split(splited_str_vec[i], "/");
-					auto indexes_size = about_vertex_indexes.size();
-
-					if (about_vertex_indexes[0].length() != 0)
-					{
-						face.vertex_indexes.push_back(std::stoi(about_vertex_indexes[0]));
-					}
-					if (indexes_size > 1 && about_vertex_indexes[1].length() != 0)
-					{
-						face.vertex_texture_indexes.push_back(std::stoi(about_vertex_indexes[1]));
-					}
-					if (indexes_size > 2 && about_vertex_indexes[2].length() != 0)
-					{
-						face.vertex_normal_indexes.push_back(std::stoi(about_vertex_indexes[2]));
-					}
-				}
+				vertex_textures[i] = corner.vertex_texture_index != 0 ? _vertex_textures[corner.vertex_texture_index - 1] : ObjModel$::VertexTexture{ 0, 0, 0 };
 			}
-			catch (std::exception e)
+			if (!vertex_normals.empty())
 			{
-				Log::Error(__ObjModel::LOG_NAME, e.what());
-				Log::Warn(__ObjModel::LOG_NAME, "While str = '%s' and split str vec size = %d", str.c_str(), vec_size);
-				PRINT_LOCATION;
-				return DEFAULT_RESULT_EXCEPTION(ObjModel$::CODE_READING_EXCEPTION, e.what());
+				vertex_normals[i] = corner.vertex_normal_index != 0 ? _vertex_normals[corner.vertex_normal_index - 1] : ObjModel$::Vertex{ 0, 0, 0 };
 			}
-			_faces.push_back(face);
-
-			continue;
 		}
-	}
+	});
+	ParallelFor(thread_pool.get(), chunk_count, [&](size_t chunk_index)
+	{
+		auto end = std::min(corner_count, (chunk_index + 1) * CORNER_CHUNK_SIZE);
+		for (auto i = chunk_index * CORNER_CHUNK_SIZE; i < end; i++)
+		{
+			auto& corner = _face_corners[i];
+			auto index = (int)welded_indexes[i] + 1;
+			corner = { index, corner.vertex_texture_index != 0 ? index : 0, corner.vertex_normal_index != 0 ? index : 0 };
+		}
+	});
 
-	fs.close();
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	Log::Info(__ObjModel::LOG_NAME, "Welded %s: %llu v, %llu vt, %llu vn of %llu corners -> %llu vertices in %.2f ms",
+		_file_name.c_str(), _vertices.size(), _vertex_textures.size(), _vertex_normals.size(), corner_count, welded_count, seconds * 1000);
 
-	return DEFAULT_RESULT;
-}
\ No newline at end of file
+	_vertices = std::move(vertices);
+	_vertex_textures = std::move(vertex_textures);
+	_vertex_normals = std::move(vertex_normals);
+}
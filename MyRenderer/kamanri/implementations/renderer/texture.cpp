@@ -0,0 +1,98 @@
+#include <algorithm>
+#include "kamanri/renderer/texture.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/utils/string.hpp"
+#include "cuda_dll/exports/memory_operations.hpp"
+
+using namespace Kamanri::Utils;
+using namespace Kamanri::Renderer;
+
+namespace __Texture
+{
+	constexpr const char* LOG_NAME = STR(Texture);
+
+	dll cuda_dll;
+	func_type(CUDAMalloc) cuda_malloc;
+	func_type(CUDAFree) cuda_free;
+	func_type(TransmitToCUDA) transmit_to_cuda;
+
+	/// @brief Average of the 2 * 2 texels of the upper level, the last row or column is repeated for an odd size
+	inline std::uint32_t Downsample(std::vector<std::uint32_t> const& texels, Texture$::Level const& upper, int x, int y)
+	{
+		int x0 = x * 2, y0 = y * 2;
+		int x1 = std::min(x0 + 1, upper.width - 1), y1 = std::min(y0 + 1, upper.height - 1);
+		std::uint32_t c[4] = 
+		{
+			texels[Texture$::TexelIndex(upper, x0, y0)], texels[Texture$::TexelIndex(upper, x1, y0)],
+			texels[Texture$::TexelIndex(upper, x0, y1)], texels[Texture$::TexelIndex(upper, x1, y1)]
+		};
+		std::uint32_t result = 0;
+		for (int shift = 0; shift <= 16; shift += 8)
+		{
+			std::uint32_t sum = 2;
+			for (int i = 0; i < 4; i++) sum += (c[i] >> shift) & 0xff;
+			result |= (sum / 4) << shift;
+		}
+		return result;
+	}
+} // namespace __Texture
+
+
+void Texture::Build(TGAImage const& image, bool is_use_cuda)
+{
+	using namespace Texture$;
+	using namespace __Texture;
+
+	_level_count = 0;
+	_texels.clear();
+	if (image.Width() <= 0 || image.Height() <= 0) return;
+
+	// lay out the levels until 1 * 1
+	size_t offset = 0;
+	for (int width = image.Width(), height = image.Height(); _level_count < MAX_LEVEL_COUNT; width = std::max(1, width / 2), height = std::max(1, height / 2))
+	{
+		auto& level = _levels[_level_count++];
+		level = { width, height, (width + TILE_LENGTH - 1) / TILE_LENGTH, offset };
+		offset += (size_t)level.tile_count_x * ((height + TILE_LENGTH - 1) / TILE_LENGTH) * TILE_TEXEL_COUNT;
+		if (width == 1 && height == 1) break;
+	}
+	_texels.assign(offset, 0);
+
+	auto& base = _levels[0];
+	for (int y = 0; y < base.height; y++)
+	{
+		for (int x = 0; x < base.width; x++) _texels[TexelIndex(base, x, y)] = image.Get(x, y).rgb;
+	}
+	for (size_t i = 1; i < _level_count; i++)
+	{
+		auto& level = _levels[i];
+		for (int y = 0; y < level.height; y++)
+		{
+			for (int x = 0; x < level.width; x++) _texels[TexelIndex(level, x, y)] = Downsample(_texels, _levels[i - 1], x, y);
+		}
+	}
+	Log::Debug(LOG_NAME, "Texture built: %d x %d, %llu levels, %llu bytes", base.width, base.height, _level_count, _texels.size() * sizeof(std::uint32_t));
+
+	if (!is_use_cuda) return;
+
+	load_dll(cuda_dll, cuda_dll, LOG_NAME);
+	import_func(CUDAMalloc, cuda_dll, cuda_malloc, LOG_NAME);
+	import_func(CUDAFree, cuda_dll, cuda_free, LOG_NAME);
+	import_func(TransmitToCUDA, cuda_dll, transmit_to_cuda, LOG_NAME);
+
+	auto data_size = _texels.size() * sizeof(std::uint32_t);
+	cuda_malloc(&(void*)_cuda_texels, data_size);
+	transmit_to_cuda(_texels.data(), _cuda_texels, data_size);
+}
+
+void Texture::DeleteCUDA()
+{
+	if (_cuda_texels == nullptr) return;
+	__Texture::cuda_free(_cuda_texels);
+	_cuda_texels = nullptr;
+}
+
+unsigned int Texture::Sample(double u, double v, double du_dx, double dv_dx, double du_dy, double dv_dy) const
+{
+	return Texture$::Sample(_texels.data(), _levels, _level_count, u, v, du_dx, dv_dx, du_dy, dv_dy);
+}
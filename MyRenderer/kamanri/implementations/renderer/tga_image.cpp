@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <cstring>
 #include "kamanri/renderer/tga_image.hpp"
+#include "kamanri/renderer/asset_cache.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/utils/mapped_file.hpp"
 #include "cuda_dll/exports/memory_operations.hpp"
 
+using namespace Kamanri::Utils;
 using namespace Kamanri::Renderer;
 using namespace Kamanri::Renderer::TGAImage$;
 
@@ -15,6 +21,21 @@ namespace __TGAImage
 	func_type(CUDAFree) cuda_free;
 	func_type(TransmitToCUDA) transmit_to_cuda;
 
+	/// @brief Sections of the texture cache
+	namespace Cache
+	{
+		constexpr size_t INFO = 0;
+		constexpr size_t DATA = 1;
+		constexpr size_t SECTION_COUNT = 2;
+
+		struct Info
+		{
+			std::int32_t width;
+			std::int32_t height;
+			std::int32_t bytes_per_pixel;
+		};
+	} // namespace Cache
+
 } // namespace __TGAImage
 
 
@@ -31,45 +52,104 @@ void TGAImage::DeleteCUDA()
 }
 
 bool TGAImage::ReadTGAFile(const std::string filename, bool is_use_cuda) {
-	std::ifstream in;
-	in.open (filename, std::ios::binary);
-	if (!in.is_open()) {
+	if (!AssetCache::IsEnabled() || !ReadCache(filename))
+	{
+		if (!DecodeTGAFile(filename)) return false;
+		if (AssetCache::IsEnabled()) WriteCache(filename);
+	}
+	std::cerr << _width << "x" << _height << "/" << _bytes_per_pixel*8 << "\n";
+
+///////////////////////////////////////////////
+	if(!is_use_cuda) return true;
+
+	using namespace __TGAImage;
+	load_dll(cuda_dll, cuda_dll, LOG_NAME);
+	import_func(CUDAMalloc, cuda_dll, cuda_malloc, LOG_NAME);
+	import_func(CUDAFree, cuda_dll, cuda_free, LOG_NAME);
+	import_func(TransmitToCUDA, cuda_dll, transmit_to_cuda, LOG_NAME);
+
+	auto data_size = _data.size();
+	cuda_malloc(&(void*)_cuda_data, data_size * sizeof(std::uint8_t));
+	transmit_to_cuda(&_data[0], _cuda_data, data_size * sizeof(std::uint8_t));
+	return true;
+}
+
+bool TGAImage::ReadCache(const std::string& filename)
+{
+	using namespace __TGAImage;
+
+	auto cache = AssetCache::Open(filename, AssetCache$::TYPE_TEXTURE);
+	if (cache == nullptr) return false;
+	if (cache->SectionCount() != Cache::SECTION_COUNT || cache->SectionSize(Cache::INFO) != sizeof(Cache::Info)) return false;
+
+	auto info = (Cache::Info const*)cache->SectionData(Cache::INFO);
+	if (info->width <= 0 || info->height <= 0 || cache->SectionSize(Cache::DATA) != (size_t)info->width * info->height * info->bytes_per_pixel)
+	{
+		return false;
+	}
+	_width = info->width;
+	_height = info->height;
+	_bytes_per_pixel = info->bytes_per_pixel;
+	return cache->CopySection(Cache::DATA, _data);
+}
+
+void TGAImage::WriteCache(const std::string& filename) const
+{
+	using namespace __TGAImage;
+
+	Cache::Info info = { _width, _height, _bytes_per_pixel };
+	AssetCache::Write(filename, AssetCache$::TYPE_TEXTURE, {
+		{ &info, sizeof(info) },
+		{ _data.data(), _data.size() }
+	});
+}
+
+bool TGAImage::DecodeTGAFile(const std::string& filename) {
+	using namespace __TGAImage;
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file(filename);
+	if (!file.IsOpen()) {
 		std::cerr << "can't open file " << filename << "\n";
-		in.close();
 		return false;
 	}
 	TGAHeader header;
-	in.read(reinterpret_cast<char *>(&header), sizeof(header));
-	if (!in.good()) {
-		in.close();
+	if (file.Size() < sizeof(header)) {
 		std::cerr << "an error occured while reading the header\n";
 		return false;
 	}
+	memcpy(&header, file.Data(), sizeof(header));
 	_width   = header.width;
 	_height   = header.height;
 	_bytes_per_pixel = header.bits_per_pixel>>3;
 	if (_width<=0 || _height<=0 || (_bytes_per_pixel!=GRAYSCALE && _bytes_per_pixel!=RGB && _bytes_per_pixel!=RGBA)) {
-		in.close();
 		std::cerr << "bad bpp (or width/height) value\n";
 		return false;
 	}
-	size_t nbytes = _bytes_per_pixel*_width*_height;
-	_data = std::vector<std::uint8_t>(nbytes, 0);
+	// the image id and the color map are skipped
+	size_t data_offset = sizeof(header) + header.id_length;
+	if (header.color_map_type == 1) data_offset += (size_t)header.color_map_length * ((header.color_map_depth + 7) >> 3);
+	if (data_offset > file.Size()) {
+		std::cerr << "an error occured while reading the header\n";
+		return false;
+	}
+	auto data = reinterpret_cast<std::uint8_t const*>(file.Data()) + data_offset;
+	auto data_size = file.Size() - data_offset;
+
+	size_t nbytes = (size_t)_bytes_per_pixel*_width*_height;
+	_data.resize(nbytes);
 	if (3==header.data_type_code || 2==header.data_type_code) {
-		in.read(reinterpret_cast<char *>(_data.data()), nbytes);
-		if (!in.good()) {
-			in.close();
+		if (data_size < nbytes) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
+		memcpy(_data.data(), data, nbytes);
 	} else if (10==header.data_type_code||11==header.data_type_code) {
-		if (!LoadRLEData(in)) {
-			in.close();
+		if (!LoadRLEData(data, data_size)) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
 	} else {
-		in.close();
 		std::cerr << "unknown file format " << (int)header.data_type_code << "\n";
 		return false;
 	}
@@ -77,77 +157,64 @@ bool TGAImage::ReadTGAFile(const std::string filename, bool is_use_cuda) {
 		FlipVertically();
 	if (header.image_descriptor & 0x10)
 		FlipHorizontally();
-	std::cerr << _width << "x" << _height << "/" << _bytes_per_pixel*8 << "\n";
-	in.close();
-
-///////////////////////////////////////////////
-	if(!is_use_cuda) return true;
-
-	using namespace __TGAImage;
-	load_dll(cuda_dll, cuda_dll, LOG_NAME);
-	import_func(CUDAMalloc, cuda_dll, cuda_malloc, LOG_NAME);
-	import_func(CUDAFree, cuda_dll, cuda_free, LOG_NAME);
-	import_func(TransmitToCUDA, cuda_dll, transmit_to_cuda, LOG_NAME);
 
-	auto data_size = _data.size();
-	cuda_malloc(&(void*)_cuda_data, data_size * sizeof(std::uint8_t));
-	transmit_to_cuda(&_data[0], _cuda_data, data_size * sizeof(std::uint8_t));
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	auto mega_bytes = nbytes / 1048576.0;
+	Log::Debug(LOG_NAME, "Decoded %s: %d x %d x %d, %.2f MB in %.2f ms, %.1f MB/s",
+		filename.c_str(), _width, _height, _bytes_per_pixel, mega_bytes, seconds * 1000, seconds > 0 ? mega_bytes / seconds : 0.0);
 	return true;
 }
 
 /**
- * @brief Load data in RLE encode
+ * @brief Load data in RLE encode, every packet is copied in bulk
  * 
- * @param in 
+ * @param data The encoded data following the header
+ * @param size 
  * @return true 
  * @return false 
  */
-bool TGAImage::LoadRLEData(std::ifstream &in) {
-	size_t pixelcount = _width*_height;
-	size_t currentpixel = 0;
-	size_t currentbyte  = 0;
-	TGAColor colorbuffer;
-	do {
-		std::uint8_t chunkheader = 0;
-		chunkheader = in.get();
-		if (!in.good()) {
+bool TGAImage::LoadRLEData(std::uint8_t const* data, size_t size) {
+	size_t bytespp = _bytes_per_pixel;
+	size_t nbytes = _data.size();
+	size_t currentbyte = 0;
+	auto end = data + size;
+	while (currentbyte < nbytes) {
+		if (data == end) {
 			std::cerr << "an error occured while reading the data\n";
 			return false;
 		}
-		if (chunkheader<128) {
-			chunkheader++;
-			for (int i=0; i<chunkheader; i++) {
-				in.read(reinterpret_cast<char *>(colorbuffer.bgra), _bytes_per_pixel);
-				if (!in.good()) {
-					std::cerr << "an error occured while reading the header\n";
-					return false;
-				}
-				for (int t=0; t<_bytes_per_pixel; t++)
-					_data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
+		std::uint8_t chunkheader = *data++;
+		size_t chunkbytes = (size_t)((chunkheader & 0x7f) + 1) * bytespp;
+		if (currentbyte + chunkbytes > nbytes) {
+			std::cerr << "Too many pixels read\n";
+			return false;
+		}
+		auto out = _data.data() + currentbyte;
+		if (chunkheader < 128) {
+			// raw packet
+			if ((size_t)(end - data) < chunkbytes) {
+				std::cerr << "an error occured while reading the header\n";
+				return false;
 			}
+			memcpy(out, data, chunkbytes);
+			data += chunkbytes;
 		} else {
-			chunkheader -= 127;
-			in.read(reinterpret_cast<char *>(colorbuffer.bgra), _bytes_per_pixel);
-			if (!in.good()) {
+			// run-length packet, the written part is doubled until the run is filled
+			if ((size_t)(end - data) < bytespp) {
 				std::cerr << "an error occured while reading the header\n";
 				return false;
 			}
-			for (int i=0; i<chunkheader; i++) {
-				for (int t=0; t<_bytes_per_pixel; t++)
-					_data[currentbyte++] = colorbuffer.bgra[t];
-				currentpixel++;
-				if (currentpixel>pixelcount) {
-					std::cerr << "Too many pixels read\n";
-					return false;
-				}
+			if (bytespp == 1) {
+				memset(out, *data, chunkbytes);
+			} else {
+				memcpy(out, data, bytespp);
+				for (size_t filled = bytespp; filled < chunkbytes; filled *= 2)
+					memcpy(out + filled, out, std::min(filled, chunkbytes - filled));
 			}
+			data += bytespp;
 		}
-	} while (currentpixel < pixelcount);
+		currentbyte += chunkbytes;
+	}
 	return true;
 }
 
@@ -269,19 +336,35 @@ void TGAImage::Set(int x, int y, const TGAColor &c) {
 
 
 void TGAImage::FlipHorizontally() {
-	int half = _width>>1;
-	for (int i=0; i<half; i++)
-		for (int j=0; j<_height; j++)
-			for (int b=0; b<_bytes_per_pixel; b++)
-				std::swap(_data[(i+j*_width)*_bytes_per_pixel+b], _data[(_width-1-i+j*_width)*_bytes_per_pixel+b]);
+	size_t bytes_per_line = (size_t)_width*_bytes_per_pixel;
+	// whole pixels of RGBA are reversed as words, which is vectorized as shuffles
+	std::vector<std::uint32_t> pixels(_bytes_per_pixel == RGBA ? _width : 0);
+	for (int j=0; j<_height; j++) {
+		auto row = _data.data() + j*bytes_per_line;
+		if (_bytes_per_pixel == GRAYSCALE) {
+			std::reverse(row, row + _width);
+		} else if (_bytes_per_pixel == RGBA) {
+			memcpy(pixels.data(), row, bytes_per_line);
+			std::reverse(pixels.begin(), pixels.end());
+			memcpy(row, pixels.data(), bytes_per_line);
+		} else {
+			for (int left=0, right=_width-1; left<right; left++, right--)
+				std::swap_ranges(row + left*_bytes_per_pixel, row + (left+1)*_bytes_per_pixel, row + right*_bytes_per_pixel);
+		}
+	}
 }
 
 void TGAImage::FlipVertically() {
+	size_t bytes_per_line = (size_t)_width*_bytes_per_pixel;
+	std::vector<std::uint8_t> line(bytes_per_line);
 	int half = _height>>1;
-	for (int i=0; i<_width; i++)
-		for (int j=0; j<half; j++)
-			for (int b=0; b<_bytes_per_pixel; b++)
-				std::swap(_data[(i+j*_width)*_bytes_per_pixel+b], _data[(i+(_height-1-j)*_width)*_bytes_per_pixel+b]);
+	for (int j=0; j<half; j++) {
+		auto top = _data.data() + j*bytes_per_line;
+		auto bottom = _data.data() + (_height-1-j)*bytes_per_line;
+		memcpy(line.data(), top, bytes_per_line);
+		memcpy(top, bottom, bytes_per_line);
+		memcpy(bottom, line.data(), bytes_per_line);
+	}
 }
 
 int TGAImage::Width() const {
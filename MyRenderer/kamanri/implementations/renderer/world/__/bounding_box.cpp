@@ -1,6 +1,11 @@
+#include <algorithm>
+#include <cfloat>
 #include "kamanri/renderer/world/__/bounding_box.hpp"
 #include "kamanri/renderer/world/blinn_phong_reflection_model.hpp"
 #include "kamanri/utils/list.hpp"
+#include "kamanri/utils/log.hpp"
+#include "kamanri/utils/string.hpp"
+#include "kamanri/utils/thread.hpp"
 #include "kamanri/maths/math.hpp"
 
 namespace Kamanri
@@ -13,53 +18,468 @@ namespace Kamanri
 			{
 				namespace __BoundingBox
 				{
-					namespace __IsThrough
+					constexpr const char* LOG_NAME = STR(Kamanri::Renderer::World::__::BoundingBox);
+
+					namespace __Build
 					{
-						using AxisType = size_t;
-						constexpr AxisType X_AXIS = 0;
-						constexpr AxisType Y_AXIS = 1;
-						constexpr AxisType Z_AXIS = 2;
-						inline bool IsThroughPlane(Maths::Vector const& location, Maths::Vector const& direction, BoundingBox const& box, AxisType axis_type, double value)
-						{
-							double x = 0, y = 0, z = 0, ratio = 0;
-
-							switch (axis_type)
-							{
-							case X_AXIS:
-								x = value;
-								ratio = (x - location[X_AXIS]) / direction[X_AXIS];
-								y = (direction[Y_AXIS] * ratio) + location[Y_AXIS];
-								z = (direction[Z_AXIS] * ratio) + location[Z_AXIS];
-								if ((y <= box.world_max[Y_AXIS] && y >= box.world_min[Y_AXIS]) || (z <= box.world_max[Z_AXIS] && z >= box.world_min[Z_AXIS]))
+						/// @brief Count of bins along the split axis
+						constexpr size_t BIN_COUNT = 12;
+						/// @brief Deeper nodes are split by the median, which keeps the depth (and the traversal stack) bounded
+						constexpr size_t SAH_MAX_DEPTH = 48;
+						/// @brief Subtrees with fewer triangles are built by one worker
+						constexpr size_t PARALLEL_MIN_TRIANGLES = 1024;
+						/// @brief The top levels are split until there are about so many subtrees per worker to balance their sizes
+						constexpr size_t SUBTREES_PER_WORKER = 8;
+						/// @brief A split of the top levels is cut into about so many chunks per worker
+						constexpr size_t CHUNKS_PER_WORKER = 4;
+						/// @brief Count of triangles whose bounds are initialized by one worker at a time
+						constexpr size_t TRIANGLE_CHUNK_SIZE = 1024;
+
+						class AABB
+						{
+							public:
+							double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+							double max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+
+							inline void Expand(AABB const& other)
+							{
+								for (size_t i = 0; i < 3; i++)
+								{
+									min[i] = Maths::Min(min[i], other.min[i]);
+									max[i] = Maths::Max(max[i], other.max[i]);
+								}
+							}
+
+							inline void Expand(double const* point)
+							{
+								for (size_t i = 0; i < 3; i++)
+								{
+									min[i] = Maths::Min(min[i], point[i]);
+									max[i] = Maths::Max(max[i], point[i]);
+								}
+							}
+
+							inline double Center(size_t axis) const { return (min[axis] + max[axis]) * 0.5; }
+
+							inline double HalfArea() const
+							{
+								double dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+								if (dx < 0 || dy < 0 || dz < 0) return 0;
+								return dx * dy + dy * dz + dz * dx;
+							}
+						};
+
+						/// @brief Build the node b_i from indexes [begin, end)
+						class Task
+						{
+							public:
+							size_t b_i;
+							size_t begin;
+							size_t end;
+							size_t depth;
+						};
+
+						inline size_t BinIndex(double center, double min, double extent)
+						{
+							auto bin_index = (size_t)((center - min) / extent * BIN_COUNT);
+							return bin_index < BIN_COUNT ? bin_index : BIN_COUNT - 1;
+						}
+
+						/// @brief Bounds and counts of the triangles whose centers fall in every bin
+						class Bins
+						{
+							public:
+							AABB bounds[BIN_COUNT];
+							size_t counts[BIN_COUNT] = { 0 };
+
+							inline void Add(AABB const& b, size_t bin_index)
+							{
+								bounds[bin_index].Expand(b);
+								counts[bin_index]++;
+							}
+
+							inline void Merge(Bins const& other)
+							{
+								for (size_t k = 0; k < BIN_COUNT; k++)
+								{
+									bounds[k].Expand(other.bounds[k]);
+									counts[k] += other.counts[k];
+								}
+							}
+						};
+
+						inline AABB CenterBounds(std::vector<AABB> const& bounds, std::vector<size_t> const& indexes, size_t begin, size_t end)
+						{
+							AABB center_bounds;
+							for (size_t i = begin; i < end; i++)
+							{
+								auto& b = bounds[indexes[i]];
+								double center[3] = { b.Center(0), b.Center(1), b.Center(2) };
+								center_bounds.Expand(center);
+							}
+							return center_bounds;
+						}
+
+						inline size_t LongestAxis(AABB const& center_bounds)
+						{
+							size_t axis = 0;
+							for (size_t i = 1; i < 3; i++)
+							{
+								if (center_bounds.max[i] - center_bounds.min[i] > center_bounds.max[axis] - center_bounds.min[axis]) axis = i;
+							}
+							return axis;
+						}
+
+						inline void AddToBins(std::vector<AABB> const& bounds, std::vector<size_t> const& indexes, size_t begin, size_t end, size_t axis, double min, double extent, Bins& bins)
+						{
+							for (size_t i = begin; i < end; i++)
+							{
+								auto& b = bounds[indexes[i]];
+								bins.Add(b, BinIndex(b.Center(axis), min, extent));
+							}
+						}
+
+						/// @brief The last bin of the left part of the cheapest split of count triangles, BIN_COUNT if every split leaves a part empty
+						inline size_t BestBin(Bins const& bins, size_t count)
+						{
+							// costs of the right parts when splitting after bin k
+							double right_costs[BIN_COUNT];
+							AABB right_bounds;
+							size_t right_count = 0;
+							for (size_t k = BIN_COUNT - 1; k > 0; k--)
+							{
+								right_bounds.Expand(bins.bounds[k]);
+								right_count += bins.counts[k];
+								right_costs[k - 1] = right_bounds.HalfArea() * right_count;
+							}
+
+							double best_cost = DBL_MAX;
+							size_t best_k = BIN_COUNT;
+							AABB left_bounds;
+							size_t left_count = 0;
+							for (size_t k = 0; k < BIN_COUNT - 1; k++)
+							{
+								left_bounds.Expand(bins.bounds[k]);
+								left_count += bins.counts[k];
+								if (left_count == 0 || left_count == count) continue;
+								double cost = left_bounds.HalfArea() * left_count + right_costs[k];
+								if (cost < best_cost)
+								{
+									best_cost = cost;
+									best_k = k;
+								}
+							}
+							return best_k;
+						}
+
+						/// @brief Split indexes [begin, end) by the median of centers on the axis and return the beginning of the right part
+						inline size_t SplitByMedian(std::vector<AABB> const& bounds, std::vector<size_t>& indexes, size_t begin, size_t end, size_t axis)
+						{
+							size_t mid = begin + (end - begin) / 2;
+							std::nth_element(indexes.begin() + begin, indexes.begin() + mid, indexes.begin() + end, [&](size_t i1, size_t i2)
+							{
+								return bounds[i1].Center(axis) < bounds[i2].Center(axis);
+							});
+							return mid;
+						}
+
+						/// @brief Partition indexes [begin, end) and return the beginning of the right part, which is never begin or end.
+						inline size_t Split(std::vector<AABB> const& bounds, std::vector<size_t>& indexes, size_t begin, size_t end, size_t depth)
+						{
+							auto center_bounds = CenterBounds(bounds, indexes, begin, end);
+							auto axis = LongestAxis(center_bounds);
+							double min = center_bounds.min[axis];
+							double extent = center_bounds.max[axis] - min;
+
+							if (extent > 0 && depth < SAH_MAX_DEPTH)
+							{
+								Bins bins;
+								AddToBins(bounds, indexes, begin, end, axis, min, extent, bins);
+								auto best_k = BestBin(bins, end - begin);
+								if (best_k != BIN_COUNT)
+								{
+									auto mid = std::partition(indexes.begin() + begin, indexes.begin() + end, [&](size_t i)
+									{
+										return BinIndex(bounds[i].Center(axis), min, extent) <= best_k;
+									});
+									return mid - indexes.begin();
+								}
+							}
+
+							return SplitByMedian(bounds, indexes, begin, end, axis);
+						}
+
+						/**
+						 * @brief Split as Split does, but the center bounds, the bins and the partition of [begin, end) are chunked over the workers.
+						 * The chunks are partitioned stably into scratch and copied back, so the result does not depend on the count of chunks.
+						 */
+						inline size_t ParallelSplit(Utils::Thread::ThreadPool& thread_pool, std::vector<AABB> const& bounds, std::vector<size_t>& indexes, std::vector<size_t>& scratch, size_t begin, size_t end, size_t depth)
+						{
+							auto count = end - begin;
+							auto chunk_size = std::max(TRIANGLE_CHUNK_SIZE, count / (thread_pool.WorkerCount() * CHUNKS_PER_WORKER) + 1);
+							auto chunk_count = (count + chunk_size - 1) / chunk_size;
+							auto chunk_begin = [&](size_t c) { return begin + c * chunk_size; };
+							auto chunk_end = [&](size_t c) { return std::min(end, begin + (c + 1) * chunk_size); };
+
+							std::vector<AABB> chunk_center_bounds(chunk_count);
+							thread_pool.ParallelFor(chunk_count, [&](size_t c)
+							{
+								chunk_center_bounds[c] = CenterBounds(bounds, indexes, chunk_begin(c), chunk_end(c));
+							});
+							AABB center_bounds;
+							for (auto const& b : chunk_center_bounds)
+							{
+								center_bounds.Expand(b);
+							}
+							auto axis = LongestAxis(center_bounds);
+							double min = center_bounds.min[axis];
+							double extent = center_bounds.max[axis] - min;
+							if (!(extent > 0 && depth < SAH_MAX_DEPTH)) return SplitByMedian(bounds, indexes, begin, end, axis);
+
+							std::vector<Bins> chunk_bins(chunk_count);
+							thread_pool.ParallelFor(chunk_count, [&](size_t c)
+							{
+								AddToBins(bounds, indexes, chunk_begin(c), chunk_end(c), axis, min, extent, chunk_bins[c]);
+							});
+							Bins bins;
+							for (auto const& b : chunk_bins)
+							{
+								bins.Merge(b);
+							}
+							auto best_k = BestBin(bins, count);
+							if (best_k == BIN_COUNT) return SplitByMedian(bounds, indexes, begin, end, axis);
+
+							auto is_left = [&](size_t i) { return BinIndex(bounds[i].Center(axis), min, extent) <= best_k; };
+							// the left parts of the chunks go to [begin, mid) in order, the right parts to [mid, end)
+							std::vector<size_t> left_offsets(chunk_count + 1, 0);
+							thread_pool.ParallelFor(chunk_count, [&](size_t c)
+							{
+								left_offsets[c + 1] = std::count_if(indexes.begin() + chunk_begin(c), indexes.begin() + chunk_end(c), is_left);
+							});
+							for (size_t c = 0; c < chunk_count; c++)
+							{
+								left_offsets[c + 1] += left_offsets[c];
+							}
+							auto mid = begin + left_offsets[chunk_count];
+							thread_pool.ParallelFor(chunk_count, [&](size_t c)
+							{
+								auto left = begin + left_offsets[c];
+								auto right = mid + (chunk_begin(c) - begin - left_offsets[c]);
+								for (size_t i = chunk_begin(c); i < chunk_end(c); i++)
+								{
+									scratch[is_left(indexes[i]) ? left++ : right++] = indexes[i];
+								}
+							});
+							thread_pool.ParallelFor(chunk_count, [&](size_t c)
+							{
+								std::copy(scratch.begin() + chunk_begin(c), scratch.begin() + chunk_end(c), indexes.begin() + chunk_begin(c));
+							});
+							return mid;
+						}
+
+						inline void SetLeaf(BoundingBox& box, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, size_t t_i)
+						{
+							auto& triangle = triangles[t_i];
+							box.triangle_count = 1;
+							box.triangle_index = t_i;
+							box.world_min = triangle.MinWorldBounding();
+							box.world_max = triangle.MaxWorldBounding();
+							box.screen_min = setups[t_i].MinScreenBounding();
+							box.screen_max = setups[t_i].MaxScreenBounding();
+						}
+
+						/// @brief Make the task a node split at mid, the children take the boxes right behind it.
+						/// A subtree of n triangles always takes 2n - 1 boxes.
+						inline void SetChildren(BoundingBox* boxes, Task const& task, size_t mid, Task& left, Task& right)
+						{
+							auto right_index = task.b_i + 2 * (mid - task.begin);
+							boxes[task.b_i].triangle_count = task.end - task.begin;
+							boxes[task.b_i].right_index = right_index;
+							left = { BoundingBox$::LeftChildIndex(task.b_i), task.begin, mid, task.depth + 1 };
+							right = { right_index, mid, task.end, task.depth + 1 };
+						}
+
+						/// @brief Split the task into 2 children, or make it a leaf if it has only one triangle. Return whether it is split.
+						inline bool SplitTask(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, std::vector<AABB> const& bounds, std::vector<size_t>& indexes, Task const& task, Task& left, Task& right)
+						{
+							if (task.end - task.begin == 1)
+							{
+								SetLeaf(boxes[task.b_i], triangles, setups, indexes[task.begin]);
+								return false;
+							}
+
+							SetChildren(boxes, task, Split(bounds, indexes, task.begin, task.end, task.depth), left, right);
+							return true;
+						}
+
+						/// @brief Merge the subtree rooted at b_i bottom-up, whose leaves are ready. Children are always behind their parent.
+						inline void MergeSubtree(BoundingBox* boxes, size_t root_b_i)
+						{
+							for (size_t b_i = root_b_i + BoundingBox$::BoxSize(boxes[root_b_i].triangle_count); b_i-- > root_b_i;)
+							{
+								if (boxes[b_i].triangle_count == 1) continue;
+								Merge(boxes[BoundingBox$::LeftChildIndex(b_i)], boxes[BoundingBox$::RightChildIndex(boxes, b_i)], boxes[b_i]);
+							}
+						}
+
+						/// @brief Build and merge the whole subtree of the root task, which only touches its own boxes and indexes. Return its depth.
+						inline size_t BuildSubtree(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, std::vector<AABB> const& bounds, std::vector<size_t>& indexes, Task const& root)
+						{
+							size_t depth = root.depth;
+							std::vector<Task> tasks;
+							tasks.push_back(root);
+							Task left, right;
+							while (!tasks.empty())
+							{
+								auto task = tasks.back();
+								tasks.pop_back();
+								depth = std::max(depth, task.depth);
+
+								if (!SplitTask(boxes, triangles, setups, bounds, indexes, task, left, right)) continue;
+								tasks.push_back(left);
+								tasks.push_back(right);
+							}
+
+							MergeSubtree(boxes, root.b_i);
+							return depth;
+						}
+
+						/// @brief Refit the leaves of the built subtree rooted at b_i and merge it, which only touches its own boxes.
+						inline void RefitSubtree(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, size_t root_b_i)
+						{
+							auto end = root_b_i + BoundingBox$::BoxSize(boxes[root_b_i].triangle_count);
+							for (size_t b_i = root_b_i; b_i < end; b_i++)
+							{
+								if (boxes[b_i].triangle_count != 1) continue;
+								SetLeaf(boxes[b_i], triangles, setups, boxes[b_i].triangle_index);
+							}
+							MergeSubtree(boxes, root_b_i);
+						}
+
+						/// @brief Split the built tree into the top nodes (parents before children) and the subtrees small enough for one worker
+						inline void SplitTopLevels(BoundingBox const* boxes, std::vector<size_t>& top_b_is, std::vector<size_t>& subtree_b_is)
+						{
+							std::vector<size_t> b_is;
+							b_is.push_back(0);
+							while (!b_is.empty())
+							{
+								auto b_i = b_is.back();
+								b_is.pop_back();
+								if (boxes[b_i].triangle_count < PARALLEL_MIN_TRIANGLES)
 								{
-									return true;
+									subtree_b_is.push_back(b_i);
+									continue;
 								}
-								break;
-							case Y_AXIS:
-								y = value;
-								ratio = (y - location[Y_AXIS]) / direction[Y_AXIS];
-								x = (direction[X_AXIS] * ratio) + location[X_AXIS];
-								z = (direction[Z_AXIS] * ratio) + location[Z_AXIS];
-								if ((x <= box.world_max[X_AXIS] && x >= box.world_min[X_AXIS]) || (z <= box.world_max[Z_AXIS] && z >= box.world_min[Z_AXIS]))
+
+								top_b_is.push_back(b_i);
+								b_is.push_back(BoundingBox$::LeftChildIndex(b_i));
+								b_is.push_back(BoundingBox$::RightChildIndex(boxes, b_i));
+							}
+						}
+					} // namespace __Build
+
+					namespace __IsThrough
+					{
+						/// @brief Segment location + t * direction for t in [0, t_max], the inverse direction is computed once for all slab tests
+						class Ray
+						{
+							public:
+							double location[3];
+							double inverse_direction[3];
+							double t_max;
+
+							Ray(Maths::Vector const& location, Maths::Vector const& direction, double t_max): t_max(t_max)
+							{
+								for (size_t i = 0; i < 3; i++)
 								{
-									return true;
+									this->location[i] = location[i];
+									// a zero component gives infinity, which the slab test handles
+									inverse_direction[i] = 1 / direction[i];
 								}
-								break;
-							case Z_AXIS:
-								z = value;
-								ratio = (z - location[Z_AXIS]) / direction[Z_AXIS];
-								x = (direction[X_AXIS] * ratio) + location[X_AXIS];
-								y = (direction[Y_AXIS] * ratio) + location[Y_AXIS];
-								if ((x <= box.world_max[X_AXIS] && x >= box.world_min[X_AXIS]) || (y <= box.world_max[Y_AXIS] && y >= box.world_min[Y_AXIS]))
+							}
+						};
+
+						/**
+						 * @brief Slab test of the ray against the box, t_near is where the ray enters the box.
+						 * NaN (a zero component of the direction on the plane of a slab) never wins a comparison, so it is ignored.
+						 */
+						inline bool IsThrough(BoundingBox const& box, Ray const& ray, double& t_near)
+						{
+							double t_min = 0, t_max = ray.t_max;
+							for (size_t i = 0; i < 3; i++)
+							{
+								double t1 = (box.world_min[i] - ray.location[i]) * ray.inverse_direction[i];
+								double t2 = (box.world_max[i] - ray.location[i]) * ray.inverse_direction[i];
+								double t_enter = t1 < t2 ? t1 : t2;
+								double t_exit = t1 < t2 ? t2 : t1;
+								t_min = t_enter > t_min ? t_enter : t_min;
+								t_max = t_exit < t_max ? t_exit : t_max;
+							}
+							t_near = t_min;
+							return t_min <= t_max;
+						}
+
+						/// @brief Segments of a Triangle3D$::RayPacket for t in [0, 1], prepared for the slab tests as Ray
+						class PacketRay
+						{
+							public:
+							double location[3][Triangle3D$::RAY_PACKET_SIZE];
+							double inverse_direction[3][Triangle3D$::RAY_PACKET_SIZE];
+
+							PacketRay(Triangle3D$::RayPacket const& packet)
+							{
+								for (size_t i = 0; i < Triangle3D$::RAY_PACKET_SIZE; i++)
 								{
-									return true;
+									location[0][i] = packet.location_x[i];
+									location[1][i] = packet.location_y[i];
+									location[2][i] = packet.location_z[i];
+									inverse_direction[0][i] = 1 / packet.direction_x[i];
+									inverse_direction[1][i] = 1 / packet.direction_y[i];
+									inverse_direction[2][i] = 1 / packet.direction_z[i];
 								}
-							default:
-								break;
 							}
+						};
 
-							return false;
+						/// @brief Node on the traversal stack of a packet with the lanes through it
+						class PacketNode
+						{
+							public:
+							size_t b_i;
+							unsigned int mask;
+						};
 
+						/// @brief Slab test of every lane of the packet against the box, return the mask of the lanes through it and the nearest t_near of them
+						inline unsigned int IsThrough(BoundingBox const& box, PacketRay const& ray, unsigned int mask, double& t_near)
+						{
+							using namespace Triangle3D$;
+							double t_mins[RAY_PACKET_SIZE], t_maxs[RAY_PACKET_SIZE];
+							for (size_t i = 0; i < RAY_PACKET_SIZE; i++)
+							{
+								t_mins[i] = 0;
+								t_maxs[i] = 1;
+							}
+							for (size_t axis = 0; axis < 3; axis++)
+							{
+								for (size_t i = 0; i < RAY_PACKET_SIZE; i++)
+								{
+									double t1 = (box.world_min[axis] - ray.location[axis][i]) * ray.inverse_direction[axis][i];
+									double t2 = (box.world_max[axis] - ray.location[axis][i]) * ray.inverse_direction[axis][i];
+									double t_enter = t1 < t2 ? t1 : t2;
+									double t_exit = t1 < t2 ? t2 : t1;
+									t_mins[i] = t_enter > t_mins[i] ? t_enter : t_mins[i];
+									t_maxs[i] = t_exit < t_maxs[i] ? t_exit : t_maxs[i];
+								}
+							}
+
+							unsigned int through_mask = 0;
+							t_near = DBL_MAX;
+							for (size_t i = 0; i < RAY_PACKET_SIZE; i++)
+							{
+								if (!((mask >> i) & 1) || t_mins[i] > t_maxs[i]) continue;
+								through_mask |= 1u << i;
+								t_near = t_mins[i] < t_near ? t_mins[i] : t_near;
+							}
+							return through_mask;
 						}
 					}
 				}
@@ -104,123 +524,260 @@ void __BoundingBox::Merge(BoundingBox const& l_box, BoundingBox const& r_box, Bo
 	out_box.triangle_count = l_box.triangle_count + r_box.triangle_count;
 }
 
-void BoundingBox$::Build(BoundingBox* boxes, std::vector<Triangle3D> const& triangles)
+void BoundingBox$::Build(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, Utils::Thread::ThreadPool* thread_pool)
 {
-	size_t boxes_size = BoxSize(triangles.size());
-	size_t b_i = LeftNodeIndex(triangles.size());
-	size_t b_i_ = b_i;
-	// init
-	for (size_t t_i = 0; t_i < triangles.size(); t_i++, b_i++)
+	using namespace __BoundingBox::__Build;
+	if (triangles.empty())
 	{
-		boxes[b_i].world_min = triangles[t_i].MinWorldBounding();
-		boxes[b_i].world_max = triangles[t_i].MaxWorldBounding();
-		boxes[b_i].screen_min = triangles[t_i].MinScreenBounding();
-		boxes[b_i].screen_max = triangles[t_i].MaxScreenBounding();
-		boxes[b_i].triangle_count = 1;
-		boxes[b_i].triangle_index = t_i;
+		boxes[0].triangle_count = 0;
+		return;
 	}
 
-	for(b_i; b_i < boxes_size; b_i++)
+	std::vector<AABB> bounds(triangles.size());
+	std::vector<size_t> indexes(triangles.size());
+	auto init_bounds = [&](size_t t_i)
 	{
-		boxes[b_i].world_min = { DBL_MAX, DBL_MAX, DBL_MAX, 1 };
-		boxes[b_i].world_max = { -DBL_MAX, -DBL_MAX, -DBL_MAX, 1 };
-		boxes[b_i].screen_min = { DBL_MAX, DBL_MAX, DBL_MAX, 1 };
-		boxes[b_i].screen_max = { -DBL_MAX, -DBL_MAX, -DBL_MAX, 1 };
-		boxes[b_i].triangle_count = 0;
-	}
-	
+		auto world_min = triangles[t_i].MinWorldBounding();
+		auto world_max = triangles[t_i].MaxWorldBounding();
+		for (size_t i = 0; i < 3; i++)
+		{
+			bounds[t_i].min[i] = world_min[i];
+			bounds[t_i].max[i] = world_max[i];
+		}
+		indexes[t_i] = t_i;
+	};
+
+	Task root = { 0, 0, triangles.size(), 1 };
+	size_t depth = 0;
 
-	for (b_i = b_i_ - 1; b_i >= 0; b_i--)
+	if (thread_pool == nullptr)
 	{
-		__BoundingBox::Merge(boxes[LeftChildIndex(b_i)], boxes[RightChildIndex(b_i)], boxes[b_i]);
-		if(b_i == 0) 
-			break;
+		for (size_t t_i = 0; t_i < triangles.size(); t_i++)
+		{
+			init_bounds(t_i);
+		}
+		depth = BuildSubtree(boxes, triangles, setups, bounds, indexes, root);
 	}
+	else
+	{
+		thread_pool->ParallelFor(triangles.size(), TRIANGLE_CHUNK_SIZE, init_bounds);
+
+		// split the top levels with every split spread over the workers, until there are enough subtrees to keep every worker busy
+		auto subtree_max_triangles = std::max(PARALLEL_MIN_TRIANGLES, triangles.size() / (thread_pool->WorkerCount() * SUBTREES_PER_WORKER));
+		std::vector<size_t> scratch(triangles.size());
+		std::vector<Task> top_tasks;
+		std::vector<Task> subtree_tasks;
+		std::vector<Task> tasks;
+		tasks.push_back(root);
+		Task left, right;
+		while (!tasks.empty())
+		{
+			auto task = tasks.back();
+			tasks.pop_back();
+			if (task.end - task.begin < subtree_max_triangles)
+			{
+				subtree_tasks.push_back(task);
+				continue;
+			}
+
+			SetChildren(boxes, task, ParallelSplit(*thread_pool, bounds, indexes, scratch, task.begin, task.end, task.depth), left, right);
+			top_tasks.push_back(task);
+			tasks.push_back(left);
+			tasks.push_back(right);
+		}
+
+		std::vector<size_t> depths(subtree_tasks.size());
+		thread_pool->ParallelFor(subtree_tasks.size(), [&](size_t i)
+		{
+			depths[i] = BuildSubtree(boxes, triangles, setups, bounds, indexes, subtree_tasks[i]);
+		});
+		for (auto subtree_depth : depths)
+		{
+			depth = std::max(depth, subtree_depth);
+		}
+
+		// merge the top levels, children are always split after their parents
+		for (auto task = top_tasks.rbegin(); task != top_tasks.rend(); task++)
+		{
+			__BoundingBox::Merge(boxes[LeftChildIndex(task->b_i)], boxes[RightChildIndex(boxes, task->b_i)], boxes[task->b_i]);
+		}
+	}
+
+	Utils::Log::Debug(__BoundingBox::LOG_NAME, "Bounding boxes built, node count: %llu, depth: %llu", BoxSize(triangles.size()), depth);
 }
 
 
-bool __BoundingBox::IsThrough(BoundingBox const& box, Maths::Vector const& location, Maths::Vector const& direction)
+void BoundingBox$::Refit(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, Utils::Thread::ThreadPool* thread_pool)
 {
-	// TODO
-	// solve
-	// (x - x0) / dx = (y - y0) / dy = (z - z0) / dz
-	// (for example) x = box.world_min[0]
-	//
-
-	using namespace __IsThrough;
-	if (IsThroughPlane(location, direction, box, X_AXIS, box.world_min[X_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, X_AXIS, box.world_max[X_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Y_AXIS, box.world_min[Y_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Y_AXIS, box.world_max[Y_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Z_AXIS, box.world_min[Z_AXIS])) return true;
-	if (IsThroughPlane(location, direction, box, Z_AXIS, box.world_max[Z_AXIS])) return true;
-
-	return false;
-	
+	using namespace __BoundingBox::__Build;
+	if (triangles.empty()) return;
+
+	if (thread_pool == nullptr)
+	{
+		RefitSubtree(boxes, triangles, setups, 0);
+	}
+	else
+	{
+		std::vector<size_t> top_b_is;
+		std::vector<size_t> subtree_b_is;
+		SplitTopLevels(boxes, top_b_is, subtree_b_is);
+
+		thread_pool->ParallelFor(subtree_b_is.size(), [&](size_t i)
+		{
+			RefitSubtree(boxes, triangles, setups, subtree_b_is[i]);
+		});
+
+		for (auto b_i = top_b_is.rbegin(); b_i != top_b_is.rend(); b_i++)
+		{
+			__BoundingBox::Merge(boxes[LeftChildIndex(*b_i)], boxes[RightChildIndex(boxes, *b_i)], boxes[*b_i]);
+		}
+	}
+
+	Utils::Log::Debug(__BoundingBox::LOG_NAME, "Bounding boxes refitted, node count: %llu", BoxSize(triangles.size()));
 }
 
-void BoundingBox$::MayThrough(
-	BoundingBox* boxes, 
-	size_t b_i, 
-	Utils::List<Triangle3D> const& triangles, 
-	Maths::Vector const& location, 
-	Maths::Vector const& direction, 
-	BlinnPhongReflectionModel$::PointLightBufferItem const& light_buffer_item, 
-	void (*build_per_triangle_light_pixel)(
-		BlinnPhongReflectionModel& bpr_model, 
-		size_t x, 
-		size_t y, 
-		__::Triangle3D& triangle, 
-		size_t point_light_index, 
-		FrameBuffer& buffer), 
-	BlinnPhongReflectionModel& bpr_model, 
-	size_t x, 
-	size_t y,
-	size_t point_light_index, 
-	FrameBuffer& buffer)
+size_t BoundingBox$::Occluded(
+	BoundingBox const* boxes,
+	size_t b_i,
+	Utils::List<Triangle3D> const& triangles,
+	Maths::Vector const& origin,
+	Maths::Vector const& target,
+	size_t skip_triangle_index,
+	Statistics* statistics)
 {
+	using namespace __BoundingBox::__IsThrough;
+	if (statistics != nullptr) statistics->ray_query_count++;
+
+	auto direction_vector = target;
+	direction_vector -= origin;
+	Ray ray(origin, direction_vector, 1);
+	double location[3] = { origin[0], origin[1], origin[2] };
+	double direction[3] = { direction_vector[0], direction_vector[1], direction_vector[2] };
+	double t_near;
+	if (boxes[b_i].triangle_count == 0) return Triangle3D$::INEXIST_INDEX;
+	if (statistics != nullptr) statistics->ray_visited_node_count++;
+	if (!IsThrough(boxes[b_i], ray, t_near)) return Triangle3D$::INEXIST_INDEX;
+
+	// only boxes the segment passes are pushed
 	Utils::ArrayStack<size_t> stack;
 	stack.Push(b_i);
 	while (!stack.IsEmpty())
 	{
 		b_i = stack.Pop();
 
-		if (boxes[b_i].triangle_count == 0) continue;
+		if (boxes[b_i].triangle_count == 1)
+		{
+			if (statistics != nullptr) statistics->ray_visited_leaf_count++;
+			auto triangle_index = boxes[b_i].triangle_index;
+			if (triangle_index != skip_triangle_index && triangles.data[triangle_index].IsThrough(location, direction)) return triangle_index;
+			continue;
+		}
+
+		// test both children, then visit the nearer one first
+		auto l_i = LeftChildIndex(b_i);
+		auto r_i = RightChildIndex(boxes, b_i);
+		double l_t_near, r_t_near;
+		if (statistics != nullptr) statistics->ray_visited_node_count += 2;
+		auto is_l_through = IsThrough(boxes[l_i], ray, l_t_near);
+		auto is_r_through = IsThrough(boxes[r_i], ray, r_t_near);
+		if (is_l_through && is_r_through)
+		{
+			auto is_l_nearer = l_t_near <= r_t_near;
+			stack.Push(is_l_nearer ? r_i : l_i);
+			stack.Push(is_l_nearer ? l_i : r_i);
+		}
+		else if (is_l_through) stack.Push(l_i);
+		else if (is_r_through) stack.Push(r_i);
+	}
+	return Triangle3D$::INEXIST_INDEX;
+}
+
+unsigned int BoundingBox$::Occluded(
+	BoundingBox const* boxes,
+	size_t b_i,
+	Utils::List<Triangle3D> const& triangles,
+	Triangle3D$::RayPacket const& packet,
+	unsigned int mask,
+	size_t const* skip_triangle_indexes,
+	size_t& occluder_index,
+	Statistics* statistics)
+{
+	using namespace __BoundingBox::__IsThrough;
+	if (statistics != nullptr)
+	{
+		for (size_t i = 0; i < Triangle3D$::RAY_PACKET_SIZE; i++) statistics->ray_query_count += (mask >> i) & 1;
+	}
 
-		if (!light_buffer_item.is_exposed) return;
+	PacketRay ray(packet);
+	double t_near;
+	if (boxes[b_i].triangle_count == 0) return 0;
+	if (statistics != nullptr) statistics->ray_visited_node_count++;
+	if (IsThrough(boxes[b_i], ray, mask, t_near) == 0) return 0;
 
-		if (!__BoundingBox::IsThrough(boxes[b_i], location, direction)) continue;
+	// a node is visited once for all lanes through it, lanes are dropped from the mask once blocked
+	Utils::ArrayStack<PacketNode> stack;
+	stack.Push({ b_i, mask });
+	unsigned int blocked_mask = 0;
+	while (!stack.IsEmpty())
+	{
+		auto node = stack.Pop();
+		auto node_mask = node.mask & ~blocked_mask;
+		if (node_mask == 0) continue;
 
-		if (boxes[b_i].triangle_count == 1)
+		if (boxes[node.b_i].triangle_count == 1)
 		{
-			build_per_triangle_light_pixel(bpr_model, x, y, triangles.data[boxes[b_i].triangle_index], point_light_index, buffer);
-			if (!light_buffer_item.is_exposed) return;
+			if (statistics != nullptr) statistics->ray_visited_leaf_count++;
+			auto triangle_index = boxes[node.b_i].triangle_index;
+			// the triangle of a point never shadows it
+			for (size_t i = 0; i < Triangle3D$::RAY_PACKET_SIZE; i++)
+			{
+				if (skip_triangle_indexes[i] == triangle_index) node_mask &= ~(1u << i);
+			}
+			if (node_mask == 0) continue;
+			auto through_mask = triangles.data[triangle_index].IsThrough(packet, node_mask);
+			if (through_mask == 0) continue;
+			occluder_index = triangle_index;
+			blocked_mask |= through_mask;
+			if (blocked_mask == mask) return blocked_mask;
 			continue;
 		}
 
-		stack.Push(LeftChildIndex(b_i));
-		stack.Push(RightChildIndex(b_i));
+		auto l_i = LeftChildIndex(node.b_i);
+		auto r_i = RightChildIndex(boxes, node.b_i);
+		double l_t_near, r_t_near;
+		if (statistics != nullptr) statistics->ray_visited_node_count += 2;
+		auto l_mask = IsThrough(boxes[l_i], ray, node_mask, l_t_near);
+		auto r_mask = IsThrough(boxes[r_i], ray, node_mask, r_t_near);
+		if (l_mask != 0 && r_mask != 0)
+		{
+			auto is_l_nearer = l_t_near <= r_t_near;
+			stack.Push(is_l_nearer ? PacketNode { r_i, r_mask } : PacketNode { l_i, l_mask });
+			stack.Push(is_l_nearer ? PacketNode { l_i, l_mask } : PacketNode { r_i, r_mask });
+		}
+		else if (l_mask != 0) stack.Push({ l_i, l_mask });
+		else if (r_mask != 0) stack.Push({ r_i, r_mask });
 	}
-	
+	return blocked_mask;
 }
 
 void BoundingBox$::MayScreenCover(
 	BoundingBox* boxes,
 	size_t b_i,
-	Utils::List<__::Triangle3D> const& triangles,
+	Utils::List<__::Triangle3D$::SetupRecord> const& setups,
 	size_t x,
 	size_t y,
 	void (*write_to_pixel_per_triangle)(
-		__::Triangle3D& triangle, 
+		__::Triangle3D$::SetupRecord const& setup, 
 		size_t x,
 		size_t y,
-		FrameBuffer& buffer,
-		double nearest_dist,
-		Object* cuda_objects),
-	FrameBuffer& buffer,
+		VisibilitySample& sample,
+		double nearest_dist),
+	VisibilitySample& sample,
 	double nearest_dist,
-	Object* cuda_objects)
+	Statistics* statistics)
 {
+	if (statistics != nullptr) statistics->screen_query_count++;
+
 	Utils::ArrayStack<size_t> stack;
 	stack.Push(b_i);
 	while (!stack.IsEmpty())
@@ -239,12 +796,13 @@ void BoundingBox$::MayScreenCover(
 
 		if (boxes[b_i].triangle_count == 1)
 		{
-			write_to_pixel_per_triangle(triangles.data[boxes[b_i].triangle_index], x, y, buffer, nearest_dist, cuda_objects);
+			if (statistics != nullptr) statistics->screen_visited_leaf_count++;
+			write_to_pixel_per_triangle(setups.data[boxes[b_i].triangle_index], x, y, sample, nearest_dist);
 			continue;
 		}
 		
 
 		stack.Push(LeftChildIndex(b_i));
-		stack.Push(RightChildIndex(b_i));
+		stack.Push(RightChildIndex(boxes, b_i));
 	}
 }
\ No newline at end of file
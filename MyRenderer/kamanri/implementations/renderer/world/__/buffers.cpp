@@ -56,6 +56,8 @@ Buffers::Buffers(size_t width, size_t height, bool is_use_cuda)
 	_height = height;
 	_buffers = NewArray<FrameBuffer>(width * height);
 	_bitmap_buffer = NewArray<DWORD>(width * height);
+	Log::Debug(__Buffers::LOG_NAME, "%llu x %llu buffers: %llu bytes per pixel, %llu bytes in total",
+		width, height, sizeof(FrameBuffer) + sizeof(DWORD), (sizeof(FrameBuffer) + sizeof(DWORD)) * width * height);
 
 	if(!is_use_cuda) return;
 
@@ -102,7 +104,7 @@ Buffers& Buffers::operator=(Buffers&& other)
 
 void Buffers::InitPixel(size_t x, size_t y)
 {
-	GetFrame(x, y).location.Set(2, -DBL_MAX);
+	GetFrame(x, y).depth = FrameBuffer$::EMPTY_DEPTH;
 }
 
 void Buffers::CleanBitmap() const
@@ -124,7 +126,6 @@ FrameBuffer& Buffers::GetFrame(size_t x, size_t y)
 	
 }
 
-
 DWORD& Buffers::GetBitmapBuffer(size_t x, size_t y)
 {
 	using namespace __Buffers;
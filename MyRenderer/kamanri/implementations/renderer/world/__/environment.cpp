@@ -6,14 +6,13 @@ Environment& Environment::operator=(Environment const& other)
     bpr_model = other.bpr_model;
     triangles = other.triangles;
     cuda_triangles = other.cuda_triangles;
+    setups = other.setups;
+    cuda_setups = other.cuda_setups;
+    attributes = other.attributes;
+    cuda_attributes = other.cuda_attributes;
 
     objects = other.objects;
     cuda_objects = other.cuda_objects;
-	
-    for (size_t i = 0; i < objects.size(); i++)
-    {   
-        objects[i].__UpdateTriangleRef(triangles, objects, i);
-    }
     return *this;
 };
 
@@ -22,13 +21,12 @@ Environment& Environment::operator=(Environment&& other)
     bpr_model = std::move(other.bpr_model);
     triangles = std::move(other.triangles);
     cuda_triangles = other.cuda_triangles;
+    setups = std::move(other.setups);
+    cuda_setups = other.cuda_setups;
+    attributes = std::move(other.attributes);
+    cuda_attributes = other.cuda_attributes;
 
     objects = std::move(other.objects);
     cuda_objects = other.cuda_objects;
-	
-    for (size_t i = 0; i < objects.size(); i++)
-    {   
-        objects[i].__UpdateTriangleRef(triangles, objects, i);
-    }
     return *this;
 };
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include "kamanri/renderer/world/__/shadow_map.hpp"
+#include "kamanri/utils/string.hpp"
+#include "kamanri/utils/log.hpp"
+
+using namespace Kamanri::Utils;
+using namespace Kamanri::Maths;
+using namespace Kamanri::Renderer::World::__;
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		namespace World
+		{
+			namespace __
+			{
+				namespace __ShadowMap
+				{
+					constexpr const char* LOG_NAME = STR(Kamanri::Renderer::World::__::ShadowMap);
+
+					/// @brief The cos below it is taken as it, so the bias of grazing surfaces is bounded
+					constexpr double MIN_COS_THETA = 0.1;
+
+					inline double Determinant(double a00, double a01, double a10, double a11)
+					{
+						return ((a00) * (a11) - (a10) * (a01));
+					}
+
+					inline double Max(double x1, double x2, double x3)
+					{
+						return x1 > x2 ? (x1 > x3 ? x1 : x3) : (x2 > x3 ? x2 : x3);
+					}
+
+					inline double Min(double x1, double x2, double x3)
+					{
+						return x1 < x2 ? (x1 < x3 ? x1 : x3) : (x2 < x3 ? x2 : x3);
+					}
+
+					/// @brief Rasterize a triangle of the face at the centers of texels, q is the inverse depth which is linear on the face
+					void RasterizeTriangle(float* depths, std::uint32_t* triangle_indexes, size_t resolution, double const* s_x, double const* s_y, double const* q, std::uint32_t triangle_index)
+					{
+						auto area = Determinant(s_x[1] - s_x[0], s_x[2] - s_x[0], s_y[1] - s_y[0], s_y[2] - s_y[0]);
+						if (area == 0) return;
+
+						// texel i covers [i, i + 1), its center is i + 0.5
+						auto max_texel = (double)resolution - 1;
+						auto min_x = Maths::Max(ceil(Min(s_x[0], s_x[1], s_x[2]) - 0.5), 0.0);
+						auto max_x = Maths::Min(floor(Max(s_x[0], s_x[1], s_x[2]) - 0.5), max_texel);
+						auto min_y = Maths::Max(ceil(Min(s_y[0], s_y[1], s_y[2]) - 0.5), 0.0);
+						auto max_y = Maths::Min(floor(Max(s_y[0], s_y[1], s_y[2]) - 0.5), max_texel);
+						if (min_x > max_x || min_y > max_y) return;
+
+						for (auto y = (size_t)min_y; y <= (size_t)max_y; y++)
+						{
+							auto center_y = y + 0.5;
+							for (auto x = (size_t)min_x; x <= (size_t)max_x; x++)
+							{
+								auto center_x = x + 0.5;
+								// areal coordinates
+								auto w0 = Determinant(s_x[1] - center_x, s_x[2] - center_x, s_y[1] - center_y, s_y[2] - center_y) / area;
+								auto w1 = Determinant(s_x[2] - center_x, s_x[0] - center_x, s_y[2] - center_y, s_y[0] - center_y) / area;
+								auto w2 = 1 - w0 - w1;
+								if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+								auto depth = (float)(1 / (w0 * q[0] + w1 * q[1] + w2 * q[2]));
+								auto i = y * resolution + x;
+								if (depth >= depths[i]) continue;
+								depths[i] = depth;
+								triangle_indexes[i] = triangle_index;
+							}
+						}
+					}
+
+					/// @brief Coordinates of the direction on the face: a, b along the face and c along its axis
+					inline void ToFace(size_t face, double const* direction, double& a, double& b, double& c)
+					{
+						auto axis = face / 2;
+						a = direction[(axis + 1) % 3];
+						b = direction[(axis + 2) % 3];
+						c = face % 2 == 0 ? direction[axis] : -direction[axis];
+					}
+				} // namespace __ShadowMap
+
+			} // namespace __
+
+		} // namespace World
+
+	} // namespace Renderer
+
+} // namespace Kamanri
+
+ShadowMap::ShadowMap(size_t resolution): _resolution(resolution)
+{
+	auto texel_count = ShadowMap$::FACE_COUNT * resolution * resolution;
+	_depths = NewArray<float>(texel_count);
+	_triangle_indexes = NewArray<std::uint32_t>(texel_count);
+	std::fill(_depths.get(), _depths.get() + texel_count, ShadowMap$::EMPTY_DEPTH);
+	Log::Debug(__ShadowMap::LOG_NAME, "%llu x %llu shadow cube map: %llu bytes", resolution, resolution, texel_count * (sizeof(float) + sizeof(std::uint32_t)));
+}
+
+ShadowMap::ShadowMap(ShadowMap const& other)
+{
+	*this = other;
+}
+
+ShadowMap& ShadowMap::operator=(ShadowMap const& other)
+{
+	auto texel_count = ShadowMap$::FACE_COUNT * other._resolution * other._resolution;
+	_resolution = other._resolution;
+	_depths = CopyArray(other._depths.get(), texel_count);
+	_triangle_indexes = CopyArray(other._triangle_indexes.get(), texel_count);
+	return *this;
+}
+
+void ShadowMap::BuildFace(size_t face, Vector const& light_location, std::vector<Triangle3D> const& triangles)
+{
+	using namespace __ShadowMap;
+	auto face_size = _resolution * _resolution;
+	auto depths = _depths.get() + face * face_size;
+	std::fill(depths, depths + face_size, ShadowMap$::EMPTY_DEPTH);
+
+	double light[3] = { light_location[0], light_location[1], light_location[2] };
+	double xs[3], ys[3], zs[3];
+	double a[3], b[3], c[3];
+	for (auto& triangle : triangles)
+	{
+		triangle.WorldVertices(xs, ys, zs);
+		for (size_t i = 0; i < 3; i++)
+		{
+			double direction[3] = { xs[i] - light[0], ys[i] - light[1], zs[i] - light[2] };
+			ToFace(face, direction, a[i], b[i], c[i]);
+		}
+
+		// out of the frustum of the face
+		if (c[0] <= ShadowMap$::NEAR_DIST && c[1] <= ShadowMap$::NEAR_DIST && c[2] <= ShadowMap$::NEAR_DIST) continue;
+		if ((a[0] > c[0] && a[1] > c[1] && a[2] > c[2]) || (a[0] < -c[0] && a[1] < -c[1] && a[2] < -c[2])) continue;
+		if ((b[0] > c[0] && b[1] > c[1] && b[2] > c[2]) || (b[0] < -c[0] && b[1] < -c[1] && b[2] < -c[2])) continue;
+
+		__WriteToFace(face, a, b, c, (std::uint32_t)triangle.Index());
+	}
+}
+
+void ShadowMap::__WriteToFace(size_t face, double const* a, double const* b, double const* c, std::uint32_t triangle_index)
+{
+	using namespace __ShadowMap;
+	// clip by the near plane, a triangle becomes a polygon of at most 4 vertices
+	double clipped_a[4], clipped_b[4], clipped_c[4];
+	size_t count = 0;
+	for (size_t i = 0; i < 3; i++)
+	{
+		auto j = (i + 1) % 3;
+		auto is_i_in = c[i] > ShadowMap$::NEAR_DIST;
+		auto is_j_in = c[j] > ShadowMap$::NEAR_DIST;
+		if (is_i_in)
+		{
+			clipped_a[count] = a[i];
+			clipped_b[count] = b[i];
+			clipped_c[count] = c[i];
+			count++;
+		}
+		if (is_i_in != is_j_in)
+		{
+			auto t = (ShadowMap$::NEAR_DIST - c[i]) / (c[j] - c[i]);
+			clipped_a[count] = a[i] + (a[j] - a[i]) * t;
+			clipped_b[count] = b[i] + (b[j] - b[i]) * t;
+			clipped_c[count] = ShadowMap$::NEAR_DIST;
+			count++;
+		}
+	}
+	if (count < 3) return;
+
+	// project to the face, [-1, 1] maps to [0, resolution]
+	double s_x[4], s_y[4], q[4];
+	auto half_resolution = _resolution * 0.5;
+	for (size_t i = 0; i < count; i++)
+	{
+		s_x[i] = (clipped_a[i] / clipped_c[i] + 1) * half_resolution;
+		s_y[i] = (clipped_b[i] / clipped_c[i] + 1) * half_resolution;
+		q[i] = 1 / clipped_c[i];
+	}
+
+	auto face_size = _resolution * _resolution;
+	auto depths = _depths.get() + face * face_size;
+	auto triangle_indexes = _triangle_indexes.get() + face * face_size;
+	RasterizeTriangle(depths, triangle_indexes, _resolution, s_x, s_y, q, triangle_index);
+	if (count == 4)
+	{
+		double fan_x[3] = { s_x[0], s_x[2], s_x[3] };
+		double fan_y[3] = { s_y[0], s_y[2], s_y[3] };
+		double fan_q[3] = { q[0], q[2], q[3] };
+		RasterizeTriangle(depths, triangle_indexes, _resolution, fan_x, fan_y, fan_q, triangle_index);
+	}
+}
+
+double ShadowMap::Exposure(Vector const& light_location, Vector const& location, size_t triangle_index, double cos_theta) const
+{
+	using namespace __ShadowMap;
+	double direction[3] = { location[0] - light_location[0], location[1] - light_location[1], location[2] - light_location[2] };
+
+	// the face is chosen by the major axis
+	size_t axis = 0;
+	if (fabs(direction[1]) > fabs(direction[axis])) axis = 1;
+	if (fabs(direction[2]) > fabs(direction[axis])) axis = 2;
+	auto face = axis * 2 + (direction[axis] < 0 ? 1 : 0);
+
+	double a, b, depth;
+	ToFace(face, direction, a, b, depth);
+	if (depth <= ShadowMap$::NEAR_DIST) return 1;
+
+	auto half_resolution = _resolution * 0.5;
+	auto center_x = (long long)floor((a / depth + 1) * half_resolution);
+	auto center_y = (long long)floor((b / depth + 1) * half_resolution);
+
+	// a texel covers 2 * depth / resolution on the surface facing the light, tilted surfaces change faster
+	cos_theta = Maths::Max(cos_theta, MIN_COS_THETA);
+	auto tan_theta = sqrt(1 - cos_theta * cos_theta) / cos_theta;
+	auto bias = ShadowMap$::BIAS_TEXELS * (2 * depth / _resolution) * (1 + tan_theta);
+
+	auto face_size = _resolution * _resolution;
+	auto depths = _depths.get() + face * face_size;
+	auto triangle_indexes = _triangle_indexes.get() + face * face_size;
+	auto max_texel = (long long)_resolution - 1;
+	size_t exposed_count = 0;
+	for (int dy = -ShadowMap$::PCF_RADIUS; dy <= ShadowMap$::PCF_RADIUS; dy++)
+	{
+		auto y = (size_t)std::min(std::max(center_y + dy, 0LL), max_texel);
+		for (int dx = -ShadowMap$::PCF_RADIUS; dx <= ShadowMap$::PCF_RADIUS; dx++)
+		{
+			auto x = (size_t)std::min(std::max(center_x + dx, 0LL), max_texel);
+			auto i = y * _resolution + x;
+			if (depths[i] + bias >= depth || triangle_indexes[i] == triangle_index) exposed_count++;
+		}
+	}
+	constexpr int PCF_LENGTH = 2 * ShadowMap$::PCF_RADIUS + 1;
+	return (double)exposed_count / (PCF_LENGTH * PCF_LENGTH);
+}
@@ -1,8 +1,9 @@
 #include <cfloat>
+#include <cmath>
 #include "kamanri/renderer/world/__/triangle3d.hpp"
 #include "kamanri/utils/log.hpp"
 #include "kamanri/maths/vector.hpp"
-#include "kamanri/maths/smatrix.hpp"
+#include "kamanri/maths/vec.hpp"
 #include "kamanri/utils/string.hpp"
 
 using namespace Kamanri::Utils;
@@ -22,63 +23,21 @@ namespace Kamanri
 				{
 					constexpr const char* LOG_NAME = STR(Kamanri::Renderer::World::__::Triangle3D);
 
-					namespace IsScreenCover
-					{
-						double v1_v2_xy_determinant;
-						double v2_v3_xy_determinant;
-						double v3_v1_xy_determinant;
-					} // namespace IsScreenCover
-					
-					namespace Build
-					{
-						SMatrix screen_vertices_matrix(3);
-						Vector s_abc_vec(3);
-						SMatrix world_vertices_matrix(3);
-						Vector w_abc_vec(3);
-						SMatrix areal_coordinates_build_matrix(3);
-					} // namespace Build
-					
-					namespace WriteToPixel
-					{
-						
-
-						// double areal_coordinates_1;
-						// double areal_coordinates_2;
-						// double areal_coordinates_3;
-
-						// double world_z;
-
-						// double img_u;
-						// double img_v;
-					} // namespace WriteToPixel
-
-					namespace WriteTo
-					{
-						double nearest_dist;
-					} // namespace WriteTo
-					
-					
-
-					namespace ArealCoordinates
-					{
-						
-						SMatrix a(3);
-					} // namespace ArealCoordinates
-
-
 					inline double Determinant(double a00, double a01, double a10, double a11)
 					{
 						return ((a00) * (a11) - (a10) * (a01));
 					}
 
-					inline double PerspectiveUndo(Vector const& areal_coordinates, double v1_factor, double v2_factor, double v3_factor)
+					/// @brief Interpolate the factors of vertices with perspective correction, q is given by the setup record
+					inline double PerspectiveCorrect(double q1, double q2, double q3, double v1_factor, double v2_factor, double v3_factor, double world_z)
 					{
-						return (1.0 / (areal_coordinates[0] / v1_factor + areal_coordinates[1] / v2_factor + areal_coordinates[2] / v3_factor));
+						return ((q1 * v1_factor + q2 * v2_factor + q3 * v3_factor) * world_z);
 					}
 
-					inline double PerspectiveCorrect(Vector const& areal_coordinates, double v1_factor, double v2_factor, double v3_factor, double c_v1_factor, double c_v2_factor, double c_v3_factor, double c_this_factor)
+					/// @brief Screen space derivative of the perspective corrected value, dq is q_dx or q_dy of the setup record
+					inline double PerspectiveDerivative(double dq1, double dq2, double dq3, double v1_factor, double v2_factor, double v3_factor, double value, double world_z)
 					{
-						return ((areal_coordinates[0] * v1_factor / c_v1_factor + areal_coordinates[1] * v2_factor / c_v2_factor + areal_coordinates[2] * v3_factor / c_v3_factor) * c_this_factor);
+						return ((dq1 * v1_factor + dq2 * v2_factor + dq3 * v3_factor - value * (dq1 + dq2 + dq3)) * world_z);
 					}
 
 					inline double Max(double x1, double x2, double x3)
@@ -105,10 +64,8 @@ namespace Kamanri
 
 
 
-Triangle3D::Triangle3D(std::vector<Object>& objects, size_t object_index, size_t index, size_t v1, size_t v2, size_t v3, size_t vt1, size_t vt2, size_t vt3, size_t vn1, size_t vn2, size_t vn3)
-: _areal_coordinates_calculate_matrix(3)
+Triangle3D::Triangle3D(size_t object_index, size_t index, size_t v1, size_t v2, size_t v3, size_t vt1, size_t vt2, size_t vt3, size_t vn1, size_t vn2, size_t vn3)
 {
-	_p_objects = &objects;
 	_object_index = object_index;
 	_index = index;
 	_v1 = v1;
@@ -130,118 +87,114 @@ void Triangle3D::PrintTriangle(LogLevel level) const
 }
 
 
-void Triangle3D::Build(Resources const& res)
+void Triangle3D::Build(Resources const& res, Triangle3D$::SetupRecord& setup, Triangle3D$::AttributeRecord& attributes)
 {
-	using namespace __Triangle3D::Build;
+	setup.index = _index;
+	attributes.object_index = (unsigned int)_object_index;
 
 	// 1. Build the location of triangle
-	_s_v1_x = res.vertices_transformed[_v1][0];
-	_s_v1_y = res.vertices_transformed[_v1][1];
-	_s_v1_z = res.vertices_transformed[_v1][2];
-	_s_v2_x = res.vertices_transformed[_v2][0];
-	_s_v2_y = res.vertices_transformed[_v2][1];
-	_s_v2_z = res.vertices_transformed[_v2][2];
-	_s_v3_x = res.vertices_transformed[_v3][0];
-	_s_v3_y = res.vertices_transformed[_v3][1];
-	_s_v3_z = res.vertices_transformed[_v3][2];
+	auto s_x = res.vertices_transformed.Component(0);
+	auto s_y = res.vertices_transformed.Component(1);
+	size_t v[3] = { _v1, _v2, _v3 };
+	for (size_t i = 0; i < 3; i++)
+	{
+		setup.s_x[i] = s_x[v[i]];
+		setup.s_y[i] = s_y[v[i]];
+	}
 
 	// add world location
-	_w_v1_x = res.vertices_model_view_transformed[_v1][0];
-	_w_v2_x = res.vertices_model_view_transformed[_v2][0];
-	_w_v3_x = res.vertices_model_view_transformed[_v3][0];
-	_w_v1_y = res.vertices_model_view_transformed[_v1][1];
-	_w_v2_y = res.vertices_model_view_transformed[_v2][1];
-	_w_v3_y = res.vertices_model_view_transformed[_v3][1];
-	_w_v1_z = res.vertices_model_view_transformed[_v1][2];
-	_w_v2_z = res.vertices_model_view_transformed[_v2][2];
-	_w_v3_z = res.vertices_model_view_transformed[_v3][2];
-
-
-	// build world coordinates vector
-	_w_v1_v2 = res.vertices_model_view_transformed[_v2];
-	_w_v1_v2 -= res.vertices_model_view_transformed[_v1];
-	_w_v2_v3 = res.vertices_model_view_transformed[_v3];
-	_w_v2_v3 -= res.vertices_model_view_transformed[_v2];
-	_w_v3_v1 = res.vertices_model_view_transformed[_v1];
-	_w_v3_v1 -= res.vertices_model_view_transformed[_v3];
-
-	// 2. build abc
-	screen_vertices_matrix = 
-	{
-		_s_v1_x, _s_v1_y, _s_v1_z,
-		_s_v2_x, _s_v2_y, _s_v2_z,
-		_s_v3_x, _s_v3_y, _s_v3_z
-	};
-	world_vertices_matrix = 
+	auto w_x = res.vertices_model_view_transformed.Component(0);
+	auto w_y = res.vertices_model_view_transformed.Component(1);
+	auto w_z = res.vertices_model_view_transformed.Component(2);
+	_w_v1_x = w_x[_v1];
+	_w_v2_x = w_x[_v2];
+	_w_v3_x = w_x[_v3];
+	_w_v1_y = w_y[_v1];
+	_w_v2_y = w_y[_v2];
+	_w_v3_y = w_y[_v3];
+	_w_v1_z = w_z[_v1];
+	_w_v2_z = w_z[_v2];
+	_w_v3_z = w_z[_v3];
+	for (size_t i = 0; i < 3; i++)
 	{
-		_w_v1_x, _w_v1_y, _w_v1_z,
-		_w_v2_x, _w_v2_y, _w_v2_z,
-		_w_v3_x, _w_v3_y, _w_v3_z
-	};
-	
-	s_abc_vec = {1, 1, 1};
-	w_abc_vec = {1, 1, 1};
+		attributes.w_x[i] = w_x[v[i]];
+		attributes.w_y[i] = w_y[v[i]];
+	}
 
-	(-screen_vertices_matrix) * s_abc_vec;
-	(-world_vertices_matrix) * w_abc_vec;
 
-	_s_a = s_abc_vec[0];
-	_s_b = s_abc_vec[1];
-	_s_c = s_abc_vec[2];
-	_w_a = w_abc_vec[0];
-	_w_b = w_abc_vec[1];
-	_w_c = w_abc_vec[2];
+	// 2. build the edges of the ray test
+	_w_e1[0] = _w_v2_x - _w_v1_x;
+	_w_e1[1] = _w_v2_y - _w_v1_y;
+	_w_e1[2] = _w_v2_z - _w_v1_z;
+	_w_e2[0] = _w_v3_x - _w_v1_x;
+	_w_e2[1] = _w_v3_y - _w_v1_y;
+	_w_e2[2] = _w_v3_z - _w_v1_z;
 
 	// 3. Build the color of every pixel in triangle
-	_vt1_x = res.vertex_textures[_vt1][0];
-	_vt1_y = res.vertex_textures[_vt1][1];
-	_vt2_x = res.vertex_textures[_vt2][0];
-	_vt2_y = res.vertex_textures[_vt2][1];
-	_vt3_x = res.vertex_textures[_vt3][0];
-	_vt3_y = res.vertex_textures[_vt3][1];
+	auto vt_x = res.vertex_textures.Component(0);
+	auto vt_y = res.vertex_textures.Component(1);
+	size_t vt[3] = { _vt1, _vt2, _vt3 };
+	for (size_t i = 0; i < 3; i++)
+	{
+		// a corner without vt samples the origin of the texture
+		attributes.vt_u[i] = vt[i] == Triangle3D$::INEXIST_INDEX ? 0.f : (float)vt_x[vt[i]];
+		attributes.vt_v[i] = vt[i] == Triangle3D$::INEXIST_INDEX ? 0.f : (float)vt_y[vt[i]];
+	}
 
 	// build vertex normals
-	_vn1_x = res.vertex_normals_model_view_transformed[_vn1][0];
-	_vn1_y = res.vertex_normals_model_view_transformed[_vn1][1];
-	_vn1_z = res.vertex_normals_model_view_transformed[_vn1][2];
-	_vn2_x = res.vertex_normals_model_view_transformed[_vn2][0];
-	_vn2_y = res.vertex_normals_model_view_transformed[_vn2][1];
-	_vn2_z = res.vertex_normals_model_view_transformed[_vn2][2];
-	_vn3_x = res.vertex_normals_model_view_transformed[_vn3][0];
-	_vn3_y = res.vertex_normals_model_view_transformed[_vn3][1];
-	_vn3_z = res.vertex_normals_model_view_transformed[_vn3][2];
-
-	// 4. build a and n_a of areal coordinates
-	areal_coordinates_build_matrix = 
+	auto vn_x = res.vertex_normals_model_view_transformed.Component(0);
+	auto vn_y = res.vertex_normals_model_view_transformed.Component(1);
+	auto vn_z = res.vertex_normals_model_view_transformed.Component(2);
+	size_t vn[3] = { _vn1, _vn2, _vn3 };
+	// a corner without vn uses the normal of the face, which follows the winding of the vertices
+	auto face_normal = Cross(Vec4(_w_e1[0], _w_e1[1], _w_e1[2], 0), Vec4(_w_e2[0], _w_e2[1], _w_e2[2], 0)).Unitization();
+	for (size_t i = 0; i < 3; i++)
 	{
-		{ _s_v1_x, _s_v1_y, _s_v1_z },
-		{ _s_v2_x, _s_v2_y, _s_v2_z },
-		{ _s_v3_x, _s_v3_y, _s_v3_z },
-	};
+		auto is_inexist = vn[i] == Triangle3D$::INEXIST_INDEX;
+		attributes.vn_x[i] = (float)(is_inexist ? face_normal[0] : vn_x[vn[i]]);
+		attributes.vn_y[i] = (float)(is_inexist ? face_normal[1] : vn_y[vn[i]]);
+		attributes.vn_z[i] = (float)(is_inexist ? face_normal[2] : vn_z[vn[i]]);
+	}
 
-	_areal_coordinates_calculate_matrix = -areal_coordinates_build_matrix;
+	// 4. build q of areal coordinates
+	// the areal coordinate of a vertex is the edge function of the opposite edge over the area,
+	// a triangle without area gets q = 0, whose depth is infinity and never passes the depth test
+	auto& x = setup.s_x;
+	auto& y = setup.s_y;
+	double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	double inverse_area = area == 0 ? 0 : 1 / area;
+	double inverse_w[3] = { 1 / _w_v1_z, 1 / _w_v2_z, 1 / _w_v3_z };
+	for (size_t i = 0; i < 3; i++)
+	{
+		auto j = (i + 1) % 3;
+		auto k = (i + 2) % 3;
+		auto factor = inverse_area * inverse_w[i];
+		setup.q_dx[i] = (y[j] - y[k]) * factor;
+		setup.q_dy[i] = (x[k] - x[j]) * factor;
+		setup.q_0[i] = (x[j] * y[k] - x[k] * y[j]) * factor;
+	}
 
 }
 
 
-bool Triangle3D::IsScreenCover(double x, double y) const
+bool Triangle3D$::SetupRecord::IsScreenCover(double x, double y) const
 {
 	using namespace __Triangle3D;
-	using namespace __Triangle3D::IsScreenCover;
-	v1_v2_xy_determinant = Determinant
+	// locals, this is called by every pixel from multiple threads
+	double v1_v2_xy_determinant = Determinant
 	(
-		_s_v2_x - _s_v1_x, x - _s_v1_x,
-		_s_v2_y - _s_v1_y, y - _s_v1_y
+		s_x[1] - s_x[0], x - s_x[0],
+		s_y[1] - s_y[0], y - s_y[0]
 	);
-	v2_v3_xy_determinant = Determinant
+	double v2_v3_xy_determinant = Determinant
 	(
-		_s_v3_x - _s_v2_x, x - _s_v2_x,
-		_s_v3_y - _s_v2_y, y - _s_v2_y
+		s_x[2] - s_x[1], x - s_x[1],
+		s_y[2] - s_y[1], y - s_y[1]
 	);
-	v3_v1_xy_determinant = Determinant
+	double v3_v1_xy_determinant = Determinant
 	(
-		_s_v1_x - _s_v3_x, x - _s_v3_x,
-		_s_v1_y - _s_v3_y, y - _s_v3_y
+		s_x[0] - s_x[2], x - s_x[2],
+		s_y[0] - s_y[2], y - s_y[2]
 	);
 
 	if (v1_v2_xy_determinant * v2_v3_xy_determinant >= 0 && v2_v3_xy_determinant * v3_v1_xy_determinant >= 0 && v3_v1_xy_determinant * v1_v2_xy_determinant >= 0)
@@ -252,141 +205,154 @@ bool Triangle3D::IsScreenCover(double x, double y) const
 	return false;
 }
 
-/// @brief Judge the line(location, direction) is through the triangle
-/// @param location 
-/// @param direction 
-/// @return 
-bool Triangle3D::IsThrough(Maths::Vector& location, Maths::Vector& direction, double& output_distance)
+unsigned int Triangle3D::IsThrough(Triangle3D$::RayPacket const& packet, unsigned int mask) const
 {
-	// solve
-	// (x - x0) / dx = (y - y0) / dy = (z - z0) / dz
-	// ax + by + cz - 1 = 0
-	//
-	auto dxdy = direction[0] * direction[1];
-	auto dxdz = direction[0] * direction[2];
-	auto dydz = direction[1] * direction[2];
-	Vector conjunction = 
+	using namespace Triangle3D$;
+	// the same arithmetic as IntersectRay without branches, a lane which misses gets false, a parallel one gets NaN
+	bool is_through[RAY_PACKET_SIZE];
+	for (size_t i = 0; i < RAY_PACKET_SIZE; i++)
 	{
-		location[0] * dydz - location[1] * dxdz,
-		location[0] * dydz - location[2] * dxdy,
-		1
-	};
-	SMatrix a = 
-	{
-		dydz, -dxdz, 0,
-		dydz, 0, -dxdy,
-		_w_a, _w_b, _w_c
-	};
-
-	(-a) * conjunction;
-
-	// judge the cross product
-
-	Vector c_v1_v2 = 
-	{
-		conjunction[0] - _w_v1_x,
-		conjunction[1] - _w_v1_y,
-		conjunction[2] - _w_v1_z,
-		1
-	};
-
-	Vector c_v2_v3 = 
-	{
-		conjunction[0] - _w_v2_x,
-		conjunction[1] - _w_v2_y,
-		conjunction[2] - _w_v2_z,
-		1
-	};
-	Vector c_v3_v1 = 
-	{
-		conjunction[0] - _w_v3_x,
-		conjunction[1] - _w_v3_y,
-		conjunction[2] - _w_v3_z,
-		1
-	};
-
-	c_v1_v2 *= _w_v1_v2;
-	c_v2_v3 *= _w_v2_v3;
-	c_v3_v1 *= _w_v3_v1;
+		auto p_x = packet.direction_y[i] * _w_e2[2] - packet.direction_z[i] * _w_e2[1];
+		auto p_y = packet.direction_z[i] * _w_e2[0] - packet.direction_x[i] * _w_e2[2];
+		auto p_z = packet.direction_x[i] * _w_e2[1] - packet.direction_y[i] * _w_e2[0];
+		auto inverse_determinant = 1 / (_w_e1[0] * p_x + _w_e1[1] * p_y + _w_e1[2] * p_z);
+
+		auto s_x = packet.location_x[i] - _w_v1_x;
+		auto s_y = packet.location_y[i] - _w_v1_y;
+		auto s_z = packet.location_z[i] - _w_v1_z;
+		auto u = (s_x * p_x + s_y * p_y + s_z * p_z) * inverse_determinant;
+
+		auto q_x = s_y * _w_e1[2] - s_z * _w_e1[1];
+		auto q_y = s_z * _w_e1[0] - s_x * _w_e1[2];
+		auto q_z = s_x * _w_e1[1] - s_y * _w_e1[0];
+		auto v = (packet.direction_x[i] * q_x + packet.direction_y[i] * q_y + packet.direction_z[i] * q_z) * inverse_determinant;
+		auto t = (_w_e2[0] * q_x + _w_e2[1] * q_y + _w_e2[2] * q_z) * inverse_determinant;
+
+		is_through[i] = (u >= 0) & (u <= 1) & (v >= 0) & (u + v <= 1) & (t > 0) & (t < 1);
+	}
 
-	if((c_v1_v2 * c_v2_v3) >= 0 && (c_v2_v3 * c_v3_v1) >= 0 && (c_v3_v1 * c_v1_v2) >= 0)
+	unsigned int through_mask = 0;
+	for (size_t i = 0; i < RAY_PACKET_SIZE; i++)
 	{
-		Vector conjunction_4d = 
-		{
-			conjunction[0], conjunction[1], conjunction[2], 1
-		};
-		output_distance = conjunction_4d - location;
-		return true;
+		through_mask |= (unsigned int)is_through[i] << i;
 	}
-
-	return false;
-
+	return through_mask & mask;
 }
 
 
 
 
-void Triangle3D::WriteToPixel(size_t x, size_t y, FrameBuffer& frame_buffer, double nearest_dist, Object* cuda_objects) const
+void Triangle3D$::SetupRecord::WriteToPixel(size_t x, size_t y, VisibilitySample& sample, double nearest_dist) const
 {
 	using namespace __Triangle3D;
 	// pruning
-	if(x < Min(_s_v1_x, _s_v2_x, _s_v3_x) || x > Max(_s_v1_x, _s_v2_x, _s_v3_x)) return;
-	if(y < Min(_s_v1_y, _s_v2_y, _s_v3_y) || y > Max(_s_v1_y, _s_v2_y, _s_v3_y)) return;
+	if(x < Min(s_x[0], s_x[1], s_x[2]) || x > Max(s_x[0], s_x[1], s_x[2])) return;
+	if(y < Min(s_y[0], s_y[1], s_y[2]) || y > Max(s_y[0], s_y[1], s_y[2])) return;
 	if(!IsScreenCover((double)x, (double)y)) return;
 
-	// get world location
-	Vector screen_areal_coordinates(3);
-	ScreenArealCoordinates((double)x, (double)y, screen_areal_coordinates);
+	WriteToSample(
+		q_dx[0] * x + q_dy[0] * y + q_0[0],
+		q_dx[1] * x + q_dy[1] * y + q_0[1],
+		q_dx[2] * x + q_dy[2] * y + q_0[2],
+		sample, nearest_dist);
+}
 
-	double world_z = PerspectiveUndo(screen_areal_coordinates, _w_v1_z, _w_v2_z, _w_v3_z);
+void Triangle3D$::SetupRecord::WriteToSamples(VisibilitySample* samples, size_t x_begin, size_t y_begin, size_t x_end, size_t y_end, double nearest_dist) const
+{
+	using namespace __Triangle3D;
+	// clip the screen bounding rectangle
+	double min_x = Maths::Max(ceil(Min(s_x[0], s_x[1], s_x[2])), (double)x_begin);
+	double max_x = Maths::Min(floor(Max(s_x[0], s_x[1], s_x[2])), (double)x_end - 1);
+	double min_y = Maths::Max(ceil(Min(s_y[0], s_y[1], s_y[2])), (double)y_begin);
+	double max_y = Maths::Min(floor(Max(s_y[0], s_y[1], s_y[2])), (double)y_end - 1);
+	if (min_x > max_x || min_y > max_y) return;
+
+	// steps of edge functions along x, the same determinants as IsScreenCover
+	double v1_v2_dx = -(s_y[1] - s_y[0]);
+	double v2_v3_dx = -(s_y[2] - s_y[1]);
+	double v3_v1_dx = -(s_y[0] - s_y[2]);
+
+	// a triangle without area covers no pixel
+	if (Determinant(s_x[1] - s_x[0], s_x[2] - s_x[1], s_y[1] - s_y[0], s_y[2] - s_y[1]) == 0) return;
+
+	for (auto y = (size_t)min_y; y <= (size_t)max_y; y++)
+	{
+		// evaluate exactly at the start of every row, then step along x
+		double v1_v2 = Determinant(s_x[1] - s_x[0], min_x - s_x[0], s_y[1] - s_y[0], y - s_y[0]);
+		double v2_v3 = Determinant(s_x[2] - s_x[1], min_x - s_x[1], s_y[2] - s_y[1], y - s_y[1]);
+		double v3_v1 = Determinant(s_x[0] - s_x[2], min_x - s_x[2], s_y[0] - s_y[2], y - s_y[2]);
+
+		double q1 = q_dx[0] * min_x + q_dy[0] * y + q_0[0];
+		double q2 = q_dx[1] * min_x + q_dy[1] * y + q_0[1];
+		double q3 = q_dx[2] * min_x + q_dy[2] * y + q_0[2];
+
+		for (auto x = (size_t)min_x; x <= (size_t)max_x; x++, v1_v2 += v1_v2_dx, v2_v3 += v2_v3_dx, v3_v1 += v3_v1_dx, q1 += q_dx[0], q2 += q_dx[1], q3 += q_dx[2])
+		{
+			if (!((v1_v2 >= 0 && v2_v3 >= 0 && v3_v1 >= 0) || (v1_v2 <= 0 && v2_v3 <= 0 && v3_v1 <= 0))) continue;
+
+			WriteToSample(q1, q2, q3, samples[(y - y_begin) * (x_end - x_begin) + (x - x_begin)], nearest_dist);
+		}
+	}
+}
+
+bool Triangle3D$::SetupRecord::WriteToSample(double q1, double q2, double q3, VisibilitySample& sample, double nearest_dist) const
+{
+	double world_z = 1 / (q1 + q2 + q3);
 
 	// z-buffer
-	if(world_z < frame_buffer.location[2] || world_z > nearest_dist) return;
+	if(world_z < sample.depth || world_z > nearest_dist) return false;
 
+	sample.depth = world_z;
+	sample.triangle_index = index;
+	return true;
+}
 
-	double world_x = PerspectiveCorrect(screen_areal_coordinates, _w_v1_x, _w_v2_x, _w_v3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
-	double world_y = PerspectiveCorrect(screen_areal_coordinates, _w_v1_y, _w_v2_y, _w_v3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
+void Triangle3D$::AttributeRecord::Resolve(SetupRecord const& setup, size_t x, size_t y, FrameBuffer& frame_buffer, Object const* objects) const
+{
+	using namespace __Triangle3D;
+	auto& s = setup;
+	double q1 = s.q_dx[0] * x + s.q_dy[0] * y + s.q_0[0];
+	double q2 = s.q_dx[1] * x + s.q_dy[1] * y + s.q_0[1];
+	double q3 = s.q_dx[2] * x + s.q_dy[2] * y + s.q_0[2];
+	double world_z = 1 / (q1 + q2 + q3);
 
 	// *****************************************
 	// 透视矫正
 	// *****************************************
-	double img_u = PerspectiveCorrect(screen_areal_coordinates, _vt1_x, _vt2_x, _vt3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
-	double img_v = PerspectiveCorrect(screen_areal_coordinates, _vt1_y, _vt2_y, _vt3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z);
-	
-	// write to buffers
-	frame_buffer.triangle_index = _index;
-	frame_buffer.location = 
+	double img_u = PerspectiveCorrect(q1, q2, q3, vt_u[0], vt_u[1], vt_u[2], world_z);
+	double img_v = PerspectiveCorrect(q1, q2, q3, vt_v[0], vt_v[1], vt_v[2], world_z);
+
+	// the encoding only keeps the direction, so the normal needs no unitization
+	frame_buffer.normal = FrameBuffer$::EncodeNormal(
+		PerspectiveCorrect(q1, q2, q3, vn_x[0], vn_x[1], vn_x[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, vn_y[0], vn_y[1], vn_y[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, vn_z[0], vn_z[1], vn_z[2], world_z));
+
+	// uv footprint of the pixel selects the mip level
+	double du_dx = PerspectiveDerivative(s.q_dx[0], s.q_dx[1], s.q_dx[2], vt_u[0], vt_u[1], vt_u[2], img_u, world_z);
+	double dv_dx = PerspectiveDerivative(s.q_dx[0], s.q_dx[1], s.q_dx[2], vt_v[0], vt_v[1], vt_v[2], img_v, world_z);
+	double du_dy = PerspectiveDerivative(s.q_dy[0], s.q_dy[1], s.q_dy[2], vt_u[0], vt_u[1], vt_u[2], img_u, world_z);
+	double dv_dy = PerspectiveDerivative(s.q_dy[0], s.q_dy[1], s.q_dy[2], vt_v[0], vt_v[1], vt_v[2], img_v, world_z);
+	frame_buffer.color = FrameBuffer$::ALPHA_OPAQUE | objects[object_index].GetTexture().Sample(img_u, img_v, du_dx, dv_dx, du_dy, dv_dy);
+}
+
+void Triangle3D$::AttributeRecord::Locate(SetupRecord const& setup, size_t x, size_t y, SurfacePoint& point) const
+{
+	using namespace __Triangle3D;
+	auto& s = setup;
+	double q1 = s.q_dx[0] * x + s.q_dy[0] * y + s.q_0[0];
+	double q2 = s.q_dx[1] * x + s.q_dy[1] * y + s.q_0[1];
+	double q3 = s.q_dx[2] * x + s.q_dy[2] * y + s.q_0[2];
+	double world_z = 1 / (q1 + q2 + q3);
+
+	point.triangle_index = s.index;
+	point.location = 
 	{
-		world_x,
-		world_y,
+		PerspectiveCorrect(q1, q2, q3, w_x[0], w_x[1], w_x[2], world_z),
+		PerspectiveCorrect(q1, q2, q3, w_y[0], w_y[1], w_y[2], world_z),
 		world_z,
 		1
 	};
-
-	frame_buffer.vertex_normal = 
-	{
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_x, _vn2_x, _vn3_x, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_y, _vn2_y, _vn3_y, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		PerspectiveCorrect(screen_areal_coordinates, _vn1_z, _vn2_z, _vn3_z, _w_v1_z, _w_v2_z, _w_v3_z, world_z),
-		0
-	};
-	
-	frame_buffer.vertex_normal.Unitization();
-
-	frame_buffer.color = _p_objects->at(_object_index).GetImage().Get(img_u, img_v).rgb;
-
-}
-
-
-void Triangle3D::ScreenArealCoordinates(double x, double y, Maths::Vector& result) const
-{
-	using namespace __Triangle3D::ArealCoordinates;
-	result = {x, y, ScreenZ(x, y)};
-	
-	// (v1, v2, v3, 0) (alpha, beta, gamma, 1)^T = target
-	
-	_areal_coordinates_calculate_matrix * result;
-
 }
 
 Vector Triangle3D::MinWorldBounding() const
@@ -401,14 +367,14 @@ Vector Triangle3D::MaxWorldBounding() const
 	return {Max(_w_v1_x, _w_v2_x, _w_v3_x), Max(_w_v1_y, _w_v2_y, _w_v3_y), Max(_w_v1_z, _w_v2_z, _w_v3_z), 1};
 }
 
-Vector Triangle3D::MinScreenBounding() const
+Vector Triangle3D$::SetupRecord::MinScreenBounding() const
 {
 	using namespace __Triangle3D;
-	return { Min(_s_v1_x, _s_v2_x, _s_v3_x), Min(_s_v1_y, _s_v2_y, _s_v3_y), Min(_s_v1_z, _s_v2_z, _s_v3_z), 1 };
+	return { Min(s_x[0], s_x[1], s_x[2]), Min(s_y[0], s_y[1], s_y[2]), 0, 1 };
 }
 
-Vector Triangle3D::MaxScreenBounding() const
+Vector Triangle3D$::SetupRecord::MaxScreenBounding() const
 {
 	using namespace __Triangle3D;
-	return { Max(_s_v1_x, _s_v2_x, _s_v3_x), Max(_s_v1_y, _s_v2_y, _s_v3_y), Max(_s_v1_z, _s_v2_z, _s_v3_z), 1 };
-}
\ No newline at end of file
+	return { Max(s_x[0], s_x[1], s_x[2]), Max(s_y[0], s_y[1], s_y[2]), 0, 1 };
+}
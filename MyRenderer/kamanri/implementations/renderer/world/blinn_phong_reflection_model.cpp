@@ -2,6 +2,7 @@
 #include "kamanri/utils/string.hpp"
 #include "cuda_dll/exports/memory_operations.hpp"
 #include "kamanri/renderer/world/__/bounding_box.hpp"
+#include "kamanri/maths/vec.hpp"
 using namespace Kamanri::Renderer::World;
 using namespace Kamanri::Utils;
 using namespace Kamanri::Maths;
@@ -31,14 +32,16 @@ namespace Kamanri
 					import_func(TransmitFromCUDA, cuda_dll, transmit_from_cuda, LOG_NAME);
 				}
 
-				inline size_t Scan_R270(size_t height, size_t x, size_t y)
+				/// @brief Squared distance from the point to the box, 0 inside it
+				inline double SquaredDistance(double const* point, double const* min, double const* max)
 				{
-					return ((height - (y + 1)) * height + x);
-				}
-
-				inline size_t LightBufferLoc(size_t width, size_t height, size_t index, size_t x, size_t y)
-				{
-					return (width * height * index + Scan_R270(height, x, y));
+					double squared_distance = 0;
+					for (size_t i = 0; i < 3; i++)
+					{
+						auto d = point[i] < min[i] ? min[i] - point[i] : (point[i] > max[i] ? point[i] - max[i] : 0);
+						squared_distance += d * d;
+					}
+					return squared_distance;
 				}
 
 				inline double SpecularTransition(double min_theta,  double theta)
@@ -71,7 +74,6 @@ BlinnPhongReflectionModel::BlinnPhongReflectionModel(std::vector<BlinnPhongRefle
 	_ambient_factor = ambient_factor;
 	_screen_width = screen_width;
 	_screen_height = screen_height;
-    _lights_buffer = NewArray<PointLightBufferItem>(_point_lights.size() * screen_width * screen_height);
 	_is_use_cuda = is_use_cuda;
 
 
@@ -106,7 +108,7 @@ BlinnPhongReflectionModel::BlinnPhongReflectionModel(BlinnPhongReflectionModel&&
     _specular_min_cos = other._specular_min_cos;
 	_diffuse_factor = other._diffuse_factor;
 	_ambient_factor = other._ambient_factor;
-	_lights_buffer = std::move(other._lights_buffer);
+	_shadow_maps = std::move(other._shadow_maps);
 
 	_cuda_lights_buffer = other._cuda_lights_buffer;
 	_cuda_point_lights = other._cuda_point_lights;
@@ -122,7 +124,7 @@ BlinnPhongReflectionModel& BlinnPhongReflectionModel::operator=(BlinnPhongReflec
     _specular_min_cos = other._specular_min_cos;
 	_diffuse_factor = other._diffuse_factor;
 	_ambient_factor = other._ambient_factor;
-	_lights_buffer = CopyArray(other._lights_buffer.get(), _screen_width * _screen_height);
+	_shadow_maps = other._shadow_maps;
 
 	_cuda_lights_buffer = other._cuda_lights_buffer;
 	_cuda_point_lights = other._cuda_point_lights;
@@ -139,7 +141,7 @@ BlinnPhongReflectionModel& BlinnPhongReflectionModel::operator=(BlinnPhongReflec
     _specular_min_cos = other._specular_min_cos;
 	_diffuse_factor = other._diffuse_factor;
 	_ambient_factor = other._ambient_factor;
-	_lights_buffer = std::move(other._lights_buffer);
+	_shadow_maps = std::move(other._shadow_maps);
 
 	_cuda_lights_buffer = other._cuda_lights_buffer;
 	_cuda_point_lights = other._cuda_point_lights;
@@ -160,153 +162,229 @@ void BlinnPhongReflectionModel::ModelViewTransform(Maths::SMatrix const& matrix)
 	__BlinnPhongReflectionModel::transmit_to_cuda(&_point_lights[0], _cuda_point_lights.data, _point_lights.size() * sizeof(PointLight));
 }
 
-void BlinnPhongReflectionModel::InitLightBufferPixel(size_t x, size_t y, FrameBuffer& buffer)
+void BlinnPhongReflectionModel::SetFactors(double specular_min_cos, double diffuse_factor, double ambient_factor)
+{
+	_specular_min_cos = specular_min_cos;
+	_diffuse_factor = diffuse_factor;
+	_ambient_factor = ambient_factor;
+}
+
+void BlinnPhongReflectionModel::SetShadowMapResolution(size_t resolution)
+{
+	_shadow_maps.clear();
+	if (resolution == 0) return;
+	if (_is_use_cuda)
+	{
+		Log::Warn(__BlinnPhongReflectionModel::LOG_NAME, "Shadow maps are not supported by CUDA, use ray queries instead");
+		return;
+	}
+	for (size_t i = 0; i < _point_lights.size(); i++)
+	{
+		_shadow_maps.emplace_back(resolution);
+	}
+}
+
+void BlinnPhongReflectionModel::BuildShadowMapFace(size_t face_index, std::vector<__::Triangle3D> const& triangles)
+{
+	auto light_index = face_index / __::ShadowMap$::FACE_COUNT;
+	_shadow_maps[light_index].BuildFace(face_index % __::ShadowMap$::FACE_COUNT, _point_lights[light_index].location_model_view_transformed, triangles);
+}
+
+void BlinnPhongReflectionModel::CullLights(double const* min, double const* max, TileLights& tile_lights) const
 {
 	using namespace __BlinnPhongReflectionModel;
-	for(size_t i = 0; i < _point_lights.size(); i++)
+	tile_lights.light_indexes.clear();
+	for (size_t i = 0; i < _point_lights.size(); i++)
 	{
-		auto& this_item = _lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
-		this_item.distance = DBL_MAX;
-		this_item.is_exposed = true;
-		this_item.is_specular = false;
+		auto& light = _point_lights[i];
+		double light_location[3] = { light.location_model_view_transformed[0], light.location_model_view_transformed[1], light.location_model_view_transformed[2] };
+		if (SquaredDistance(light_location, min, max) > light.radius * light.radius) continue;
+		tile_lights.light_indexes.push_back(i);
+	}
+	tile_lights.items.resize(tile_lights.light_indexes.size() * SHADING_BATCH_SIZE);
+}
+
+void BlinnPhongReflectionModel::InitLightBufferPixel(TileLights& tile_lights, size_t k)
+{
+	for (size_t slot = 0; slot < tile_lights.light_indexes.size(); slot++)
+	{
+		tile_lights.Item(slot, k) = PointLightBufferItem();
 	}
-	
 }
 
-void BlinnPhongReflectionModel::__BuildPerTriangleLightPixel(size_t x, size_t y, __::Triangle3D& triangle, size_t point_light_index, FrameBuffer& buffer)
+void BlinnPhongReflectionModel::__BuildSpecularLightPixel(PointLightBufferItem& light_buffer_item, size_t point_light_index, SurfacePoint const& point)
 {
 	using namespace __BlinnPhongReflectionModel;
-	auto& light_buffer_item = _lights_buffer[LightBufferLoc(_screen_width, _screen_height, point_light_index, x, y)];
-	auto& light_location = _point_lights[point_light_index].location_model_view_transformed;
-	auto light_point_distance = light_location - buffer.location;
-	if (triangle.Index() == buffer.triangle_index)
+	Vec4 light_location_vec(_point_lights[point_light_index].location_model_view_transformed);
+	Vec4 location(point.location);
+	auto light_point_distance = Distance(light_location_vec, location);
+	if (light_point_distance < light_buffer_item.distance) light_buffer_item.distance = light_point_distance;
+
+	// judge whether is specular
+	// camera is at (0, 0, 0, 1)
+	auto point_camera_add_point_light_vector = light_location_vec;
+	point_camera_add_point_light_vector += Vec4(0, 0, 0, 1);
+	point_camera_add_point_light_vector -= location;
+	point_camera_add_point_light_vector -= location;
+
+	point_camera_add_point_light_vector.Unitization();
+	auto cos_theta = Dot(point_camera_add_point_light_vector, Vec4(point.vertex_normal));
+	if (cos_theta >= _specular_min_cos)
 	{
-		if (light_point_distance < light_buffer_item.distance) light_buffer_item.distance = light_point_distance;
-
-		// judge whether is specular
-		// camera is at (0, 0, 0, 1)
-		auto point_camera_add_point_light_vector = light_location;
-		point_camera_add_point_light_vector += { 0, 0, 0, 1 };
-		point_camera_add_point_light_vector -= buffer.location;
-		point_camera_add_point_light_vector -= buffer.location;
-
-		point_camera_add_point_light_vector.Unitization();
-		auto cos_theta = point_camera_add_point_light_vector * buffer.vertex_normal;
-		if (cos_theta >= _specular_min_cos)
-		{
-			light_buffer_item.is_specular = true;
-			light_buffer_item.specular_factor = SpecularTransition(_specular_min_cos, cos_theta);
-		}
+		light_buffer_item.is_specular = true;
+		light_buffer_item.specular_factor = SpecularTransition(_specular_min_cos, cos_theta);
 	}
-	else
+}
+
+void BlinnPhongReflectionModel::__BuildShadowPixels(size_t count, SurfacePoint* points, Utils::List<__::Triangle3D> triangles, __::BoundingBox* boxes, TileLights& tile_lights, size_t* occluder_cache, __::BoundingBox$::Statistics* statistics)
+{
+	using namespace __BlinnPhongReflectionModel;
+	using namespace __::Triangle3D$;
+	for (size_t slot = 0; slot < tile_lights.light_indexes.size(); slot++)
 	{
-		auto light_point_direction = buffer.location;
-		light_point_direction -= light_location;
+		auto i = tile_lights.light_indexes[slot];
+		auto& light = _point_lights[i];
+		auto& light_location = light.location_model_view_transformed;
+		for (size_t k = 0; k < count; k++)
+		{
+			__BuildSpecularLightPixel(tile_lights.Item(slot, k), i, points[k]);
+		}
 
-		double light_triangle_distance;
-		if (triangle.IsThrough(light_location, light_point_direction, light_triangle_distance))
+		// lanes beyond count, out of the radius or behind the surface are left out of the mask
+		RayPacket packet;
+		size_t skip_triangle_indexes[RAY_PACKET_SIZE];
+		for (size_t begin = 0; begin < count; begin += RAY_PACKET_SIZE)
 		{
-			if (light_triangle_distance < light_point_distance)
+			unsigned int mask = 0;
+			for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
 			{
-				light_buffer_item.distance = light_triangle_distance;
-				light_buffer_item.is_exposed = false;
+				auto& point = points[begin + lane < count ? begin + lane : begin];
+				packet.location_x[lane] = light_location[0];
+				packet.location_y[lane] = light_location[1];
+				packet.location_z[lane] = light_location[2];
+				packet.direction_x[lane] = point.location[0] - light_location[0];
+				packet.direction_y[lane] = point.location[1] - light_location[1];
+				packet.direction_z[lane] = point.location[2] - light_location[2];
+				skip_triangle_indexes[lane] = point.triangle_index;
+
+				auto squared_distance = packet.direction_x[lane] * packet.direction_x[lane] + packet.direction_y[lane] * packet.direction_y[lane] + packet.direction_z[lane] * packet.direction_z[lane];
+				auto facing = -(packet.direction_x[lane] * point.vertex_normal[0] + packet.direction_y[lane] * point.vertex_normal[1] + packet.direction_z[lane] * point.vertex_normal[2]);
+				if (begin + lane < count && squared_distance <= light.radius * light.radius && facing > 0) mask |= 1u << lane;
+			}
+			if (mask == 0) continue;
+
+			// neighbouring points are likely blocked by the same triangle, which is tested before the traversal
+			auto& occluder_index = occluder_cache[i];
+			unsigned int blocked_mask = 0;
+			if (occluder_index < triangles.size)
+			{
+				unsigned int cache_mask = mask;
+				for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+				{
+					if (skip_triangle_indexes[lane] == occluder_index) cache_mask &= ~(1u << lane);
+				}
+				blocked_mask = triangles.data[occluder_index].IsThrough(packet, cache_mask);
+				if (statistics != nullptr)
+				{
+					for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++) statistics->occluder_cache_hit_count += (blocked_mask >> lane) & 1;
+				}
+			}
+			if (blocked_mask != mask)
+				blocked_mask |= __::BoundingBox$::Occluded(boxes, 0, triangles, packet, mask & ~blocked_mask, skip_triangle_indexes, occluder_index, statistics);
+
+			for (size_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+			{
+				if (!((blocked_mask >> lane) & 1)) continue;
+				tile_lights.Item(slot, begin + lane).exposure = 0;
 			}
 		}
 	}
 }
 
-void BlinnPhongReflectionModel::__BuildPerTrianglePixel(size_t x, size_t y, __::Triangle3D& triangle, FrameBuffer& buffer)
+
+void BlinnPhongReflectionModel::__LookupShadowPixel(TileLights& tile_lights, size_t k, SurfacePoint& point)
 {
-	for (size_t i = 0; i < _point_lights.size(); i++)
+	using namespace __BlinnPhongReflectionModel;
+	Vec4 location(point.location);
+	Vec4 vertex_normal(point.vertex_normal);
+	for (size_t slot = 0; slot < tile_lights.light_indexes.size(); slot++)
 	{
-		__BuildPerTriangleLightPixel(x, y, triangle, i, buffer);
+		auto i = tile_lights.light_indexes[slot];
+		auto& light_location = _point_lights[i].location_model_view_transformed;
+		auto& light_buffer_item = tile_lights.Item(slot, k);
+		Vec4 light_location_vec(light_location);
+		auto direction = light_location_vec - location;
+		direction.Unitization();
+		auto cos_theta = Dot(vertex_normal, direction);
+		// not lit anyway
+		if (cos_theta <= 0) continue;
+
+		light_buffer_item.exposure = _shadow_maps[i].Exposure(light_location, point.location, point.triangle_index, cos_theta);
+		if (light_buffer_item.exposure == 0) continue;
+
+		__BuildSpecularLightPixel(light_buffer_item, i, point);
 	}
 }
 
-void BlinnPhongReflectionModel::__BuildShadowPixel(size_t x, size_t y, Utils::List<__::Triangle3D> triangles, __::BoundingBox* boxes, FrameBuffer& buffer)
+void BlinnPhongReflectionModel::WriteToPixels(size_t count, SurfacePoint const* points, DWORD* const* pixels, TileLights const& tile_lights)
 {
-	// Utils::ArrayStack<size_t> triangle_index_stack;
 	using namespace __BlinnPhongReflectionModel;
-	for (size_t i = 0; i < _point_lights.size(); i++)
+	constexpr size_t B = SHADING_BATCH_SIZE;
+	if (count > B) count = B;
+
+	double location_x[B], location_y[B], location_z[B];
+	double normal_x[B], normal_y[B], normal_z[B];
+	double powers[B];
+	unsigned int specular_colors[B], diffuse_colors[B];
+
+	for (size_t k = 0; k < count; k++)
 	{
-		auto& light_location = _point_lights[i].location_model_view_transformed;
-		auto& light_buffer_item = _lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
-		auto light_point_direction = buffer.location;
-		light_point_direction -= light_location;
-		__::BoundingBox$::MayThrough(
-			boxes, 
-			0, 
-			triangles, 
-			light_location, 
-			light_point_direction, 
-			light_buffer_item, 
-			[](BlinnPhongReflectionModel& bpr_model, 
-			size_t x, 
-			size_t y, 
-			__::Triangle3D& triangle, 
-			size_t point_light_index, 
-			FrameBuffer& buffer){
-				bpr_model.__BuildPerTriangleLightPixel(x, y, triangle, point_light_index, buffer);
-			}, *this, x, y, i, buffer);
-		
+		auto& point = points[k];
+		location_x[k] = point.location[0];
+		location_y[k] = point.location[1];
+		location_z[k] = point.location[2];
+		normal_x[k] = point.vertex_normal[0];
+		normal_y[k] = point.vertex_normal[1];
+		normal_z[k] = point.vertex_normal[2];
+		specular_colors[k] = diffuse_colors[k] = 0;
 	}
-	
-}
 
+	for (size_t slot = 0; slot < tile_lights.light_indexes.size(); slot++)
+	{
+		auto& light = _point_lights[tile_lights.light_indexes[slot]];
+		double light_x = light.location_model_view_transformed[0];
+		double light_y = light.location_model_view_transformed[1];
+		double light_z = light.location_model_view_transformed[2];
 
-/// @brief Require normal unitized.
-/// @param location 
-/// @param normal 
-/// @param reflect_point 
-void BlinnPhongReflectionModel::WriteToPixel(size_t x, size_t y, FrameBuffer& buffer, DWORD& pixel)
-{
-	using namespace __BlinnPhongReflectionModel;
-	
-    buffer.r = buffer.g = buffer.b = 0;
-	buffer.power = 0;
-	buffer.specular_color = buffer.diffuse_color = buffer.ambient_color = 0;
-    for(size_t i = 0; i < _point_lights.size(); i++)
-    {
-		// Do
-		auto& light_buffer_item = _lights_buffer[LightBufferLoc(_screen_width, _screen_height, i, x, y)];
-		auto distance = _point_lights[i].location_model_view_transformed - buffer.location;
-		auto direction = _point_lights[i].location_model_view_transformed;
-		direction -= buffer.location;
-		direction.Unitization();
+		// power = theta / S * cos(theta), 0 if the light is behind or out of its radius
+		for (size_t k = 0; k < count; k++)
+		{
+			double dx = light_x - location_x[k];
+			double dy = light_y - location_y[k];
+			double dz = light_z - location_z[k];
+			double distance = sqrt(dx * dx + dy * dy + dz * dz);
+			double cos_theta = (normal_x[k] * (dx / distance) + normal_y[k] * (dy / distance)) + normal_z[k] * (dz / distance);
+			double power = (light.power / (4 * Maths::PI * (distance * distance))) * cos_theta;
+			powers[k] = cos_theta > 0 && distance <= light.radius ? power : 0;
+		}
 
-		// power = theta / S * cos(theta)
-		auto cos_theta = (buffer.vertex_normal * direction);
-				
-		if (cos_theta <= 0) continue;
-		
-		auto power = (_point_lights[i].power / (4 * Maths::PI * pow(distance, 2))) * cos_theta;
-		buffer.power += power;
-
-		auto receive_light_color = RGBMul(_point_lights[i].color, power);
-        DivideRGB(
-			RGBReflect(receive_light_color, buffer.color), 
-			buffer.r, buffer.g, buffer.b, 
-			[](unsigned int& y, RGB x){ y += x; }
-		);
-		
-		buffer.specular_color += GenerizeReflection(buffer.r, buffer.g, buffer.b, power * light_buffer_item.specular_factor * light_buffer_item.is_specular * light_buffer_item.is_exposed);
-		buffer.diffuse_color += GenerizeReflection(buffer.r, buffer.g, buffer.b, power * _diffuse_factor * light_buffer_item.is_exposed);
-		
-		// if(light_buffer_item.is_exposed)
-		// {
-		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "buffer(%llu, %llu) diffuse color: %6.X", x, y, buffer.diffuse_color);
-		// }
-		// if(light_buffer_item.is_specular && light_buffer_item.is_exposed)
-		// {
-		// 	Log::Debug(__BlinnPhongReflectionModel::LOG_NAME, "buffer(%llu, %llu) specular color: %6.X", x, y, buffer.specular_color);
-		// }
-
-    }
-
-	buffer.ambient_color += RGBMul(buffer.color, _ambient_factor);
-
-	pixel = RGBAdd(buffer.ambient_color, buffer.diffuse_color, buffer.specular_color);
+		for (size_t k = 0; k < count; k++)
+		{
+			if (powers[k] <= 0) continue;
+			auto power = powers[k];
+			auto& light_buffer_item = tile_lights.Item(slot, k);
 
-}
+			// reflected color of this light only, as in WriteToPixel
+			unsigned int r = 0, g = 0, b = 0;
+			DivideRGB(RGBReflect(RGBMul(light.color, power), points[k].color), r, g, b, AddHandle);
 
+			specular_colors[k] += GenerizeReflection(r, g, b, power * light_buffer_item.specular_factor * light_buffer_item.is_specular * light_buffer_item.exposure);
+			diffuse_colors[k] += GenerizeReflection(r, g, b, power * _diffuse_factor * light_buffer_item.exposure);
+		}
+	}
 
+	for (size_t k = 0; k < count; k++)
+	{
+		*pixels[k] = RGBAdd(RGBMul(points[k].color, _ambient_factor), diffuse_colors[k], specular_colors[k]);
+	}
+}
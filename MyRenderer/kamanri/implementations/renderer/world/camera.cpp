@@ -4,7 +4,9 @@
 #include "kamanri/renderer/world/camera.hpp"
 #include "kamanri/utils/result.hpp"
 #include "kamanri/maths/smatrix.hpp"
+#include "kamanri/maths/vec.hpp"
 #include "kamanri/utils/string.hpp"
+#include "kamanri/utils/thread.hpp"
 
 using namespace Kamanri::Utils;
 using namespace Kamanri::Renderer::World;
@@ -32,23 +34,103 @@ namespace Kamanri
 				{
 					return x > 1 ? asin(1) : (x < -1 ? asin(-1) : asin(x));
 				}
-				
 
-				// Camera::Transform
 				namespace Transform
 				{
-					SMatrix model_view_transform(4);
-					SMatrix projection_screen_transform(4);
+					/// @brief Count of vertices which are transformed by one worker at a time, a multiple of the batch size 4
+					constexpr size_t VERTEX_CHUNK_SIZE = 4096;
+
+					/// @brief Load 4 vectors from index i into structure of arrays, the omitted homogeneous component is w
+					inline void Load(__::Resources$::VectorArray<3> const& vectors, size_t i, double w, Maths::Vec4* soa)
+					{
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							auto component = vectors.Component(axis) + i;
+							for (size_t lane = 0; lane < 4; lane++) soa[axis][lane] = component[lane];
+						}
+						for (size_t lane = 0; lane < 4; lane++) soa[3][lane] = w;
+					}
+
+					inline void Store(Maths::Vec4 const* soa, __::Resources$::VectorArray<3>& vectors, size_t i)
+					{
+						for (size_t axis = 0; axis < 3; axis++)
+						{
+							auto component = vectors.Component(axis) + i;
+							for (size_t lane = 0; lane < 4; lane++) component[lane] = soa[axis][lane];
+						}
+					}
+
+					/// @brief Transform vertices in [begin, end) by batches of 4
+					inline void TransformVertices(__::Resources& res, Maths::Mat4 const& model_view, Maths::Mat4 const& projection_screen, size_t begin, size_t end)
+					{
+						Maths::Vec4 vertices[4], model_view_vertices[4], screen_vertices[4];
+						size_t i = begin;
+						for (; i + 4 <= end; i += 4)
+						{
+							Load(res.vertices, i, 1, vertices);
+							Maths::MultiplySoA(model_view, vertices, model_view_vertices);
+							Maths::MultiplySoA(projection_screen, model_view_vertices, screen_vertices);
+							// homogeneous coordinates unitization
+							for (size_t lane = 0; lane < 4; lane++)
+							{
+								auto inverse_w = 1 / screen_vertices[3][lane];
+								for (size_t axis = 0; axis < 3; axis++) screen_vertices[axis][lane] *= inverse_w;
+							}
+							Store(model_view_vertices, res.vertices_model_view_transformed, i);
+							Store(screen_vertices, res.vertices_transformed, i);
+						}
+
+						for (; i < end; i++)
+						{
+							Maths::Vec4 vertex(res.vertices.Component(0)[i], res.vertices.Component(1)[i], res.vertices.Component(2)[i], 1);
+							auto model_view_vertex = model_view * vertex;
+							auto screen_vertex = projection_screen * model_view_vertex;
+							screen_vertex *= (1 / screen_vertex[3]); // homogeneous coordinates unitization
+							for (size_t axis = 0; axis < 3; axis++)
+							{
+								res.vertices_model_view_transformed.Component(axis)[i] = model_view_vertex[axis];
+								res.vertices_transformed.Component(axis)[i] = screen_vertex[axis];
+							}
+						}
+					}
+
+					/// @brief Transform vertex normals in [begin, end) by batches of 4
+					inline void TransformNormals(__::Resources& res, Maths::Mat4 const& model_view, size_t begin, size_t end)
+					{
+						Maths::Vec4 normals[4], model_view_normals[4];
+						size_t i = begin;
+						for (; i + 4 <= end; i += 4)
+						{
+							Load(res.vertex_normals, i, 0, normals);
+							Maths::MultiplySoA(model_view, normals, model_view_normals);
+							Store(model_view_normals, res.vertex_normals_model_view_transformed, i);
+						}
+
+						for (; i < end; i++)
+						{
+							Maths::Vec4 normal(res.vertex_normals.Component(0)[i], res.vertex_normals.Component(1)[i], res.vertex_normals.Component(2)[i], 0);
+							auto model_view_normal = model_view * normal;
+							for (size_t axis = 0; axis < 3; axis++) res.vertex_normals_model_view_transformed.Component(axis)[i] = model_view_normal[axis];
+						}
+					}
+
+					/// @brief Call func(begin, end) for every chunk, by the thread pool if not null
+					template <class F>
+					inline void ForChunks(Utils::Thread::ThreadPool* thread_pool, size_t count, F const& func)
+					{
+						auto chunk_count = (count + VERTEX_CHUNK_SIZE - 1) / VERTEX_CHUNK_SIZE;
+						auto chunk = [&](size_t c)
+						{
+							func(c * VERTEX_CHUNK_SIZE, std::min(count, (c + 1) * VERTEX_CHUNK_SIZE));
+						};
+						if (thread_pool == nullptr || chunk_count <= 1)
+						{
+							for (size_t c = 0; c < chunk_count; c++) chunk(c);
+							return;
+						}
+						thread_pool->ParallelFor(chunk_count, chunk);
+					}
 				} // namespace Transform
-				
-
-				// Camera::InverseUpperByDirection
-				namespace InverseUpperByDirection
-				{
-					Vector upward_before = {0, 1, 0, 0};
-					Vector upward_after = {0, 1, 0, 0};
-				} // namespace InverseUpperByDirection
-				
 
 			} // namespace __Camera
 			
@@ -140,7 +222,7 @@ void Camera::SetAngles()
 }
 
 Camera::Camera(Camera && camera) 
-: _p_resources(camera._p_resources), _p_bpr_model(camera._p_bpr_model), _alpha(camera._alpha), _beta(camera._beta), _gamma(camera._gamma), _nearest_dist(camera._nearest_dist), _furthest_dist(camera._furthest_dist), _screen_width(camera._screen_width), _screen_height(camera._screen_height)
+: _p_resources(camera._p_resources), _p_bpr_model(camera._p_bpr_model), _p_thread_pool(camera._p_thread_pool), _alpha(camera._alpha), _beta(camera._beta), _gamma(camera._gamma), _nearest_dist(camera._nearest_dist), _furthest_dist(camera._furthest_dist), _screen_width(camera._screen_width), _screen_height(camera._screen_height)
 {
 	_location = std::move(camera._location);
 	_direction = std::move(camera._direction);
@@ -151,6 +233,7 @@ Camera& Camera::operator=(Camera const& other)
 {
 	_p_resources = other._p_resources;
 	_p_bpr_model = other._p_bpr_model;
+	_p_thread_pool = other._p_thread_pool;
 	_alpha = other._alpha;
 	_beta = other._beta;
 	_gamma = other._gamma;
@@ -168,6 +251,7 @@ Camera& Camera::operator=(Camera&& other)
 {
 	_p_resources = other._p_resources;
 	_p_bpr_model = other._p_bpr_model;
+	_p_thread_pool = other._p_thread_pool;
 	_alpha = other._alpha;
 	_beta = other._beta;
 	_gamma = other._gamma;
@@ -181,10 +265,11 @@ Camera& Camera::operator=(Camera&& other)
 	return *this;
 }
 
-void Camera::__SetRefs(__::Resources& resources, BlinnPhongReflectionModel& bpr_model)
+void Camera::__SetRefs(__::Resources& resources, BlinnPhongReflectionModel& bpr_model, Thread::ThreadPool* thread_pool)
 {
 	_p_resources = &resources;
 	_p_bpr_model = &bpr_model;
+	_p_thread_pool = thread_pool;
 }
 
 
@@ -194,7 +279,7 @@ int Camera::Transform(bool is_bpr_model_transform)
 	CHECK_MEMORY_IS_ALLOCATED(_p_bpr_model, __Camera::LOG_NAME, Camera$::CODE_NULL_POINTER_PVERTICES);
 	SetAngles();
 
-	Log::Trace(__Camera::LOG_NAME, "vertices count: %d", _p_resources->vertices.size());
+	Log::Trace(__Camera::LOG_NAME, "vertices count: %d", _p_resources->vertices.Size());
 	//
 	auto sin_a = sin(_alpha);
 	auto cos_a = cos(_alpha);
@@ -239,9 +324,8 @@ int Camera::Transform(bool is_bpr_model_transform)
 	// };
 
 
-	using namespace __Camera::Transform;
-
-	model_view_transform = 
+	// locals, so that the transform is reentrant
+	SMatrix model_view_transform = 
 	{
 		cos_a*cos_g + sin_a_sin_b*sin_g, -cos_b*sin_g, sin_a*cos_g - cos_a_sin_b*sin_g, lx*(-cos_a*cos_g-sin_a_sin_b*sin_g) + ly*cos_b*sin_g + lz*(-sin_a*cos_g+cos_a_sin_b*sin_g),
 		cos_a*sin_g - sin_a_sin_b*cos_g, cos_b*cos_g, sin_a*sin_g + cos_a_sin_b*cos_g, lx*(-cos_a*sin_g+sin_a_sin_b*cos_g) - ly*cos_b*cos_g + lz*(-sin_a*sin_g-cos_a_sin_b*cos_g),
@@ -273,7 +357,7 @@ int Camera::Transform(bool is_bpr_model_transform)
 	//     0, 0, 0, 1
 	// };
 
-	projection_screen_transform = 
+	SMatrix projection_screen_transform = 
 	{
 		(double)_screen_width * _nearest_dist / 2, 0, (double)_screen_width / 2, 0,
 		0, -(double)_screen_height * _nearest_dist * cos_g / 2, (double)_screen_height / 2, 0,
@@ -290,38 +374,29 @@ int Camera::Transform(bool is_bpr_model_transform)
 	// };
 
 	// ensure the vertex normal num == vertex num
-	// if(_p_resources->vertex_normals.size() != _p_resources->vertices.size())
+	// if(_p_resources->vertex_normals.size() != _p_resources->vertices.Size())
 	// {
-	// 	Log::Error(__Camera::LOG_NAME, "Unequal normal num %llu and vertex num %llu", _p_resources->vertex_normals.size(), _p_resources->vertices.size());
+	// 	Log::Error(__Camera::LOG_NAME, "Unequal normal num %llu and vertex num %llu", _p_resources->vertex_normals.size(), _p_resources->vertices.Size());
 	// 	return DEFAULT_RESULT_EXCEPTION(Camera$::CODE_UNEQUAL_NUM, "Unequal normal num and vertex num");
 	// }
 	// copy vertices_transformed from vertices(origin) and transform it.
 	
 
-	// TODO: CUDA parallelize "Transform Vertices"
-	for(std::size_t i = 0; i != _p_resources->vertices.size(); i++)
+	using namespace __Camera::Transform;
+	Mat4 model_view(model_view_transform);
+	Mat4 projection_screen(projection_screen_transform);
+	auto& resources = *_p_resources;
+	ForChunks(_p_thread_pool, resources.vertices.Size(), [&](size_t begin, size_t end)
 	{
-		// IMPORTANT!!
-		_p_resources->vertices_transformed[i] = _p_resources->vertices[i]; 
-		_p_resources->vertices_model_view_transformed[i] = _p_resources->vertices[i];
-		//
-		
-		_p_resources->vertices_transformed[i].PrintVector(Log$::TRACE_LEVEL);
-		model_view_transform * _p_resources->vertices_transformed[i];
-		model_view_transform * _p_resources->vertices_model_view_transformed[i];
-		
-		_p_resources->vertices_transformed[i].PrintVector(Log$::TRACE_LEVEL);
-		projection_screen_transform * _p_resources->vertices_transformed[i];
-		_p_resources->vertices_transformed[i].PrintVector(Log$::TRACE_LEVEL);
-		_p_resources->vertices_transformed[i] *= (1 / (_p_resources->vertices_transformed[i][3])); // homogeneous coordinates unitization
-		_p_resources->vertices_transformed[i].PrintVector(Log$::TRACE_LEVEL);
-	}
-
-	for(std::size_t i = 0; i != _p_resources->vertex_normals.size(); i++)
+		TransformVertices(resources, model_view, projection_screen, begin, end);
+	});
+	ForChunks(_p_thread_pool, resources.vertex_normals.Size(), [&](size_t begin, size_t end)
 	{
-		_p_resources->vertex_normals_model_view_transformed[i] = _p_resources->vertex_normals[i];
-		model_view_transform * _p_resources->vertex_normals_model_view_transformed[i];
-	}
+		TransformNormals(resources, model_view, begin, end);
+	});
+
+	// triangles and bounding boxes are out of date
+	_p_resources->is_vertices_transformed_dirty = true;
 
 	if(is_bpr_model_transform) _p_bpr_model->ModelViewTransform(model_view_transform);
 	//
@@ -338,10 +413,8 @@ int Camera::InverseUpperByDirection(Maths::Vector const &last_direction)
 		return Camera$::CODE_INVALID_VECTOR_LENGTH;
 	}
 
-	using namespace __Camera::InverseUpperByDirection;
-
-	upward_before = _upward;
-	upward_after = _upward;
+	auto upward_before = _upward;
+	auto upward_after = _upward;
 
 	upward_before *= last_direction;
 	upward_after *= _direction;
@@ -1,6 +1,6 @@
 #include "kamanri/utils/string.hpp"
 #include "kamanri/renderer/world/object.hpp"
-#include "kamanri/renderer/world/__/triangle3d.hpp"
+#include "kamanri/renderer/world/__/resources.hpp"
 #include "kamanri/utils/result.hpp"
 #include "kamanri/maths/smatrix.hpp"
 
@@ -26,31 +26,32 @@ namespace Kamanri
 } // namespace Kamanri
 
 
-Object::Object(std::vector<Maths::Vector>& vertices, size_t v_offset, size_t v_length, size_t t_offset, size_t t_length, std::string tga_image_name, bool is_use_cuda): 
-_pvertices(&vertices), _v_offset(v_offset), _v_length(v_length), _t_offset(t_offset), _t_length(t_length)
+Object::Object(__::Resources& resources, size_t v_offset, size_t v_length, size_t t_offset, size_t t_length, std::string tga_image_name, bool is_use_cuda): 
+_p_resources(&resources), _v_offset(v_offset), _v_length(v_length), _t_offset(t_offset), _t_length(t_length)
 {
 	if(!_img.ReadTGAFile(tga_image_name, is_use_cuda))
 	{
 		Log::Error(__Object::LOG_NAME, "Cannot read the TGA image '%s'.", tga_image_name.c_str());
 		PRINT_LOCATION;
+		return;
 	}
-}
-
-void Object::__UpdateTriangleRef(std::vector<__::Triangle3D>& triangles, std::vector<Object>& objects, size_t index)
-{
-	for(size_t i = _t_offset; i < _t_offset + _t_length; i++)
-	{
-		auto& t = triangles[i];
-		t._p_objects = &objects;
-		t._index = index;
-	}
+	_texture.Build(_img, is_use_cuda);
 }
 
 DefaultResult Object::Transform(SMatrix const& transform_matrix) const
 {
+	auto x = _p_resources->vertices.Component(0);
+	auto y = _p_resources->vertices.Component(1);
+	auto z = _p_resources->vertices.Component(2);
 	for(size_t i = _v_offset; i < _v_offset + _v_length; i++)
 	{
-		transform_matrix * (*_pvertices)[i];
+		Vector vertex = {x[i], y[i], z[i], 1};
+		transform_matrix * vertex;
+		x[i] = vertex[0];
+		y[i] = vertex[1];
+		z[i] = vertex[2];
 	}
+	// the topology of bounding boxes is out of date
+	_p_resources->is_vertices_dirty = true;
 	return DEFAULT_RESULT;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "kamanri/renderer/world/world3d.hpp"
 #include "kamanri/renderer/world/__/bounding_box.hpp"
 #include "kamanri/renderer/world/frame_buffer.hpp"
@@ -29,8 +30,146 @@ namespace Kamanri
 				namespace Build
 				{
 					func_type(BuildWorld) build_world;
+
+					/// @brief The side length of the square tile which is built by one worker at a time
+					constexpr size_t TILE_LENGTH = 32;
+
+					/// @brief Count of triangles which are built by one worker at a time
+					constexpr size_t TRIANGLE_CHUNK_SIZE = 1024;
+
+					inline size_t TileCount(size_t length)
+					{
+						return (length + TILE_LENGTH - 1) / TILE_LENGTH;
+					}
 				} // namespace Build
 
+				namespace AddObjModel
+				{
+					/**
+					 * @brief Split polygons into triangles, the scratch buffers are reused by every polygon.
+					 * A convex polygon is split as a fan from its first corner, a concave one by ear clipping,
+					 * both on the plane of its Newell normal. The triangles keep the winding of the polygon.
+					 */
+					class Triangulator
+					{
+						public:
+						/// @brief Corner indexes (in the polygon) of the triangles of the last polygon, 3 per triangle
+						std::vector<size_t> triangles;
+
+						void Triangulate(ObjModel$::Vertex const* vertices, ObjModel$::FaceCorner const* corners, size_t count)
+						{
+							triangles.clear();
+							if (count < 3) return;
+							if (count == 3)
+							{
+								triangles.insert(triangles.end(), { 0, 1, 2 });
+								return;
+							}
+
+							// project the polygon to the coordinate plane which is the most parallel to it
+							double normal[3] = { 0, 0, 0 };
+							for (size_t i = 0; i < count; i++)
+							{
+								auto& a = vertices[corners[i].vertex_index - 1];
+								auto& b = vertices[corners[(i + 1) % count].vertex_index - 1];
+								normal[0] += (a.y - b.y) * (a.z + b.z);
+								normal[1] += (a.z - b.z) * (a.x + b.x);
+								normal[2] += (a.x - b.x) * (a.y + b.y);
+							}
+							size_t axis = 0;
+							if (fabs(normal[1]) > fabs(normal[axis])) axis = 1;
+							if (fabs(normal[2]) > fabs(normal[axis])) axis = 2;
+							_sign = normal[axis] < 0 ? -1 : 1;
+							_x.resize(count);
+							_y.resize(count);
+							for (size_t i = 0; i < count; i++)
+							{
+								auto& v = vertices[corners[i].vertex_index - 1];
+								_x[i] = axis == 0 ? v.y : (axis == 1 ? v.z : v.x);
+								_y[i] = axis == 0 ? v.z : (axis == 1 ? v.x : v.y);
+							}
+
+							bool is_convex = true;
+							for (size_t i = 0; i < count && is_convex; i++)
+							{
+								is_convex = Turn((i + count - 1) % count, i, (i + 1) % count) >= 0;
+							}
+							if (is_convex)
+							{
+								Fan(count);
+								return;
+							}
+
+							_polygon.resize(count);
+							for (size_t i = 0; i < count; i++) _polygon[i] = i;
+							while (_polygon.size() > 3)
+							{
+								if (!ClipEar())
+								{
+									// self-intersecting or degenerate, nothing better than a fan
+									Fan(_polygon.size(), true);
+									return;
+								}
+							}
+							triangles.insert(triangles.end(), { _polygon[0], _polygon[1], _polygon[2] });
+						}
+
+						private:
+						std::vector<double> _x;
+						std::vector<double> _y;
+						std::vector<size_t> _polygon;
+						double _sign;
+
+						/// @brief Positive if a -> b -> c turns as the polygon does, 0 if they are collinear
+						inline double Turn(size_t a, size_t b, size_t c) const
+						{
+							return ((_x[b] - _x[a]) * (_y[c] - _y[a]) - (_y[b] - _y[a]) * (_x[c] - _x[a])) * _sign;
+						}
+
+						/// @brief Split the first `count` corners of the polygon, or of the remaining polygon of ear clipping
+						inline void Fan(size_t count, bool is_remaining = false)
+						{
+							auto corner = [&](size_t i) { return is_remaining ? _polygon[i] : i; };
+							for (size_t i = 1; i + 1 < count; i++)
+							{
+								triangles.insert(triangles.end(), { corner(0), corner(i), corner(i + 1) });
+							}
+						}
+
+						bool ClipEar()
+						{
+							auto size = _polygon.size();
+							for (size_t i = 0; i < size; i++)
+							{
+								auto a = _polygon[(i + size - 1) % size], b = _polygon[i], c = _polygon[(i + 1) % size];
+								if (Turn(a, b, c) <= 0) continue;
+
+								bool is_ear = true;
+								for (auto p : _polygon)
+								{
+									if (p == a || p == b || p == c) continue;
+									if (Turn(a, b, p) >= 0 && Turn(b, c, p) >= 0 && Turn(c, a, p) >= 0)
+									{
+										is_ear = false;
+										break;
+									}
+								}
+								if (!is_ear) continue;
+
+								triangles.insert(triangles.end(), { a, b, c });
+								_polygon.erase(_polygon.begin() + i);
+								return true;
+							}
+							return false;
+						}
+					};
+
+					inline bool IsIndexInBound(int index, size_t size, bool is_optional)
+					{
+						return (is_optional && index == 0) || (index >= 1 && (size_t)index <= size);
+					}
+				} // namespace AddObjModel
+
 				void ImportFunctions()
 				{
 					load_dll(cuda_dll, cuda_dll, LOG_NAME);
@@ -52,7 +191,7 @@ namespace Kamanri
 
 
 
-World3D::World3D(Camera&& camera, BlinnPhongReflectionModel&& model, bool is_shadow_mapping, bool is_use_cuda)
+World3D::World3D(Camera&& camera, BlinnPhongReflectionModel&& model, bool is_shadow_mapping, bool is_use_cuda, unsigned int worker_count, bool is_triangle_rasterization, unsigned int shadow_map_resolution)
 : _camera(std::move(camera)), 
 _buffers(_camera.ScreenWidth(), _camera.ScreenHeight(), is_use_cuda),
 _environment(std::move(model))
@@ -67,11 +206,23 @@ _environment(std::move(model))
 		_environment.bpr_model.ScreenHeight());
 		exit(World3D$::CODE_UNHANDLED_EXCEPTION);
 	}
-	_camera.__SetRefs(_resources, _environment.bpr_model);
-
 	_configs.is_shadow_mapping = is_shadow_mapping;
+	_configs.worker_count = worker_count;
+	_configs.is_triangle_rasterization = is_triangle_rasterization;
+	_configs.shadow_map_resolution = is_shadow_mapping ? shadow_map_resolution : 0;
+	_environment.bpr_model.SetShadowMapResolution(_configs.shadow_map_resolution);
+
+	if(worker_count > 1)
+	{
+		_thread_pool = New<Thread::ThreadPool>(worker_count);
+	}
+	_camera.__SetRefs(_resources, _environment.bpr_model, _thread_pool.get());
 
 	if(!is_use_cuda) return;
+	if(is_triangle_rasterization)
+	{
+		Log::Warn(__World3D::LOG_NAME, "Triangle rasterization is not supported by CUDA, build per pixel instead");
+	}
 	_configs.is_use_cuda = is_use_cuda;
 	__World3D::ImportFunctions();
 
@@ -86,8 +237,10 @@ World3D& World3D::operator=(World3D const& other)
 	_buffers = other._buffers;
 	_configs = other._configs;
 	_cuda_world = other._cuda_world;
+	// The thread pool can not be shared, create an own one
+	_thread_pool = _configs.worker_count > 1 ? New<Thread::ThreadPool>(_configs.worker_count) : nullptr;
 	// Move the reference of vertices of camera
-	_camera.__SetRefs(_resources, _environment.bpr_model);
+	_camera.__SetRefs(_resources, _environment.bpr_model, _thread_pool.get());
 	return *this;
 }
 
@@ -99,94 +252,106 @@ World3D& World3D::operator=(World3D && other)
 	_buffers = std::move(other._buffers);
 	_configs = std::move(other._configs);
 	_cuda_world = other._cuda_world;
+	_thread_pool = std::move(other._thread_pool);
+	_tile_triangles = std::move(other._tile_triangles);
+	_tile_statistics = std::move(other._tile_statistics);
+	_tile_occluders = std::move(other._tile_occluders);
 	// Move the reference of vertices of camera
-	_camera.__SetRefs(_resources, _environment.bpr_model);
+	_camera.__SetRefs(_resources, _environment.bpr_model, _thread_pool.get());
 	return *this;
 }
 
 Result<Object *> World3D::AddObjModel(ObjModel const &model)
 {
-	auto v_offset = _resources.vertices.size();
-	auto vt_offset = _resources.vertex_textures.size();
-	auto vn_offset = _resources.vertex_normals.size();
-
-	/// transform to Vector from std::vector
+	auto v_offset = _resources.vertices.Size();
+	auto vt_offset = _resources.vertex_textures.Size();
+	auto vn_offset = _resources.vertex_normals.Size();
 
-	for(size_t i = 0; i < model.GetVertexSize(); i++)
+	// check the indexes before anything is added
+	auto all_corners = model.FaceCorners();
+	for (size_t i = 0; i < all_corners.size; i++)
 	{
-		auto vertex = *model.GetVertex(i);
-		Vector vector = {vertex[0], vertex[1], vertex[2], 1};
-		_resources.vertices.push_back(vector);
-		_resources.vertices_transformed.push_back(vector);
-		_resources.vertices_model_view_transformed.push_back(vector);
-		
+		auto const& c = all_corners.data[i];
+		if (!__World3D::AddObjModel::IsIndexInBound(c.vertex_index, model.GetVertexSize(), false) ||
+			!__World3D::AddObjModel::IsIndexInBound(c.vertex_texture_index, model.GetVertexTextureSize(), true) ||
+			!__World3D::AddObjModel::IsIndexInBound(c.vertex_normal_index, model.GetVertexNormalSize(), true))
+		{
+			auto message = "Face index out of bound";
+			Log::Error(__World3D::LOG_NAME, "%s: v %d, vt %d, vn %d", message, c.vertex_index, c.vertex_texture_index, c.vertex_normal_index);
+			PRINT_LOCATION;
+			return RESULT_EXCEPTION(Object *, World3D$::CODE_INDEX_OUT_OF_BOUND, message);
+		}
 	}
 
-	for(size_t i = 0; i < model.GetVertexNormalSize(); i++)
-	{
-		auto vertex = *model.GetVertexNormal(i);
-		Vector vector = {vertex[0], vertex[1], vertex[2], 0};
-		_resources.vertex_normals.push_back(vector);
-		_resources.vertex_normals_model_view_transformed.push_back(vector);
-	}
+	static_assert(sizeof(ObjModel$::Vertex) == 3 * sizeof(double) && sizeof(ObjModel$::VertexTexture) == 3 * sizeof(double), "ObjModel vertices should be packed doubles");
 
-	for(size_t i = 0; i < model.GetVertexTextureSize(); i++)
-	{
-		auto vertex = *model.GetVertexTexture(i);
-		Vector vector = {vertex[0], vertex[1], vertex.size() > 2 ? vertex[2] : 0};
-		_resources.vertex_textures.push_back(vector);
-	}
+	auto vertices = model.Vertices();
+	auto vertex_normals = model.VertexNormals();
+	auto vertex_textures = model.VertexTextures();
+
+	_resources.vertices.Append(reinterpret_cast<double const*>(vertices.data), vertices.size, 3);
+	_resources.vertices_transformed.Append(reinterpret_cast<double const*>(vertices.data), vertices.size, 3);
+	_resources.vertices_model_view_transformed.Append(reinterpret_cast<double const*>(vertices.data), vertices.size, 3);
+	_resources.vertex_normals.Append(reinterpret_cast<double const*>(vertex_normals.data), vertex_normals.size, 3);
+	_resources.vertex_normals_model_view_transformed.Append(reinterpret_cast<double const*>(vertex_normals.data), vertex_normals.size, 3);
+	_resources.vertex_textures.Append(reinterpret_cast<double const*>(vertex_textures.data), vertex_textures.size, 3);
 
 	auto t_offset = _environment.triangles.size();
+	auto face_size = model.GetFaceSize();
+	if (all_corners.size > face_size * 2)
+	{
+		_environment.triangles.reserve(t_offset + all_corners.size - face_size * 2);
+	}
 
-	for(size_t i = 0; i < model.GetFaceSize(); i++)
+	// Some object may not have vts or vns
+	auto add_triangle = [&](ObjModel$::FaceCorner const& c1, ObjModel$::FaceCorner const& c2, ObjModel$::FaceCorner const& c3)
 	{
-		auto face = *model.GetFace(i);
-		if(face.vertex_indexes.size() > 4)
+		auto vt = [&](ObjModel$::FaceCorner const& c) { return c.vertex_texture_index != 0 ? vt_offset + c.vertex_texture_index - 1 : __::Triangle3D$::INEXIST_INDEX; };
+		auto vn = [&](ObjModel$::FaceCorner const& c) { return c.vertex_normal_index != 0 ? vn_offset + c.vertex_normal_index - 1 : __::Triangle3D$::INEXIST_INDEX; };
+		_environment.triangles.push_back(__::Triangle3D(
+			_environment.objects.size(),
+			_environment.triangles.size(),
+			v_offset + c1.vertex_index - 1,
+			v_offset + c2.vertex_index - 1,
+			v_offset + c3.vertex_index - 1,
+			vt(c1), vt(c2), vt(c3),
+			vn(c1), vn(c2), vn(c3)));
+	};
+
+	__World3D::AddObjModel::Triangulator triangulator;
+	size_t degenerate_face_count = 0;
+	for(size_t i = 0; i < face_size; i++)
+	{
+		auto corners = model.FaceCorners(i);
+		if (corners.size < 3)
 		{
-			auto message = "Can not handle `face.vertex_indexes() > 4`";
-			Log::Error(__World3D::LOG_NAME, message);
-			PRINT_LOCATION;
-			return RESULT_EXCEPTION(Object *, World3D$::CODE_UNHANDLED_EXCEPTION, message);
+			degenerate_face_count++;
+			continue;
 		}
-		// Some object may not have vns
-		auto has_vn = face.vertex_normal_indexes.size() != 0;
-		if (face.vertex_indexes.size() == 4)
+		if (corners.size == 3)
 		{
-			auto splited_triangle = __::Triangle3D(
-				_environment.objects,
-				_environment.objects.size(),
-				_environment.triangles.size(),
-				v_offset + face.vertex_indexes[0] - 1,
-				v_offset + face.vertex_indexes[3] - 1,
-				v_offset + face.vertex_indexes[2] - 1,
-				vt_offset + face.vertex_texture_indexes[0] - 1,
-				vt_offset + face.vertex_texture_indexes[3] - 1,
-				vt_offset + face.vertex_texture_indexes[2] - 1,
-				has_vn ? vn_offset + face.vertex_normal_indexes[0] - 1 : __::Triangle3D$::INEXIST_INDEX,
-				has_vn ? vn_offset + face.vertex_normal_indexes[3] - 1 : __::Triangle3D$::INEXIST_INDEX,
-				has_vn ? vn_offset + face.vertex_normal_indexes[2] - 1 : __::Triangle3D$::INEXIST_INDEX);
-			this->_environment.triangles.push_back(splited_triangle);
+			add_triangle(corners.data[0], corners.data[1], corners.data[2]);
+			continue;
 		}
-		auto triangle = __::Triangle3D(
-			_environment.objects,
-			_environment.objects.size(),
-			_environment.triangles.size(),
-			v_offset + face.vertex_indexes[0] - 1,
-			v_offset + face.vertex_indexes[1] - 1,
-			v_offset + face.vertex_indexes[2] - 1,
-			vt_offset + face.vertex_texture_indexes[0] - 1,
-			vt_offset + face.vertex_texture_indexes[1] - 1,
-			vt_offset + face.vertex_texture_indexes[2] - 1,
-			has_vn ? vn_offset + face.vertex_normal_indexes[0] - 1 : __::Triangle3D$::INEXIST_INDEX,
-			has_vn ? vn_offset + face.vertex_normal_indexes[1] - 1 : __::Triangle3D$::INEXIST_INDEX,
-			has_vn ? vn_offset + face.vertex_normal_indexes[2] - 1 : __::Triangle3D$::INEXIST_INDEX);
+		triangulator.Triangulate(vertices.data, corners.data, corners.size);
+		auto& triangles = triangulator.triangles;
+		for (size_t j = 0; j < triangles.size(); j += 3)
+		{
+			add_triangle(corners.data[triangles[j]], corners.data[triangles[j + 1]], corners.data[triangles[j + 2]]);
+		}
+	}
 
-		_environment.triangles.push_back(triangle);
+	if (degenerate_face_count != 0)
+	{
+		Log::Warn(__World3D::LOG_NAME, "%llu faces with less than 3 corners are skipped", degenerate_face_count);
 	}
 
+	// the records are written by the next build of the triangles
+	_environment.setups.resize(_environment.triangles.size());
+	_environment.attributes.resize(_environment.triangles.size());
+
 	// Add an object
-	_environment.objects.push_back(Object(_resources.vertices, v_offset, model.GetVertexSize(), t_offset, model.GetFaceSize(), model.GetTGAImageName(), _configs.is_use_cuda));
+	_environment.objects.push_back(Object(_resources, v_offset, model.GetVertexSize(), t_offset, _environment.triangles.size() - t_offset, model.GetTGAImageName(), _configs.is_use_cuda));
 	// Now you can get the object& by _environment.objects.back()
 	auto& object = _environment.objects.back();
 
@@ -215,6 +380,8 @@ World3D::~World3D()
 
 	__World3D::cuda_free(_environment.cuda_objects.data);
 	__World3D::cuda_free(_environment.cuda_triangles.data);
+	__World3D::cuda_free(_environment.cuda_setups.data);
+	__World3D::cuda_free(_environment.cuda_attributes.data);
 	__World3D::cuda_free(_cuda_world);
 }
 
@@ -223,6 +390,13 @@ World3D& World3D::Commit()
 	if(_configs.is_commited) return *this;
 	_configs.is_commited = true;
 
+	Log::Debug(__World3D::LOG_NAME, "Vertex resources: %llu bytes, %llu bytes if stored as Maths::Vector",
+		_resources.Footprint(),
+		(_resources.vertices.Size() * 3 + _resources.vertex_normals.Size() * 2 + _resources.vertex_textures.Size()) * sizeof(Vector));
+
+	Log::Debug(__World3D::LOG_NAME, "Triangle: %llu bytes, setup record: %llu bytes, attribute record: %llu bytes",
+		sizeof(__::Triangle3D), sizeof(__::Triangle3D$::SetupRecord), sizeof(__::Triangle3D$::AttributeRecord));
+
 	// create bounding boxes buffer
 	_environment.boxes = NewArray<__::BoundingBox>(
 		__::BoundingBox$::BoxSize(
@@ -241,6 +415,10 @@ World3D& World3D::Commit()
 	auto triangles_size = _environment.triangles.size();
 	_environment.cuda_triangles.size = triangles_size;
 	__World3D::cuda_malloc(&(void*)_environment.cuda_triangles.data, triangles_size * sizeof(__::Triangle3D));
+	_environment.cuda_setups.size = triangles_size;
+	__World3D::cuda_malloc(&(void*)_environment.cuda_setups.data, triangles_size * sizeof(__::Triangle3D$::SetupRecord));
+	_environment.cuda_attributes.size = triangles_size;
+	__World3D::cuda_malloc(&(void*)_environment.cuda_attributes.data, triangles_size * sizeof(__::Triangle3D$::AttributeRecord));
 	// boxes
 	auto boxes_size = __::BoundingBox$::BoxSize(_environment.triangles.size());
 	_environment.cuda_boxes.size = boxes_size;
@@ -261,27 +439,78 @@ void World3D::Build()
 
 	_buffers.CleanBitmap();
 
-	for(auto& t: _environment.triangles)
+	// Triangles only change when the camera is transformed, objects transformed later are applied by the next camera transform.
+	auto is_triangles_dirty = _resources.is_vertices_transformed_dirty;
+	if (is_triangles_dirty)
+	{
+		if (!_thread_pool)
+		{
+			for (size_t i = 0; i < _environment.triangles.size(); i++)
+			{
+				_environment.triangles[i].Build(_resources, _environment.setups[i], _environment.attributes[i]);
+			}
+		}
+		else
+		{
+			_thread_pool->ParallelFor(_environment.triangles.size(), __World3D::Build::TRIANGLE_CHUNK_SIZE, [this](size_t i)
+			{
+				_environment.triangles[i].Build(_resources, _environment.setups[i], _environment.attributes[i]);
+			});
+		}
+
+		// build bounding box
+		if (_resources.is_vertices_dirty)
+		{
+			__::BoundingBox$::Build(_environment.boxes.get(), _environment.triangles, _environment.setups, _thread_pool.get());
+			_resources.is_vertices_dirty = false;
+		}
+		else
+		{
+			// only the camera moved, which moves all vertices rigidly, so the topology is still good
+			__::BoundingBox$::Refit(_environment.boxes.get(), _environment.triangles, _environment.setups, _thread_pool.get());
+		}
+		_resources.is_vertices_transformed_dirty = false;
+	}
+	else
 	{
-		t.Build(_resources);
+		Log::Debug(__World3D::LOG_NAME, "Nothing is transformed, reuse the triangles and bounding boxes");
 	}
 
-	// build bounding box
-	__::BoundingBox$::Build(_environment.boxes.get(), _environment.triangles);
+	// the lights are only transformed with the vertices by the camera, so the shadow maps are good as long as the triangles are
+	if (is_triangles_dirty && _configs.is_shadow_mapping && _environment.bpr_model.IsShadowMapped())
+	{
+		__BuildShadowMaps();
+	}
 
 	if (_configs.is_use_cuda)
 	{
-
-		__World3D::transmit_to_cuda(
-			&_environment.triangles[0], 
-			_environment.cuda_triangles.data, 
-			_environment.triangles.size() * sizeof(__::Triangle3D)
-		);
-		__World3D::transmit_to_cuda(
-			_environment.boxes.get(), 
-			_environment.cuda_boxes.data, 
-			__::BoundingBox$::BoxSize(_environment.triangles.size()) * sizeof(__::BoundingBox)
-		);
+		if (is_triangles_dirty)
+		{
+			// the triangles themselves are only read by the shadow rays
+			if (_configs.is_shadow_mapping)
+			{
+				__World3D::transmit_to_cuda(
+					&_environment.triangles[0], 
+					_environment.cuda_triangles.data, 
+					_environment.triangles.size() * sizeof(__::Triangle3D)
+				);
+			}
+			__World3D::transmit_to_cuda(
+				&_environment.setups[0], 
+				_environment.cuda_setups.data, 
+				_environment.setups.size() * sizeof(__::Triangle3D$::SetupRecord)
+			);
+			__World3D::transmit_to_cuda(
+				&_environment.attributes[0], 
+				_environment.cuda_attributes.data, 
+				_environment.attributes.size() * sizeof(__::Triangle3D$::AttributeRecord)
+			);
+			__World3D::transmit_to_cuda(
+				_environment.boxes.get(), 
+				_environment.cuda_boxes.data, 
+				__::BoundingBox$::BoxSize(_environment.triangles.size()) * sizeof(__::BoundingBox)
+			);
+		}
 		__World3D::transmit_to_cuda(this, _cuda_world, sizeof(World3D));
 
 		__World3D::Build::build_world(_cuda_world, _buffers.Width(), _buffers.Height());
@@ -293,59 +522,356 @@ void World3D::Build()
 		);
 	}
 
-	else
+	else if (!_thread_pool && !_configs.is_triangle_rasterization)
 	{
+		__::BoundingBox$::Statistics statistics;
 		for (size_t x = 0; x < _buffers.Width(); x++)
 		{
 			for (size_t y = 0; y < _buffers.Height(); y++)
 			{
-				__BuildForPixel(x, y);
+				__BuildForPixel(x, y, &statistics);
 			}
 		}
+		__LogStatistics(statistics);
+		Shade();
 	}
 
+	else
+	{
+		// every pixel is built independently, so tiles can be built in any order
+		using namespace __World3D::Build;
+		auto tile_count = TileCount(_buffers.Width()) * TileCount(_buffers.Height());
 
+		if (_configs.is_triangle_rasterization) __BinTriangles();
+		_tile_statistics.assign(tile_count, __::BoundingBox$::Statistics());
+
+		if (!_thread_pool)
+		{
+			for (size_t i = 0; i < tile_count; i++)
+			{
+				__BuildForTile(i);
+			}
+		}
+		else
+		{
+			_thread_pool->ParallelFor(tile_count, [this](size_t tile_index)
+			{
+				__BuildForTile(tile_index);
+			});
+		}
+
+		__::BoundingBox$::Statistics statistics;
+		for (auto& tile_statistics : _tile_statistics)
+		{
+			statistics += tile_statistics;
+		}
+		__LogStatistics(statistics);
+		Shade();
+	}
 
-	
 }
 
-void World3D::__BuildForPixel(size_t x, size_t y)
+void World3D::Shade()
 {
+	if (_configs.is_use_cuda)
+	{
+		Log::Warn(__World3D::LOG_NAME, "CUDA shades every pixel right after its visibility, build again instead");
+		Build();
+		return;
+	}
+
+	using namespace __World3D::Build;
+	auto tile_count = TileCount(_buffers.Width()) * TileCount(_buffers.Height());
+	_tile_statistics.assign(tile_count, __::BoundingBox$::Statistics());
+	_tile_occluders.assign(tile_count * _environment.bpr_model.PointLightCount(), __::Triangle3D$::INEXIST_INDEX);
+
+	if (!_thread_pool)
+	{
+		for (size_t i = 0; i < tile_count; i++)
+		{
+			__ShadeTile(i);
+		}
+	}
+	else
+	{
+		_thread_pool->ParallelFor(tile_count, [this](size_t tile_index)
+		{
+			__ShadeTile(tile_index);
+		});
+	}
+
+	__::BoundingBox$::Statistics statistics;
+	for (auto& tile_statistics : _tile_statistics)
+	{
+		statistics += tile_statistics;
+	}
+	__LogStatistics(statistics);
+}
+
+void World3D::__BuildForTile(size_t tile_index)
+{
+	using namespace __World3D::Build;
+	auto tile_count_x = TileCount(_buffers.Width());
+	auto x_begin = (tile_index % tile_count_x) * TILE_LENGTH;
+	auto y_begin = (tile_index / tile_count_x) * TILE_LENGTH;
+	auto x_end = std::min(x_begin + TILE_LENGTH, _buffers.Width());
+	auto y_end = std::min(y_begin + TILE_LENGTH, _buffers.Height());
+
+	auto& statistics = _tile_statistics[tile_index];
+
+	if (_configs.is_triangle_rasterization)
+	{
+		__RasterizeTile(x_begin, y_begin, x_end, y_end, tile_index, &statistics);
+		return;
+	}
+
+	for (size_t x = x_begin; x < x_end; x++)
+	{
+		for (size_t y = y_begin; y < y_end; y++)
+		{
+			__BuildForPixel(x, y, &statistics);
+		}
+	}
+}
+
+void World3D::__LogStatistics(__::BoundingBox$::Statistics const& statistics)
+{
+	Log::Debug(__World3D::LOG_NAME, "Screen queries: %llu, average leaves visited: %.2f; ray queries: %llu, average nodes visited: %.2f, average leaves visited: %.2f; occluder cache hits: %llu",
+		statistics.screen_query_count,
+		statistics.screen_query_count == 0 ? 0.0 : (double)statistics.screen_visited_leaf_count / statistics.screen_query_count,
+		statistics.ray_query_count,
+		statistics.ray_query_count == 0 ? 0.0 : (double)statistics.ray_visited_node_count / statistics.ray_query_count,
+		statistics.ray_query_count == 0 ? 0.0 : (double)statistics.ray_visited_leaf_count / statistics.ray_query_count,
+		statistics.occluder_cache_hit_count);
+}
+
+void World3D::__BinTriangles()
+{
+	using namespace __World3D::Build;
+	auto tile_count_x = TileCount(_buffers.Width());
+	auto tile_count_y = TileCount(_buffers.Height());
+	double max_x = (double)_buffers.Width() - 1;
+	double max_y = (double)_buffers.Height() - 1;
+
+	// keep the capacities between frames
+	_tile_triangles.resize(tile_count_x * tile_count_y);
+	for (auto& tile : _tile_triangles)
+	{
+		tile.clear();
+	}
+
+	for (size_t i = 0; i < _environment.setups.size(); i++)
+	{
+		auto& t = _environment.setups[i];
+		auto min_bounding = t.MinScreenBounding();
+		auto max_bounding = t.MaxScreenBounding();
+		// out of screen
+		if (max_bounding[0] < 0 || max_bounding[1] < 0 || min_bounding[0] > max_x || min_bounding[1] > max_y) continue;
+
+		auto tile_x_begin = (size_t)Maths::Max(min_bounding[0], 0.0) / TILE_LENGTH;
+		auto tile_y_begin = (size_t)Maths::Max(min_bounding[1], 0.0) / TILE_LENGTH;
+		auto tile_x_end = (size_t)Maths::Min(max_bounding[0], max_x) / TILE_LENGTH;
+		auto tile_y_end = (size_t)Maths::Min(max_bounding[1], max_y) / TILE_LENGTH;
+
+		// triangles are pushed in order, so the result is independent of the order of tiles
+		for (size_t tile_y = tile_y_begin; tile_y <= tile_y_end; tile_y++)
+		{
+			for (size_t tile_x = tile_x_begin; tile_x <= tile_x_end; tile_x++)
+			{
+				_tile_triangles[tile_y * tile_count_x + tile_x].push_back(i);
+			}
+		}
+	}
+}
+
+void World3D::__RasterizeTile(size_t x_begin, size_t y_begin, size_t x_end, size_t y_end, size_t tile_index, __::BoundingBox$::Statistics* statistics)
+{
+	using namespace __World3D::Build;
+	// the depths are tested in full precision inside the tile, only the results go to the frame buffers
+	VisibilitySample samples[TILE_LENGTH * TILE_LENGTH];
+	auto width = x_end - x_begin;
+	auto sample_count = width * (y_end - y_begin);
 	// set z = infinity
-	_buffers.InitPixel(x, y);
+	for (size_t i = 0; i < sample_count; i++)
+	{
+		samples[i].depth = -DBL_MAX;
+	}
 
-	auto& buffer = _buffers.GetFrame(x, y);
-	auto& bitmap_pixel = _buffers.GetBitmapBuffer(x, y);
+	// a tile is one screen query, its binned triangles are the leaves it visits
+	if (statistics != nullptr)
+	{
+		statistics->screen_query_count++;
+		statistics->screen_visited_leaf_count += _tile_triangles[tile_index].size();
+	}
 
-	Utils::List<__::Triangle3D> triangles;
-	triangles.data = &_environment.triangles[0];
-	triangles.size = _environment.triangles.size();
+	for (auto i : _tile_triangles[tile_index])
+	{
+		_environment.setups[i].WriteToSamples(samples, x_begin, y_begin, x_end, y_end, _camera.NearestDist());
+	}
+
+	// only the visible triangle of a pixel is resolved
+	for (size_t y = y_begin; y < y_end; y++)
+	{
+		for (size_t x = x_begin; x < x_end; x++)
+		{
+			auto& sample = samples[(y - y_begin) * width + (x - x_begin)];
+			auto& frame_buffer = _buffers.GetFrame(x, y);
+			if (sample.depth == -DBL_MAX)
+			{
+				frame_buffer.depth = FrameBuffer$::EMPTY_DEPTH;
+				continue;
+			}
+			frame_buffer.depth = (float)sample.depth;
+			frame_buffer.triangle_index = (std::uint32_t)sample.triangle_index;
+			_environment.attributes[sample.triangle_index].Resolve(_environment.setups[sample.triangle_index], x, y, frame_buffer, _environment.objects.data());
+		}
+	}
+}
+
+void World3D::__BuildForPixel(size_t x, size_t y, __::BoundingBox$::Statistics* statistics)
+{
+	// set z = infinity
+	VisibilitySample sample;
+	sample.depth = -DBL_MAX;
+
+	Utils::List<__::Triangle3D$::SetupRecord> setups;
+	setups.data = &_environment.setups[0];
+	setups.size = _environment.setups.size();
 
 	__::BoundingBox$::MayScreenCover(
 		_environment.boxes.get(),
-		0, triangles,
+		0, setups,
 		x, y,
 		[](
-			__::Triangle3D& triangle,
+			__::Triangle3D$::SetupRecord const& setup,
 			size_t x,
 			size_t y,
-			FrameBuffer& buffer,
-			double nearest_dist,
-			Object* cuda_objects)
+			VisibilitySample& sample,
+			double nearest_dist)
 		{
-			triangle.WriteToPixel(x, y, buffer, nearest_dist);
-		}, buffer, _camera.NearestDist());
+			setup.WriteToPixel(x, y, sample, nearest_dist);
+		}, sample, _camera.NearestDist(), statistics);
+
+	auto& frame_buffer = _buffers.GetFrame(x, y);
+	if (sample.depth == -DBL_MAX)
+	{
+		frame_buffer.depth = FrameBuffer$::EMPTY_DEPTH;
+		return;
+	}
+	frame_buffer.depth = (float)sample.depth;
+	frame_buffer.triangle_index = (std::uint32_t)sample.triangle_index;
+	_environment.attributes[sample.triangle_index].Resolve(_environment.setups[sample.triangle_index], x, y, frame_buffer, _environment.objects.data());
+}
 
-	if(_buffers.GetFrame(x, y).location[2] == -DBL_MAX) return;
+void World3D::__BuildShadowMaps()
+{
+	auto& bpr_model = _environment.bpr_model;
+	auto face_count = bpr_model.ShadowMapFaceCount();
+	Log::Debug(__World3D::LOG_NAME, "Build %llu faces of shadow maps", face_count);
+	if (!_thread_pool)
+	{
+		for (size_t i = 0; i < face_count; i++)
+		{
+			bpr_model.BuildShadowMapFace(i, _environment.triangles);
+		}
+		return;
+	}
 
-	// set distance = infinity, is exposed.
-	_environment.bpr_model.InitLightBufferPixel(x, y, buffer);
+	_thread_pool->ParallelFor(face_count, [this](size_t face_index)
+	{
+		_environment.bpr_model.BuildShadowMapFace(face_index, _environment.triangles);
+	});
+}
 
-	if(_configs.is_shadow_mapping)
-		_environment.bpr_model.__BuildShadowPixel(x, y, triangles, _environment.boxes.get(), buffer);
+void World3D::__ShadeTile(size_t tile_index)
+{
+	using namespace __World3D::Build;
+	using namespace BlinnPhongReflectionModel$;
+	auto tile_count_x = TileCount(_buffers.Width());
+	auto x_begin = (tile_index % tile_count_x) * TILE_LENGTH;
+	auto y_begin = (tile_index / tile_count_x) * TILE_LENGTH;
+	auto x_end = std::min(x_begin + TILE_LENGTH, _buffers.Width());
+	auto y_end = std::min(y_begin + TILE_LENGTH, _buffers.Height());
+
+	auto statistics = &_tile_statistics[tile_index];
+	auto& bpr_model = _environment.bpr_model;
+	auto occluders = _tile_occluders.data() + tile_index * bpr_model.PointLightCount();
 
-	_environment.bpr_model.WriteToPixel(x, y, buffer, bitmap_pixel);
-	
+	Utils::List<__::Triangle3D> triangles;
+	triangles.data = &_environment.triangles[0];
+	triangles.size = _environment.triangles.size();
+
+	// the covered pixels are located once, the lights are culled by the box of their points
+	double locations[TILE_LENGTH * TILE_LENGTH][3];
+	double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	SurfacePoint point;
+	for (size_t y = y_begin; y < y_end; y++)
+	{
+		for (size_t x = x_begin; x < x_end; x++)
+		{
+			auto& frame_buffer = _buffers.GetFrame(x, y);
+			if (frame_buffer.depth == FrameBuffer$::EMPTY_DEPTH) continue;
+			_environment.attributes[frame_buffer.triangle_index].Locate(_environment.setups[frame_buffer.triangle_index], x, y, point);
+			auto location = locations[(y - y_begin) * TILE_LENGTH + (x - x_begin)];
+			for (size_t i = 0; i < 3; i++)
+			{
+				location[i] = point.location[i];
+				min[i] = Maths::Min(min[i], location[i]);
+				max[i] = Maths::Max(max[i], location[i]);
+			}
+		}
+	}
+	TileLights tile_lights;
+	bpr_model.CullLights(min, max, tile_lights);
+
+	// covered pixels of a row are decoded one by one, then traced and lit as a batch
+	SurfacePoint points[SHADING_BATCH_SIZE];
+	DWORD* pixels[SHADING_BATCH_SIZE];
+	auto is_ray_shadowing = _configs.is_shadow_mapping && !bpr_model.IsShadowMapped();
+	auto shade_batch = [&](size_t count)
+	{
+		if (is_ray_shadowing)
+			bpr_model.__BuildShadowPixels(count, points, triangles, _environment.boxes.get(), tile_lights, occluders, statistics);
+		bpr_model.WriteToPixels(count, points, pixels, tile_lights);
+	};
+	for (size_t y = y_begin; y < y_end; y++)
+	{
+		size_t count = 0;
+		for (size_t x = x_begin; x < x_end; x++)
+		{
+			auto& bitmap_pixel = _buffers.GetBitmapBuffer(x, y);
+			auto& frame_buffer = _buffers.GetFrame(x, y);
+			if (frame_buffer.depth == FrameBuffer$::EMPTY_DEPTH)
+			{
+				bitmap_pixel = 0;
+				continue;
+			}
+
+			auto& point = points[count];
+			auto location = locations[(y - y_begin) * TILE_LENGTH + (x - x_begin)];
+			point.triangle_index = frame_buffer.triangle_index;
+			point.location = { location[0], location[1], location[2], 1 };
+			double normal_x, normal_y, normal_z;
+			FrameBuffer$::DecodeNormal(frame_buffer.normal, normal_x, normal_y, normal_z);
+			point.vertex_normal = { normal_x, normal_y, normal_z, 0 };
+			point.color = frame_buffer.color & ~FrameBuffer$::ALPHA_OPAQUE;
+
+			// set distance = infinity, is exposed.
+			bpr_model.InitLightBufferPixel(tile_lights, count);
+
+			if (_configs.is_shadow_mapping && !is_ray_shadowing)
+				bpr_model.__LookupShadowPixel(tile_lights, count, point);
+
+			pixels[count] = &bitmap_pixel;
+			if (++count == SHADING_BATCH_SIZE)
+			{
+				shade_batch(count);
+				count = 0;
+			}
+		}
+		if (count != 0) shade_batch(count);
+	}
 }
 
 FrameBuffer const& World3D::GetFrameBuffer(int x, int y)
@@ -0,0 +1,78 @@
+#include "kamanri/utils/mapped_file.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Kamanri::Utils;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const& file_name)
+{
+	auto file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return;
+	_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) return;
+	_size = (size_t)size.QuadPart;
+	if (_size == 0)
+	{
+		_is_open = true;
+		return;
+	}
+
+	_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr) return;
+	_data = (char const*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	_is_open = _data != nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data != nullptr) UnmapViewOfFile(_data);
+	if (_mapping != nullptr) CloseHandle(_mapping);
+	if (_file != nullptr) CloseHandle(_file);
+}
+
+#else
+
+MappedFile::MappedFile(std::string const& file_name)
+{
+	auto file = open(file_name.c_str(), O_RDONLY);
+	if (file < 0) return;
+
+	struct stat status;
+	if (fstat(file, &status) == 0)
+	{
+		_size = (size_t)status.st_size;
+		if (_size == 0)
+		{
+			_is_open = true;
+		}
+		else
+		{
+			auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data != MAP_FAILED)
+			{
+				madvise(data, _size, MADV_SEQUENTIAL);
+				_data = (char const*)data;
+				_is_open = true;
+			}
+		}
+	}
+	// the mapping is kept after the file is closed
+	close(file);
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data != nullptr) munmap((void*)_data, _size);
+}
+
+#endif
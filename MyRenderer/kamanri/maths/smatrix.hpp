@@ -109,11 +109,6 @@ namespace Kamanri
 			// SMatrixElemType _Get(size_t row, size_t col) const;
 
 			Vector _Get(size_t col) const;
-			// Calculate the determinant of matrix recursively
-			SMatrixElemType _Determinant(SMatrixElemType* psm, std::vector<std::size_t> &row_list, std::vector<std::size_t> &col_list) const;
-
-			// algebraic complement
-			SMatrixElemType _AComplement(SMatrixElemType* psm, std::vector<size_t>& row_list, std::vector<size_t>& col_list, size_t row, size_t col) const;
 		};
 
 	}
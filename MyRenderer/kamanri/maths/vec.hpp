@@ -0,0 +1,371 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include "vector.hpp"
+#include "smatrix.hpp"
+
+// SIMD kernels of Vec4 and Mat4, only for CPU
+#if !defined(__CUDA_ARCH__) && defined(__AVX__)
+#include <immintrin.h>
+#define KAMANRI_MATHS_AVX
+#elif !defined(__CUDA_ARCH__) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define KAMANRI_MATHS_SSE2
+#endif
+
+namespace Kamanri
+{
+	namespace Maths
+	{
+		/**
+		 * @brief Vector whose dimension is known at compile time.
+		 * Nothing is checked, use it on hot paths instead of Vector.
+		 */
+		template <size_t N>
+		class alignas(N == 4 ? 32 : alignof(double)) Vec
+		{
+			public:
+			double v[N];
+
+			Vec(): v() {}
+
+			template <class... Ts>
+			Vec(double v0, Ts... vs): v{ v0, (double)vs... } {}
+
+			explicit Vec(Vector const& vector)
+			{
+				for (size_t i = 0; i < N; i++) v[i] = vector[i];
+			}
+
+			inline Vector ToVector() const
+			{
+				Vector vector(N);
+				for (size_t i = 0; i < N; i++) vector.Set(i, v[i]);
+				return vector;
+			}
+
+			inline double& operator[](size_t n) { return v[n]; }
+			inline double operator[](size_t n) const { return v[n]; }
+
+			inline Vec& operator+=(Vec const& other)
+			{
+				for (size_t i = 0; i < N; i++) v[i] += other.v[i];
+				return *this;
+			}
+
+			inline Vec& operator-=(Vec const& other)
+			{
+				for (size_t i = 0; i < N; i++) v[i] -= other.v[i];
+				return *this;
+			}
+
+			inline Vec& operator*=(double value)
+			{
+				for (size_t i = 0; i < N; i++) v[i] *= value;
+				return *this;
+			}
+
+			inline Vec operator+(Vec const& other) const { Vec result = *this; return result += other; }
+			inline Vec operator-(Vec const& other) const { Vec result = *this; return result -= other; }
+			inline Vec operator*(double value) const { Vec result = *this; return result *= value; }
+
+			/// @brief Unitize it as Vector::Unitization does
+			inline Vec& Unitization();
+		};
+
+		using Vec3 = Vec<3>;
+		using Vec4 = Vec<4>;
+
+		template <>
+		inline Vec4& Vec4::operator+=(Vec4 const& other)
+		{
+#if defined(KAMANRI_MATHS_AVX)
+			_mm256_store_pd(v, _mm256_add_pd(_mm256_load_pd(v), _mm256_load_pd(other.v)));
+#elif defined(KAMANRI_MATHS_SSE2)
+			_mm_store_pd(v, _mm_add_pd(_mm_load_pd(v), _mm_load_pd(other.v)));
+			_mm_store_pd(v + 2, _mm_add_pd(_mm_load_pd(v + 2), _mm_load_pd(other.v + 2)));
+#else
+			for (size_t i = 0; i < 4; i++) v[i] += other.v[i];
+#endif
+			return *this;
+		}
+
+		template <>
+		inline Vec4& Vec4::operator-=(Vec4 const& other)
+		{
+#if defined(KAMANRI_MATHS_AVX)
+			_mm256_store_pd(v, _mm256_sub_pd(_mm256_load_pd(v), _mm256_load_pd(other.v)));
+#elif defined(KAMANRI_MATHS_SSE2)
+			_mm_store_pd(v, _mm_sub_pd(_mm_load_pd(v), _mm_load_pd(other.v)));
+			_mm_store_pd(v + 2, _mm_sub_pd(_mm_load_pd(v + 2), _mm_load_pd(other.v + 2)));
+#else
+			for (size_t i = 0; i < 4; i++) v[i] -= other.v[i];
+#endif
+			return *this;
+		}
+
+		template <>
+		inline Vec4& Vec4::operator*=(double value)
+		{
+#if defined(KAMANRI_MATHS_AVX)
+			_mm256_store_pd(v, _mm256_mul_pd(_mm256_load_pd(v), _mm256_set1_pd(value)));
+#elif defined(KAMANRI_MATHS_SSE2)
+			auto values = _mm_set1_pd(value);
+			_mm_store_pd(v, _mm_mul_pd(_mm_load_pd(v), values));
+			_mm_store_pd(v + 2, _mm_mul_pd(_mm_load_pd(v + 2), values));
+#else
+			for (size_t i = 0; i < 4; i++) v[i] *= value;
+#endif
+			return *this;
+		}
+
+		/// @brief Dot product
+		template <size_t N>
+		inline double Dot(Vec<N> const& v1, Vec<N> const& v2)
+		{
+			double result = 0;
+			for (size_t i = 0; i < N; i++) result += v1.v[i] * v2.v[i];
+			return result;
+		}
+
+		/// @brief Dot product, summed as (x + y) + (z + w) by every instruction set
+		inline double Dot(Vec4 const& v1, Vec4 const& v2)
+		{
+#if defined(KAMANRI_MATHS_AVX)
+			auto product = _mm256_mul_pd(_mm256_load_pd(v1.v), _mm256_load_pd(v2.v));
+			auto sum = _mm256_hadd_pd(product, product);
+			return _mm_cvtsd_f64(_mm_add_sd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1)));
+#elif defined(KAMANRI_MATHS_SSE2)
+			auto low = _mm_mul_pd(_mm_load_pd(v1.v), _mm_load_pd(v2.v));
+			auto high = _mm_mul_pd(_mm_load_pd(v1.v + 2), _mm_load_pd(v2.v + 2));
+			low = _mm_add_sd(low, _mm_unpackhi_pd(low, low));
+			high = _mm_add_sd(high, _mm_unpackhi_pd(high, high));
+			return _mm_cvtsd_f64(_mm_add_sd(low, high));
+#else
+			return (v1.v[0] * v2.v[0] + v1.v[1] * v2.v[1]) + (v1.v[2] * v2.v[2] + v1.v[3] * v2.v[3]);
+#endif
+		}
+
+		/// @brief Cross product of the first 3 dimensions, the 4th is multiplied as Vector does
+		template <size_t N>
+		inline Vec<N> Cross(Vec<N> const& v1, Vec<N> const& v2)
+		{
+			static_assert(N == 3 || N == 4, "Vec has not cross product when N != 3 or 4");
+			Vec<N> result;
+			result.v[0] = v1.v[1] * v2.v[2] - v1.v[2] * v2.v[1];
+			result.v[1] = v1.v[2] * v2.v[0] - v1.v[0] * v2.v[2];
+			result.v[2] = v1.v[0] * v2.v[1] - v1.v[1] * v2.v[0];
+			if (N == 4) result.v[N - 1] = v1.v[N - 1] * v2.v[N - 1];
+			return result;
+		}
+
+#if defined(KAMANRI_MATHS_AVX)
+		namespace __Vec
+		{
+			/// @brief (y, z, x, w) of the vector, in-lane permutes of it and of it with the halves swapped, which needs no AVX2
+			inline __m256d YZXW(__m256d v, __m256d swapped)
+			{
+				return _mm256_blend_pd(_mm256_permute_pd(v, 0b1001), _mm256_permute_pd(swapped, 0b0000), 0b0110);
+			}
+
+			/// @brief (z, x, y, w) of the vector, as YZXW
+			inline __m256d ZXYW(__m256d v, __m256d swapped)
+			{
+				return _mm256_blend_pd(_mm256_permute_pd(v, 0b1000), _mm256_permute_pd(swapped, 0b0100), 0b0101);
+			}
+		} // namespace __Vec
+#endif
+
+		/// @brief Cross product as yzx(v1) * zxy(v2) - zxy(v1) * yzx(v2), the 4th lane keeps the product w1 * w2
+		template <>
+		inline Vec4 Cross(Vec4 const& v1, Vec4 const& v2)
+		{
+			Vec4 result;
+#if defined(KAMANRI_MATHS_AVX)
+			auto a = _mm256_load_pd(v1.v);
+			auto b = _mm256_load_pd(v2.v);
+			auto a_swapped = _mm256_permute2f128_pd(a, a, 0x01);
+			auto b_swapped = _mm256_permute2f128_pd(b, b, 0x01);
+			auto product = _mm256_mul_pd(__Vec::YZXW(a, a_swapped), __Vec::ZXYW(b, b_swapped));
+			auto difference = _mm256_sub_pd(product, _mm256_mul_pd(__Vec::ZXYW(a, a_swapped), __Vec::YZXW(b, b_swapped)));
+			_mm256_store_pd(result.v, _mm256_blend_pd(difference, product, 0b1000));
+#elif defined(KAMANRI_MATHS_SSE2)
+			auto a_low = _mm_load_pd(v1.v), a_high = _mm_load_pd(v1.v + 2);
+			auto b_low = _mm_load_pd(v2.v), b_high = _mm_load_pd(v2.v + 2);
+			// (y, z | x, w) and (z, x | y, w)
+			auto a_yz = _mm_shuffle_pd(a_low, a_high, 0b01), a_xw = _mm_shuffle_pd(a_low, a_high, 0b10);
+			auto a_zx = _mm_shuffle_pd(a_high, a_low, 0b00), a_yw = _mm_shuffle_pd(a_low, a_high, 0b11);
+			auto b_yz = _mm_shuffle_pd(b_low, b_high, 0b01), b_xw = _mm_shuffle_pd(b_low, b_high, 0b10);
+			auto b_zx = _mm_shuffle_pd(b_high, b_low, 0b00), b_yw = _mm_shuffle_pd(b_low, b_high, 0b11);
+			_mm_store_pd(result.v, _mm_sub_pd(_mm_mul_pd(a_yz, b_zx), _mm_mul_pd(a_zx, b_yz)));
+			// the subtraction of the low lane only keeps w1 * w2 in the high lane
+			_mm_store_pd(result.v + 2, _mm_sub_sd(_mm_mul_pd(a_xw, b_yw), _mm_mul_pd(a_yw, b_xw)));
+#else
+			result.v[0] = v1.v[1] * v2.v[2] - v1.v[2] * v2.v[1];
+			result.v[1] = v1.v[2] * v2.v[0] - v1.v[0] * v2.v[2];
+			result.v[2] = v1.v[0] * v2.v[1] - v1.v[1] * v2.v[0];
+			result.v[3] = v1.v[3] * v2.v[3];
+#endif
+			return result;
+		}
+
+		/// @brief Distance between 2 uniformed locations
+		inline double Distance(Vec4 const& v1, Vec4 const& v2)
+		{
+			auto d = v1 - v2;
+			return sqrt(d.v[0] * d.v[0] + d.v[1] * d.v[1] + d.v[2] * d.v[2]);
+		}
+
+		template <size_t N>
+		inline Vec<N>& Vec<N>::Unitization()
+		{
+			double length_square = Dot(*this, *this);
+			// the length of vector is 1, need not to unitization.
+			if (length_square == 1) return *this;
+			auto length = sqrt(length_square);
+			for (size_t i = 0; i < N; i++) v[i] /= length;
+			return *this;
+		}
+
+		/// @brief The length is rooted and divided by on all lanes at once, which gives the same results as the scalar square root and division
+		template <>
+		inline Vec4& Vec4::Unitization()
+		{
+			double length_square = Dot(*this, *this);
+			// the length of vector is 1, need not to unitization.
+			if (length_square == 1) return *this;
+#if defined(KAMANRI_MATHS_AVX)
+			auto length = _mm256_sqrt_pd(_mm256_set1_pd(length_square));
+			_mm256_store_pd(v, _mm256_div_pd(_mm256_load_pd(v), length));
+#elif defined(KAMANRI_MATHS_SSE2)
+			auto length = _mm_sqrt_pd(_mm_set1_pd(length_square));
+			_mm_store_pd(v, _mm_div_pd(_mm_load_pd(v), length));
+			_mm_store_pd(v + 2, _mm_div_pd(_mm_load_pd(v + 2), length));
+#else
+			auto length = sqrt(length_square);
+			for (size_t i = 0; i < 4; i++) v[i] /= length;
+#endif
+			return *this;
+		}
+
+		/**
+		 * @brief N * N row-major square matrix whose size is known at compile time.
+		 * Nothing is checked, use it on hot paths instead of SMatrix.
+		 */
+		template <size_t N>
+		class alignas(N == 4 ? 32 : alignof(double)) Mat
+		{
+			public:
+			double m[N * N];
+
+			Mat(): m() {}
+
+			template <class... Ts>
+			Mat(double m0, Ts... ms): m{ m0, (double)ms... } {}
+
+			explicit Mat(SMatrix const& sm)
+			{
+				for (size_t i = 0; i < N * N; i++) m[i] = sm[i];
+			}
+
+			inline double& operator()(size_t row, size_t col) { return m[row * N + col]; }
+			inline double operator()(size_t row, size_t col) const { return m[row * N + col]; }
+
+			inline Vec<N> operator*(Vec<N> const& v) const
+			{
+				Vec<N> result;
+				for (size_t row = 0; row < N; row++)
+				{
+					double sum = 0;
+					for (size_t col = 0; col < N; col++) sum += m[row * N + col] * v.v[col];
+					result.v[row] = sum;
+				}
+				return result;
+			}
+
+			inline Mat operator*(Mat const& other) const
+			{
+				Mat result;
+				for (size_t row = 0; row < N; row++)
+				{
+					for (size_t col = 0; col < N; col++)
+					{
+						double sum = 0;
+						for (size_t i = 0; i < N; i++) sum += m[row * N + i] * other.m[i * N + col];
+						result.m[row * N + col] = sum;
+					}
+				}
+				return result;
+			}
+
+			inline Mat Transpose() const
+			{
+				Mat result;
+				for (size_t row = 0; row < N; row++)
+				{
+					for (size_t col = 0; col < N; col++) result.m[col * N + row] = m[row * N + col];
+				}
+				return result;
+			}
+		};
+
+		using Mat3 = Mat<3>;
+		using Mat4 = Mat<4>;
+
+		/// @brief Every row is summed as (x + y) + (z + w) by every instruction set
+		template <>
+		inline Vec4 Mat4::operator*(Vec4 const& v) const
+		{
+			Vec4 result;
+#if defined(KAMANRI_MATHS_AVX)
+			auto vv = _mm256_load_pd(v.v);
+			auto r0 = _mm256_mul_pd(_mm256_load_pd(m), vv);
+			auto r1 = _mm256_mul_pd(_mm256_load_pd(m + 4), vv);
+			auto r2 = _mm256_mul_pd(_mm256_load_pd(m + 8), vv);
+			auto r3 = _mm256_mul_pd(_mm256_load_pd(m + 12), vv);
+			// (r0.x + r0.y, r1.x + r1.y, r0.z + r0.w, r1.z + r1.w)
+			auto r01 = _mm256_hadd_pd(r0, r1);
+			auto r23 = _mm256_hadd_pd(r2, r3);
+			auto low = _mm256_permute2f128_pd(r01, r23, 0x20);
+			auto high = _mm256_permute2f128_pd(r01, r23, 0x31);
+			_mm256_store_pd(result.v, _mm256_add_pd(low, high));
+#elif defined(KAMANRI_MATHS_SSE2)
+			auto v_low = _mm_load_pd(v.v);
+			auto v_high = _mm_load_pd(v.v + 2);
+			for (size_t row = 0; row < 4; row += 2)
+			{
+				auto r0_low = _mm_mul_pd(_mm_load_pd(m + row * 4), v_low);
+				auto r0_high = _mm_mul_pd(_mm_load_pd(m + row * 4 + 2), v_high);
+				auto r1_low = _mm_mul_pd(_mm_load_pd(m + row * 4 + 4), v_low);
+				auto r1_high = _mm_mul_pd(_mm_load_pd(m + row * 4 + 6), v_high);
+				// (r0.x + r0.y, r1.x + r1.y) + (r0.z + r0.w, r1.z + r1.w)
+				auto low = _mm_add_pd(_mm_unpacklo_pd(r0_low, r1_low), _mm_unpackhi_pd(r0_low, r1_low));
+				auto high = _mm_add_pd(_mm_unpacklo_pd(r0_high, r1_high), _mm_unpackhi_pd(r0_high, r1_high));
+				_mm_store_pd(result.v + row, _mm_add_pd(low, high));
+			}
+#else
+			for (size_t row = 0; row < 4; row++)
+			{
+				auto r = m + row * 4;
+				result.v[row] = (r[0] * v.v[0] + r[1] * v.v[1]) + (r[2] * v.v[2] + r[3] * v.v[3]);
+			}
+#endif
+			return result;
+		}
+
+		/**
+		 * @brief Multiply the matrix by 4 vectors stored as structure of arrays, soa[i] holds the i-th components of all 4 vectors.
+		 * Every row is summed as (x + y) + (z + w) as Mat4 * Vec4 does, so the results are the same.
+		 */
+		inline void MultiplySoA(Mat4 const& m, Vec4 const* soa, Vec4* out_soa)
+		{
+			for (size_t row = 0; row < 4; row++)
+			{
+				auto r = m.m + row * 4;
+				out_soa[row] = (soa[0] * r[0] + soa[1] * r[1]) + (soa[2] * r[2] + soa[3] * r[3]);
+			}
+		}
+
+	} // namespace Maths
+
+} // namespace Kamanri
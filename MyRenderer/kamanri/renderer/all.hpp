@@ -1,4 +1,6 @@
 #pragma once
 #include "world/all.hpp"
 #include "obj_model.hpp"
-#include "tga_image.hpp"
\ No newline at end of file
+#include "tga_image.hpp"
+#include "asset_cache.hpp"
+#include "texture.hpp"
\ No newline at end of file
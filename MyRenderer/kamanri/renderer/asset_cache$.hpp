@@ -0,0 +1,50 @@
+#pragma once
+#ifndef SWIG
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		namespace AssetCache$
+		{
+			/// @brief "KRAC", the first 4 bytes of every cache file
+			constexpr std::uint32_t MAGIC = 0x4341524b;
+			/// @brief Increase it when the layout of any cached asset is changed, the old caches are rebuilt then
+			constexpr std::uint32_t VERSION = 3;
+
+			constexpr std::uint32_t TYPE_MESH = 1;
+			constexpr std::uint32_t TYPE_TEXTURE = 2;
+
+			constexpr size_t MAX_SECTION_COUNT = 8;
+			/// @brief Every section starts at a multiple of it, so a mapped section can be read as an array of any type
+			constexpr size_t SECTION_ALIGNMENT = 64;
+
+			/// @brief The header at the beginning of a cache file, the file is only read by the build writing it
+			struct Header
+			{
+				std::uint32_t magic;
+				std::uint32_t version;
+				std::uint32_t type;
+				std::uint32_t section_count;
+				/// @brief Size and last write time of the source file, the cache is stale if any of them is changed
+				std::uint64_t source_size;
+				std::int64_t source_time;
+				/// @brief Checksum of the sections in order, a cache mixed up by concurrent writers is rejected by it
+				std::uint64_t checksum;
+				std::uint64_t section_offsets[MAX_SECTION_COUNT];
+				std::uint64_t section_sizes[MAX_SECTION_COUNT];
+			};
+
+			struct Section
+			{
+				void const* data;
+				size_t size;
+			};
+		} // namespace AssetCache$
+		
+	} // namespace Renderer
+	
+} // namespace Kamanri
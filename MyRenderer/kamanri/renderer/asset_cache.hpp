@@ -0,0 +1,55 @@
+#pragma once
+#ifndef SWIG
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include "kamanri/renderer/asset_cache$.hpp"
+#include "kamanri/utils/mapped_file.hpp"
+#include "kamanri/utils/memory.hpp"
+#endif
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		/**
+		 * @brief Binary cache of a decoded asset, stored as sections of raw arrays and keyed by the size and last write time of the source file.
+		 * The cache file is mapped, so loading an asset from it is only copying the sections.
+		 */
+		class AssetCache
+		{
+			public:
+			static bool IsEnabled();
+			static void SetEnabled(bool is_enabled);
+			/// @brief The directory to store caches, caches are stored next to the source files if it is empty
+			static std::string const& Directory();
+			static void SetDirectory(std::string const& directory);
+			static std::string PathOf(std::string const& source_file_name);
+
+			/// @brief Map the cache of the source file, return nullptr if the cache is absent, stale or of another type
+			static Kamanri::Utils::P<AssetCache> Open(std::string const& source_file_name, std::uint32_t type);
+			/// @brief Write the sections as the cache of the source file
+			static bool Write(std::string const& source_file_name, std::uint32_t type, std::initializer_list<AssetCache$::Section> sections);
+
+			inline size_t SectionCount() const { return _header->section_count; }
+			inline size_t SectionSize(size_t index) const { return _header->section_sizes[index]; }
+			inline void const* SectionData(size_t index) const { return _file->Data() + _header->section_offsets[index]; }
+			/// @brief Copy the section to the vector, return false if the section is not an array of T
+			template <class T, class A>
+			bool CopySection(size_t index, std::vector<T, A>& to) const
+			{
+				if (index >= SectionCount() || SectionSize(index) % sizeof(T) != 0) return false;
+				to.resize(SectionSize(index) / sizeof(T));
+				if (!to.empty()) memcpy(to.data(), SectionData(index), SectionSize(index));
+				return true;
+			}
+
+			private:
+			explicit AssetCache(Kamanri::Utils::P<Kamanri::Utils::MappedFile> file);
+			Kamanri::Utils::P<Kamanri::Utils::MappedFile> _file;
+			AssetCache$::Header const* _header;
+		};
+	} // namespace Renderer
+	
+} // namespace Kamanri
@@ -2,6 +2,7 @@
 #ifndef SWIG
 #include <vector>
 #include "kamanri/utils/result.hpp"
+#include "kamanri/utils/list.hpp"
 #include "tga_image.hpp"
 #endif
 
@@ -16,6 +17,30 @@ namespace Kamanri
 			constexpr int CODE_READING_EXCEPTION = 200;
 			constexpr int CODE_INDEX_OUT_OF_BOUND = 300;
 
+			/// @brief x, y, z of a vertex or a vertex normal
+			struct Vertex
+			{
+				double x;
+				double y;
+				double z;
+			};
+
+			/// @brief u, v, w of a vertex texture, the missing w is 0
+			struct VertexTexture
+			{
+				double u;
+				double v;
+				double w;
+			};
+
+			/// @brief v, vt, vn indexes of a corner of a face, start from 1, 0 if absent
+			struct FaceCorner
+			{
+				int vertex_index;
+				int vertex_texture_index;
+				int vertex_normal_index;
+			};
+
 			class Face
 			{
 			public:
@@ -11,7 +11,11 @@ namespace Kamanri
 		class ObjModel
 		{
 		public:
-			explicit ObjModel(std::string const &file_name, std::string const& tga_file_name = "");
+			/**
+			 * @brief Load the .obj file, the file is mapped and its chunks are parsed by `worker_count` threads.
+			 * The vertices are welded if `is_welding`, see Weld.
+			 */
+			explicit ObjModel(std::string const &file_name, std::string const& tga_file_name = "", unsigned int worker_count = 1, bool is_welding = false);
 			size_t GetVertexSize() const;
 			size_t GetVertexNormalSize() const;
 			size_t GetVertexTextureSize() const;
@@ -21,20 +25,46 @@ namespace Kamanri
 			Kamanri::Utils::Result<std::vector<double>> GetVertexTexture(size_t index) const;
 			Kamanri::Utils::Result<Kamanri::Renderer::ObjModel$::Face> GetFace(size_t index) const;
 
+			/// Views of the flat storage, valid while the model is alive and nothing is copied.
+			inline Kamanri::Utils::List<Kamanri::Renderer::ObjModel$::Vertex const> Vertices() const { return { _vertices.data(), _vertices.size() }; }
+			inline Kamanri::Utils::List<Kamanri::Renderer::ObjModel$::Vertex const> VertexNormals() const { return { _vertex_normals.data(), _vertex_normals.size() }; }
+			inline Kamanri::Utils::List<Kamanri::Renderer::ObjModel$::VertexTexture const> VertexTextures() const { return { _vertex_textures.data(), _vertex_textures.size() }; }
+			/// @brief The corners of all faces in order
+			inline Kamanri::Utils::List<Kamanri::Renderer::ObjModel$::FaceCorner const> FaceCorners() const { return { _face_corners.data(), _face_corners.size() }; }
+			/// @brief The corners of the face, the index is not checked
+			inline Kamanri::Utils::List<Kamanri::Renderer::ObjModel$::FaceCorner const> FaceCorners(size_t index) const
+			{
+				return { _face_corners.data() + _face_offsets[index], _face_offsets[index + 1] - _face_offsets[index] };
+			}
+
+			/**
+			 * @brief Merge the corners of the same (v, vt, vn) into one vertex, so that the vertices, vertex textures
+			 * and vertex normals share a single index buffer, the absent vt or vn of a corner is still absent.
+			 * The corners are hashed by `worker_count` threads.
+			 */
+			void Weld(unsigned int worker_count = 1);
+
 			inline std::string GetTGAImageName() const { return _tga_image_name; }
 			
 
 		private:
-			std::vector<std::vector<double>> _vertices;
+			std::vector<Kamanri::Renderer::ObjModel$::Vertex> _vertices;
 			/// @brief 顶点法线，物理里面有说过眼睛看到物体是因为光线经过物体表面反射到眼睛，所以这个法线就是通过入射光线计算反射光线使用的法线。
-			std::vector<std::vector<double>> _vertex_normals;
+			std::vector<Kamanri::Renderer::ObjModel$::Vertex> _vertex_normals;
 			/// @brief 顶点纹理，代表当前顶点对应纹理图的哪个像素，通常是0-1，如果大于1，就相当于将纹理重新扩充然后取值，比如镜像填充、翻转填充之类的，然后根据纹理图的宽高去计算具体像素位置
-			std::vector<std::vector<double>> _vertex_textures;
-			std::vector<Kamanri::Renderer::ObjModel$::Face> _faces;
+			std::vector<Kamanri::Renderer::ObjModel$::VertexTexture> _vertex_textures;
+			/// @brief The corners of every face in order
+			std::vector<Kamanri::Renderer::ObjModel$::FaceCorner> _face_corners;
+			/// @brief The first corner of face i is _face_offsets[i], the face count + 1 offsets are stored
+			std::vector<size_t> _face_offsets = { 0 };
 
+			std::string _file_name;
 			std::string _tga_image_name;
 
-			Kamanri::Utils::DefaultResult ReadObjFileAndInit(std::string const &file_name);
+			Kamanri::Utils::DefaultResult ReadObjFileAndInit(std::string const &file_name, unsigned int worker_count);
+			/// @brief Load the flat storage from the asset cache of the file, return false if the cache is absent or stale
+			bool ReadCache(std::string const& file_name);
+			void WriteCache(std::string const& file_name) const;
 		};
 
 	}
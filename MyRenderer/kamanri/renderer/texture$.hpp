@@ -0,0 +1,145 @@
+#pragma once
+#ifndef SWIG
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#endif
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		namespace Texture$
+		{
+			/// @brief Enough for a 32768 * 32768 texture
+			constexpr size_t MAX_LEVEL_COUNT = 16;
+			/// @brief Texels of a level are stored as TILE_LENGTH * TILE_LENGTH tiles in row-major order, 
+			/// the texels in a tile are stored in Morton order so that the 2 * 2 texels of bilinear filtering are close
+			constexpr int TILE_BITS = 3;
+			constexpr int TILE_LENGTH = 1 << TILE_BITS;
+			constexpr size_t TILE_TEXEL_COUNT = TILE_LENGTH * TILE_LENGTH;
+
+			/// @brief A level of the mip chain, its texels start from `offset` of the texel array
+			struct Level
+			{
+				int width;
+				int height;
+				int tile_count_x;
+				size_t offset;
+			};
+
+			/// @brief 0b abc -> 0b 0a0b0c
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline unsigned int SpreadTileBits(unsigned int bits)
+			{
+				bits = (bits | (bits << 2)) & 0x33;
+				return (bits | (bits << 1)) & 0x55;
+			}
+
+			/// @brief Index of the texel (x, y) of the level in the texel array
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline size_t TexelIndex(Level const& level, int x, int y)
+			{
+				auto tile = (size_t)(y >> TILE_BITS) * level.tile_count_x + (x >> TILE_BITS);
+				auto morton = SpreadTileBits(x & (TILE_LENGTH - 1)) | (SpreadTileBits(y & (TILE_LENGTH - 1)) << 1);
+				return level.offset + tile * TILE_TEXEL_COUNT + morton;
+			}
+
+			/// @brief The texel (x, y) of the level, packed as 0x00RRGGBB
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline std::uint32_t Fetch(std::uint32_t const* texels, Level const& level, int x, int y)
+			{
+				return texels[TexelIndex(level, x, y)];
+			}
+
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline int Wrap(int i, int size)
+			{
+				i %= size;
+				return i < 0 ? i + size : i;
+			}
+
+			/// @brief Bilinear filtering of the level, the texture repeats out of [0, 1], v is towards up
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline void SampleBilinear(std::uint32_t const* texels, Level const& level, double u, double v, double* rgb)
+			{
+				u -= floor(u);
+				v -= floor(v);
+				double s = u * level.width - 0.5;
+				double t = (1 - v) * level.height - 0.5;
+				double s_floor = floor(s);
+				double t_floor = floor(t);
+				double fs = s - s_floor;
+				double ft = t - t_floor;
+				int x0 = Wrap((int)s_floor, level.width);
+				int y0 = Wrap((int)t_floor, level.height);
+				int x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+				int y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+				std::uint32_t c00 = Fetch(texels, level, x0, y0);
+				std::uint32_t c10 = Fetch(texels, level, x1, y0);
+				std::uint32_t c01 = Fetch(texels, level, x0, y1);
+				std::uint32_t c11 = Fetch(texels, level, x1, y1);
+				for (int i = 0; i < 3; i++)
+				{
+					auto shift = 16 - i * 8;
+					double top = ((c00 >> shift) & 0xff) * (1 - fs) + ((c10 >> shift) & 0xff) * fs;
+					double bottom = ((c01 >> shift) & 0xff) * (1 - fs) + ((c11 >> shift) & 0xff) * fs;
+					rgb[i] = top * (1 - ft) + bottom * ft;
+				}
+			}
+
+			/**
+			 * @brief Sample the mip chain with the screen space derivatives of uv.
+			 * A magnified texture is filtered bilinearly on level 0, a minified one trilinearly between the 2 nearest levels.
+			 * @return Color packed as 0x00RRGGBB
+			 */
+#ifdef __CUDA_RUNTIME_H__  
+			__host__ __device__
+#endif
+			inline unsigned int Sample(std::uint32_t const* texels, Level const* levels, size_t level_count, 
+				double u, double v, double du_dx, double dv_dx, double du_dy, double dv_dy)
+			{
+				if (level_count == 0) return 0;
+
+				// the length of the pixel footprint in texels of level 0
+				double width = levels[0].width, height = levels[0].height;
+				double x_square = (du_dx * width) * (du_dx * width) + (dv_dx * height) * (dv_dx * height);
+				double y_square = (du_dy * width) * (du_dy * width) + (dv_dy * height) * (dv_dy * height);
+				double lod = 0.5 * log2(x_square > y_square ? x_square : y_square);
+
+				double rgb[3];
+				if (!(lod > 0))
+				{
+					SampleBilinear(texels, levels[0], u, v, rgb);
+				}
+				else if (lod >= (double)(level_count - 1))
+				{
+					SampleBilinear(texels, levels[level_count - 1], u, v, rgb);
+				}
+				else
+				{
+					auto level = (size_t)lod;
+					double f = lod - level;
+					double rgb_next[3];
+					SampleBilinear(texels, levels[level], u, v, rgb);
+					SampleBilinear(texels, levels[level + 1], u, v, rgb_next);
+					for (int i = 0; i < 3; i++) rgb[i] = rgb[i] * (1 - f) + rgb_next[i] * f;
+				}
+				return ((unsigned int)(rgb[0] + 0.5) << 16) | ((unsigned int)(rgb[1] + 0.5) << 8) | (unsigned int)(rgb[2] + 0.5);
+			}
+		} // namespace Texture$
+		
+	} // namespace Renderer
+	
+} // namespace Kamanri
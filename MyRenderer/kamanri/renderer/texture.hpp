@@ -0,0 +1,40 @@
+#pragma once
+#ifndef SWIG
+#include <vector>
+#include "kamanri/renderer/texture$.hpp"
+#include "kamanri/renderer/tga_image.hpp"
+#endif
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		/**
+		 * @brief Mipmapped texture built from a TGAImage, every level is stored in tiles, see Texture$::TILE_LENGTH.
+		 * 
+		 */
+		class Texture
+		{
+			public:
+			Texture() = default;
+			/// @brief Build the mip chain of the image, the texels are transmitted to CUDA if is_use_cuda
+			void Build(Kamanri::Renderer::TGAImage const& image, bool is_use_cuda = false);
+			void DeleteCUDA();
+
+			/// @brief Sample with the screen space derivatives of uv, see Texture$::Sample
+#ifdef __CUDA_RUNTIME_H__  
+			__device__
+#endif
+			unsigned int Sample(double u, double v, double du_dx, double dv_dx, double du_dy, double dv_dy) const;
+
+			inline size_t LevelCount() const { return _level_count; }
+
+			private:
+			Kamanri::Renderer::Texture$::Level _levels[Kamanri::Renderer::Texture$::MAX_LEVEL_COUNT] = {};
+			size_t _level_count = 0;
+			std::vector<std::uint32_t> _texels;
+			std::uint32_t* _cuda_texels = nullptr;
+		};
+	} // namespace Renderer
+	
+} // namespace Kamanri
@@ -40,7 +40,11 @@ namespace Kamanri
 			int Height() const;
 
 			private:
-			bool LoadRLEData(std::ifstream& in);
+			bool DecodeTGAFile(const std::string& filename);
+			/// @brief Load the decoded image from the asset cache of the file, return false if the cache is absent or stale
+			bool ReadCache(const std::string& filename);
+			void WriteCache(const std::string& filename) const;
+			bool LoadRLEData(std::uint8_t const* data, size_t size);
 			bool UnloadRLEData(std::ofstream& out) const;
 
 			int _width = 0;
@@ -3,4 +3,5 @@
 #include "buffers.hpp"
 #include "configs.hpp"
 #include "environment.hpp"
+#include "shadow_map.hpp"
 #include "triangle3d.hpp"
\ No newline at end of file
@@ -8,6 +8,15 @@
 
 namespace Kamanri
 {
+	namespace Utils
+	{
+		namespace Thread
+		{
+			// declare a thread pool
+			class ThreadPool;
+		}
+	}
+
 	namespace Renderer
 	{
 		namespace World
@@ -24,74 +33,101 @@ namespace Kamanri
 					Maths::Vector screen_max;
 					size_t triangle_count = 0;
 					size_t triangle_index = 0;
+					/// @brief Index of the right child, the left child always follows its parent
+					size_t right_index = 0;
 				};
 
 				namespace __BoundingBox
 				{
 					void Merge(BoundingBox const& box1, BoundingBox const& box2, BoundingBox& out_box);
-#ifdef __CUDA_RUNTIME_H__  
-					__device__
-#endif
-						bool IsThrough(BoundingBox const& box, Maths::Vector const& location, Maths::Vector const& direction);
 				}
 
 				namespace BoundingBox$
 				{
-					inline size_t LeftNodeSize(size_t triangles_size)
+					/// @brief Statistics of queries, only collected by CPU
+					class Statistics
 					{
-						size_t left_node_size = 1;
-						while (left_node_size < triangles_size) left_node_size <<= 1;
+						public:
+						/// @brief Count of pixels queried by the tree, or of tiles rasterized by their binned triangles
+						size_t screen_query_count = 0;
+						size_t screen_visited_leaf_count = 0;
+						size_t ray_query_count = 0;
+						size_t ray_visited_leaf_count = 0;
+						/// @brief Count of boxes tested against the rays
+						size_t ray_visited_node_count = 0;
+						/// @brief Count of rays blocked by the cached occluder of their tile, which skip the traversal
+						size_t occluder_cache_hit_count = 0;
 
-						return left_node_size;
-					}
-
-					inline size_t LeftNodeIndex(size_t triangles_size)
-					{
-						return LeftNodeSize(triangles_size) - 1;
-					}
+						Statistics& operator+=(Statistics const& other)
+						{
+							screen_query_count += other.screen_query_count;
+							screen_visited_leaf_count += other.screen_visited_leaf_count;
+							ray_query_count += other.ray_query_count;
+							ray_visited_leaf_count += other.ray_visited_leaf_count;
+							ray_visited_node_count += other.ray_visited_node_count;
+							occluder_cache_hit_count += other.occluder_cache_hit_count;
+							return *this;
+						}
+					};
 
+					/// @brief Every leaf holds one triangle, so a full binary tree of n leaves has 2n - 1 boxes
 					inline size_t BoxSize(size_t triangles_size)
 					{
-						return LeftNodeSize(triangles_size) * 2 - 1;
+						return triangles_size == 0 ? 1 : triangles_size * 2 - 1;
 					}
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
 					inline size_t LeftChildIndex(size_t b_index)
 					{
-						return 2 * b_index + 1;
+						return b_index + 1;
 					}
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
-					inline size_t RightChildIndex(size_t b_index)
+					inline size_t RightChildIndex(BoundingBox const* boxes, size_t b_index)
 					{
-						return 2 * b_index + 2;
+						return boxes[b_index].right_index;
 					}
 
-					void Build(BoundingBox* boxes, std::vector<Triangle3D> const& triangles);
+					/// @brief Build the bounding volume hierarchy by binned surface area heuristic on world space,
+					/// nodes are stored in depth-first order. If thread_pool is given, the splits of the top levels are spread over the workers, then the subtrees under them are built in parallel.
+					void Build(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, Utils::Thread::ThreadPool* thread_pool = nullptr);
+					/// @brief Keep the topology built by Build, only update the bounds of leaves from the rebuilt triangles and merge them bottom-up.
+					/// Only valid when the triangles are not changed and the vertices are moved as a whole (e.g. by the camera).
+					void Refit(BoundingBox* boxes, std::vector<Triangle3D> const& triangles, std::vector<Triangle3D$::SetupRecord> const& setups, Utils::Thread::ThreadPool* thread_pool = nullptr);
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
-						void MayThrough(
-							BoundingBox* boxes,
-							size_t b_i,
-							Utils::List<Triangle3D> const& triangles,
-							Maths::Vector const& location,
-							Maths::Vector const& direction,
-							BlinnPhongReflectionModel$::PointLightBufferItem const& light_buffer_item,
-							void (*build_per_triangle_light_pixel)(
-								BlinnPhongReflectionModel& bpr_model,
-								size_t x,
-								size_t y,
-								__::Triangle3D& triangle,
-								size_t point_light_index,
-								FrameBuffer& buffer),
-							BlinnPhongReflectionModel& bpr_model,
-							size_t x,
-							size_t y,
-							size_t point_light_index,
-							FrameBuffer& buffer);
+					/**
+					 * @brief Any-hit query of the segment from origin to target, stops at the first triangle crossing it.
+					 * The triangle skip_triangle_index (the one of the target) never blocks the segment.
+					 * @return The index of the blocking triangle, Triangle3D$::INEXIST_INDEX if the segment is clear
+					 */
+					size_t Occluded(
+						BoundingBox const* boxes,
+						size_t b_i,
+						Utils::List<Triangle3D> const& triangles,
+						Maths::Vector const& origin,
+						Maths::Vector const& target,
+						size_t skip_triangle_index,
+						Statistics* statistics = nullptr);
+
+					/**
+					 * @brief Any-hit query of the segments of the packet set in mask, the triangle skip_triangle_indexes[i] never blocks the segment i.
+					 * The boxes are visited once for all segments through them. Only by CPU.
+					 * @param occluder_index The last blocking triangle found, kept if no segment is blocked
+					 * @return The mask of the blocked segments
+					 */
+					unsigned int Occluded(
+						BoundingBox const* boxes,
+						size_t b_i,
+						Utils::List<Triangle3D> const& triangles,
+						Triangle3D$::RayPacket const& packet,
+						unsigned int mask,
+						size_t const* skip_triangle_indexes,
+						size_t& occluder_index,
+						Statistics* statistics = nullptr);
 
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
@@ -99,19 +135,18 @@ namespace Kamanri
 						void MayScreenCover(
 							BoundingBox* boxes, 
 							size_t b_i, 
-							Utils::List<__::Triangle3D> const& triangles, 
+							Utils::List<__::Triangle3D$::SetupRecord> const& setups, 
 							size_t x, 
 							size_t y, 
 							void (*write_to_pixel_per_triangle)(
-								__::Triangle3D& triangle, 
+								__::Triangle3D$::SetupRecord const& setup, 
 								size_t x, 
 								size_t y, 
-								FrameBuffer& buffer, 
-								double nearest_dist, 
-								Object* cuda_objects), 
-							FrameBuffer& buffer, 
-							double nearest_dist, 
-							Object* cuda_objects = nullptr);
+								VisibilitySample& sample, 
+								double nearest_dist), 
+							VisibilitySample& sample, 
+							double nearest_dist,
+							Statistics* statistics = nullptr);
 
 				} // namespace BoundingBox$
 
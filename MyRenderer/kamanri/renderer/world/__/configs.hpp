@@ -16,11 +16,20 @@ namespace Kamanri
 					bool is_commited = false;
 					bool is_shadow_mapping = false;
 					bool is_use_cuda = false;
+					/// @brief Count of CPU threads used to build the world when not CUDA accelerated, <= 1 means serial.
+					unsigned int worker_count = 1;
+					/// @brief Whether to rasterize triangle by triangle over screen tiles instead of querying the bounding boxes for every pixel, only for CPU build.
+					bool is_triangle_rasterization = false;
+					/// @brief Resolution of every face of the shadow cube maps, 0 means the shadows are found by ray queries through the bounding boxes, only for CPU build.
+					unsigned int shadow_map_resolution = 0;
 					Configs& operator=(Configs const& other)
 					{
 						is_commited = other.is_commited;
 						is_shadow_mapping = other.is_shadow_mapping;
 						is_use_cuda = other.is_use_cuda;
+						worker_count = other.worker_count;
+						is_triangle_rasterization = other.is_triangle_rasterization;
+						shadow_map_resolution = other.shadow_map_resolution;
 						return *this;
 					}
 
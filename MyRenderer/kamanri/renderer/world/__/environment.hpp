@@ -26,6 +26,12 @@ namespace Kamanri
 					/// @brief Store all Triangles
 					std::vector<Triangle3D> triangles;
 					Utils::List<Triangle3D> cuda_triangles;
+					/// @brief Hot records of the triangles in the same order, the only ones read by rasterization
+					std::vector<Triangle3D$::SetupRecord> setups;
+					Utils::List<Triangle3D$::SetupRecord> cuda_setups;
+					/// @brief Cold records of the triangles in the same order, read by the visible pixels
+					std::vector<Triangle3D$::AttributeRecord> attributes;
+					Utils::List<Triangle3D$::AttributeRecord> cuda_attributes;
 
 					/// @brief Store all objects.
 					std::vector<Object> objects;
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
+#include "kamanri/maths/vector.hpp"
+#include "kamanri/utils/memory.hpp"
 
 namespace Kamanri
 {
@@ -9,6 +11,50 @@ namespace Kamanri
 		{
 			namespace __
 			{
+				namespace Resources$
+				{
+					constexpr size_t CACHE_LINE_SIZE = 64;
+
+					/**
+					 * @brief Structure of arrays of N-dimensional vectors, every component is stored in its own cache line aligned array.
+					 * Nothing is checked, the omitted homogeneous component is known by the user (1 for locations, 0 for directions).
+					 */
+					template <size_t N>
+					class VectorArray
+					{
+						private:
+						std::vector<double, Utils::AlignedAllocator<double, CACHE_LINE_SIZE>> _components[N];
+
+						public:
+						/// @brief Bytes used to store one vector
+						static constexpr size_t BYTES_PER_VECTOR = N * sizeof(double);
+
+						inline size_t Size() const { return _components[0].size(); }
+						inline void Resize(size_t size)
+						{
+							for (size_t i = 0; i < N; i++) _components[i].resize(size);
+						}
+						/// @brief Push the first N components of the vector
+						inline void PushBack(Maths::Vector const& vector)
+						{
+							for (size_t i = 0; i < N; i++) _components[i].push_back(vector[i]);
+						}
+						/// @brief Append `count` vectors stored as array of structures, the i-th component of the j-th vector is vectors[j * stride + i]
+						inline void Append(double const* vectors, size_t count, size_t stride)
+						{
+							auto offset = Size();
+							Resize(offset + count);
+							for (size_t i = 0; i < N; i++)
+							{
+								auto component = _components[i].data() + offset;
+								for (size_t j = 0; j < count; j++) component[j] = vectors[j * stride + i];
+							}
+						}
+						inline double* Component(size_t component) { return _components[component].data(); }
+						inline double const* Component(size_t component) const { return _components[component].data(); }
+					};
+				} // namespace Resources$
+
 				class Resources
 				{
 					private:
@@ -19,20 +65,24 @@ namespace Kamanri
 				 * @brief Used to store every vertex, note that the cluster of vertices of a object is stored in order.
 				 *
 				 */
-					std::vector<Maths::Vector> vertices;
+					Resources$::VectorArray<3> vertices;
 					/**
 					 * @brief Used to store every PROJECTION transformed vertex, note that the cluster of vertices of a object is stored in order.
 					 *
 					 */
-					std::vector<Maths::Vector> vertices_transformed;
+					Resources$::VectorArray<3> vertices_transformed;
 					/// @brief Used to store ONLY MODEL VIEW transformed vertices
-					std::vector<Maths::Vector> vertices_model_view_transformed;
+					Resources$::VectorArray<3> vertices_model_view_transformed;
 					/// @brief 顶点纹理，代表当前顶点对应纹理图的哪个像素，通常是0-1，如果大于1，就相当于将纹理重新扩充然后取值，比如镜像填充、翻转填充之类的，然后根据纹理图的宽高去计算具体像素位置
-					std::vector<Maths::Vector> vertex_textures;
+					Resources$::VectorArray<2> vertex_textures;
 					/// @brief 顶点法线，物理里面有说过眼睛看到物体是因为光线经过物体表面反射到眼睛，所以这个法线就是通过入射光线计算反射光线使用的法线。
-					std::vector<Maths::Vector> vertex_normals;
+					Resources$::VectorArray<3> vertex_normals;
 					/// @brief Used to store ONLY MODEL VIEW transformed vertex normals
-					std::vector<Maths::Vector> vertex_normals_model_view_transformed;
+					Resources$::VectorArray<3> vertex_normals_model_view_transformed;
+					/// @brief Whether any object is transformed since the bounding boxes are built, which needs to rebuild the topology of bounding boxes
+					bool is_vertices_dirty = true;
+					/// @brief Whether the camera is transformed since the world is built
+					bool is_vertices_transformed_dirty = true;
 
 					Resources& operator=(Resources const& other)
 					{
@@ -42,6 +92,8 @@ namespace Kamanri
 						vertex_textures = other.vertex_textures;
 						vertex_normals = other.vertex_normals;
 						vertex_normals_model_view_transformed = other.vertex_normals_model_view_transformed;
+						is_vertices_dirty = other.is_vertices_dirty;
+						is_vertices_transformed_dirty = other.is_vertices_transformed_dirty;
 						return *this;
 					}
 
@@ -53,8 +105,18 @@ namespace Kamanri
 						vertex_textures = std::move(other.vertex_textures);
 						vertex_normals = std::move(other.vertex_normals);
 						vertex_normals_model_view_transformed = std::move(other.vertex_normals_model_view_transformed);
+						is_vertices_dirty = other.is_vertices_dirty;
+						is_vertices_transformed_dirty = other.is_vertices_transformed_dirty;
 						return *this;
 					}
+
+					/// @brief Bytes used to store all vertices, normals and texture coordinates
+					inline size_t Footprint() const
+					{
+						return vertices.Size() * 3 * Resources$::VectorArray<3>::BYTES_PER_VECTOR +
+							vertex_normals.Size() * 2 * Resources$::VectorArray<3>::BYTES_PER_VECTOR +
+							vertex_textures.Size() * Resources$::VectorArray<2>::BYTES_PER_VECTOR;
+					}
 				};
 			} // namespace __
 
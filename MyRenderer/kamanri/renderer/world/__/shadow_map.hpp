@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include "kamanri/utils/memory.hpp"
+#include "kamanri/maths/all.hpp"
+#include "triangle3d.hpp"
+
+namespace Kamanri
+{
+	namespace Renderer
+	{
+		namespace World
+		{
+			namespace __
+			{
+				namespace ShadowMap$
+				{
+					/// @brief Faces of a cube map, +x, -x, +y, -y, +z, -z
+					constexpr size_t FACE_COUNT = 6;
+					/// @brief The percentage closer filter reads (2 * PCF_RADIUS + 1)^2 texels around the lookup
+					constexpr int PCF_RADIUS = 1;
+					/// @brief Occluders nearer than it to the light are clipped
+					constexpr double NEAR_DIST = 1e-4;
+					/// @brief Depth bias in texels, scaled by the slope of the surface to the light
+					constexpr double BIAS_TEXELS = 1.5;
+					/// @brief Depth of the texels which no triangle covers
+					constexpr float EMPTY_DEPTH = FLT_MAX;
+				} // namespace ShadowMap$
+
+				/**
+				 * @brief Cube depth map of a point light. Every face is a 90 degree perspective view from the light,
+				 * keeping the distance along its axis and the index of the nearest triangle of every texel.
+				 *
+				 * A texel whose nearest triangle is the one of the shaded point never shadows it, as the ray queries do,
+				 * so the bias only has to cover the neighbour triangles.
+				 */
+				class ShadowMap
+				{
+					private:
+					size_t _resolution;
+					/// @brief FACE_COUNT faces of _resolution * _resolution texels, row by row
+					Utils::P<float[]> _depths;
+					Utils::P<std::uint32_t[]> _triangle_indexes;
+
+					/// @brief Rasterize a triangle given by the face coordinates (u * depth, v * depth, depth) of its vertices, clipped by the near plane
+					void __WriteToFace(size_t face, double const* a, double const* b, double const* c, std::uint32_t triangle_index);
+
+					public:
+					ShadowMap(size_t resolution);
+					ShadowMap(ShadowMap const& other);
+					ShadowMap(ShadowMap&& other) = default;
+					ShadowMap& operator=(ShadowMap const& other);
+					ShadowMap& operator=(ShadowMap&& other) = default;
+					inline size_t Resolution() const { return _resolution; }
+					/// @brief Rasterize all triangles into a face, faces are independent so they can be built in parallel
+					void BuildFace(size_t face, Maths::Vector const& light_location, std::vector<Triangle3D> const& triangles);
+					/**
+					 * @brief Percentage of the filtered texels around the location which the light reaches.
+					 * @param cos_theta cos of the angle between the normal and the direction to the light, scales the bias
+					 */
+					double Exposure(Maths::Vector const& light_location, Maths::Vector const& location, size_t triangle_index, double cos_theta) const;
+				};
+
+			} // namespace __
+
+		} // namespace World
+
+	} // namespace Renderer
+
+} // namespace Kamanri
@@ -18,6 +18,112 @@ namespace Kamanri
 				{
 					constexpr size_t CODE_NOT_IN_TRIANGLE = 100;
 					constexpr size_t INEXIST_INDEX = 0xffffffffffffffff;
+
+					/**
+					 * @brief Hot record of a triangle, read by every pixel it may cover. Exactly 2 cache lines.
+					 * The records of all triangles are stored contiguously, apart from the triangles and their attribute records.
+					 * 
+					 * The areal coordinates divided by the world z (the inverse w) of their vertices are linear on screen:
+					 * q[i] = q_dx[i] * x + q_dy[i] * y + q_0[i], where 1 / (q[0] + q[1] + q[2]) is the world z of the pixel.
+					 */
+					class alignas(64) SetupRecord
+					{
+						public:
+						/// @brief Screen coordinates of vertices
+						double s_x[3], s_y[3];
+						double q_dx[3], q_dy[3], q_0[3];
+						/// @brief Index of the triangle
+						size_t index;
+
+#ifdef __CUDA_RUNTIME_H__  
+						__device__
+#endif
+						bool IsScreenCover(double x, double y) const;
+#ifdef __CUDA_RUNTIME_H__  
+						__device__
+#endif
+						void WriteToPixel(size_t x, size_t y, VisibilitySample& sample, double nearest_dist) const;
+						/// @brief Rasterize the triangle by traversing its screen bounding rectangle clipped by [x_begin, x_end) * [y_begin, y_end),
+						/// using incremental edge functions and areal coordinates, and write the nearer pixels to the row-major samples of the rectangle.
+						void WriteToSamples(VisibilitySample* samples, size_t x_begin, size_t y_begin, size_t x_end, size_t y_end, double nearest_dist) const;
+						/// @brief Only x and y are meaningful, the screen depth is not kept
+						Maths::Vector MinScreenBounding() const;
+						Maths::Vector MaxScreenBounding() const;
+
+						private:
+						/// @brief Write the pixel whose q is given to the sample if it is nearer, return whether it is written
+#ifdef __CUDA_RUNTIME_H__  
+						__device__
+#endif
+						bool WriteToSample(double q1, double q2, double q3, VisibilitySample& sample, double nearest_dist) const;
+					};
+
+					/// @brief Cold record of a triangle, only read by pixels passing the depth test.
+					/// 112 bytes of data padded to exactly 2 cache lines, so no record of the array straddles a third one.
+					class alignas(64) AttributeRecord
+					{
+						public:
+						/// @brief World coordinates of vertices, the z is given by the setup record
+						double w_x[3], w_y[3];
+						float vt_u[3], vt_v[3];
+						float vn_x[3], vn_y[3], vn_z[3];
+						/// @brief Index of the object the triangle belongs to
+						unsigned int object_index;
+
+						/// @brief Resolve the normal and the albedo of the pixel (x, y) the triangle is visible at, objects are on the side of the caller
+#ifdef __CUDA_RUNTIME_H__  
+						__device__
+#endif
+						void Resolve(SetupRecord const& setup, size_t x, size_t y, FrameBuffer& frame_buffer, Object const* objects) const;
+						/// @brief Recompute the location of the pixel (x, y) the triangle is visible at
+#ifdef __CUDA_RUNTIME_H__  
+						__device__
+#endif
+						void Locate(SetupRecord const& setup, size_t x, size_t y, SurfacePoint& point) const;
+					};
+
+					/// @brief Count of rays traced together by a RayPacket
+					constexpr size_t RAY_PACKET_SIZE = 4;
+
+					/// @brief RAY_PACKET_SIZE segments location + t * direction for t in (0, 1) as structure of arrays, so every lane is computed alike
+					class RayPacket
+					{
+						public:
+						double location_x[RAY_PACKET_SIZE], location_y[RAY_PACKET_SIZE], location_z[RAY_PACKET_SIZE];
+						double direction_x[RAY_PACKET_SIZE], direction_y[RAY_PACKET_SIZE], direction_z[RAY_PACKET_SIZE];
+					};
+
+					/**
+					 * @brief Möller–Trumbore intersection of the ray location + t * direction with the triangle v1 + u * e1 + v * e2.
+					 * The edge tests include their bounds, but the rounding is not controlled, so a ray through an edge shared by 2 triangles may miss both.
+					 * @return t of the intersection, -1 if the ray misses the triangle or is parallel to it
+					 */
+#ifdef __CUDA_RUNTIME_H__
+					__host__ __device__
+#endif
+					inline double IntersectRay(double const* v1, double const* e1, double const* e2, double const* location, double const* direction)
+					{
+						// p = direction x e2
+						double p_x = direction[1] * e2[2] - direction[2] * e2[1];
+						double p_y = direction[2] * e2[0] - direction[0] * e2[2];
+						double p_z = direction[0] * e2[1] - direction[1] * e2[0];
+						double determinant = e1[0] * p_x + e1[1] * p_y + e1[2] * p_z;
+						if (determinant == 0) return -1;
+						double inverse_determinant = 1 / determinant;
+
+						double s_x = location[0] - v1[0], s_y = location[1] - v1[1], s_z = location[2] - v1[2];
+						double u = (s_x * p_x + s_y * p_y + s_z * p_z) * inverse_determinant;
+						if (u < 0 || u > 1) return -1;
+
+						// q = s x e1
+						double q_x = s_y * e1[2] - s_z * e1[1];
+						double q_y = s_z * e1[0] - s_x * e1[2];
+						double q_z = s_x * e1[1] - s_y * e1[0];
+						double v = (direction[0] * q_x + direction[1] * q_y + direction[2] * q_z) * inverse_determinant;
+						if (v < 0 || u + v > 1) return -1;
+
+						return (e2[0] * q_x + e2[1] * q_y + e2[2] * q_z) * inverse_determinant;
+					}
 				} // namespace Triangle3D$
 
 				
@@ -29,78 +135,54 @@ namespace Kamanri
 				class Triangle3D
 				{
 				private:
-					/// @brief The object triangle belongs to.
-					std::vector<Object>* _p_objects;
-					Object* _cuda_p_objects;
-
-					size_t _object_index;
+					/// @brief Index of the triangle, which is also the index of its setup and attribute records
 					size_t _index;
+					/// @brief Index of the object the triangle belongs to
+					size_t _object_index;
 
-					// offset + index
+					// offset + index, only used by Build
 					size_t _v1, _v2, _v3;
 					size_t _vt1, _vt2, _vt3;
 					size_t _vn1, _vn2, _vn3;
 					
-					/// values
-					// on screen coordinates
-					double _s_v1_x, _s_v1_y, _s_v1_z, _s_v2_x, _s_v2_y, _s_v2_z, _s_v3_x, _s_v3_y, _s_v3_z;
-					// on world coordinates
+					// on world coordinates, used by rays and bounding boxes
 					double _w_v1_x, _w_v2_x, _w_v3_x, _w_v1_y, _w_v2_y, _w_v3_y, _w_v1_z, _w_v2_z, _w_v3_z;
 
-					double _vt1_x, _vt1_y, _vt2_x, _vt2_y, _vt3_x, _vt3_y;
-					double _vn1_x, _vn1_y, _vn1_z, _vn2_x, _vn2_y, _vn2_z, _vn3_x, _vn3_y, _vn3_z;
-
-					// factors of square, ax + by + cz - 1 = 0
-					// on screen coordinates
-					double _s_a, _s_b, _s_c;
-					// on world coordinates
-					double _w_a, _w_b, _w_c;
-
-					// the world coordinates vector used in IsThrough
-					Maths::Vector _w_v1_v2;
-					Maths::Vector _w_v2_v3;
-					Maths::Vector _w_v3_v1; 
-
-					// areal coordinates calculate matrix
-					Maths::SMatrix _areal_coordinates_calculate_matrix;
-#ifdef __CUDA_RUNTIME_H__  
-			__device__
-#endif
-					inline double ScreenZ(double x, double y) const { return (1 - _s_a * x - _s_b * y) / _s_c; }
-					
-					
-					friend void Object::__UpdateTriangleRef(std::vector<Triangle3D>& triangles, std::vector<Object>& objects, size_t index);
-					
-#ifdef __CUDA_RUNTIME_H__  
-					__device__
-#endif
-					void ScreenArealCoordinates(double x, double y, Maths::Vector& result) const;
+					// edges v2 - v1 and v3 - v1 on world coordinates, used by IsThrough
+					double _w_e1[3], _w_e2[3];
 
 				public:
-					Triangle3D(std::vector<Object>& objects, size_t object_index, size_t index, size_t v1, size_t v2, size_t v3, size_t vt1, size_t vt2, size_t vt3, size_t vn1, size_t vn2, size_t vn3);
+					Triangle3D(size_t object_index, size_t index, size_t v1, size_t v2, size_t v3, size_t vt1, size_t vt2, size_t vt3, size_t vn1, size_t vn2, size_t vn3);
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif			
 					inline size_t Index() const { return _index; }
+					/// @brief Whether the segment location + t * direction for t in (0, 1) crosses the triangle
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
-					bool IsScreenCover(double x, double y) const;
-#ifdef __CUDA_RUNTIME_H__  
-					__device__
-#endif
-					bool IsThrough(Maths::Vector& location, Maths::Vector& direction, double& output_distance);
-					void Build(Resources const& res);
+					inline bool IsThrough(double const* location, double const* direction) const
+					{
+						double v1[3] = { _w_v1_x, _w_v1_y, _w_v1_z };
+						auto t = Triangle3D$::IntersectRay(v1, _w_e1, _w_e2, location, direction);
+						return t > 0 && t < 1;
+					}
+					/// @brief Return the mask of the segments of the packet crossing the triangle, only the lanes set in mask are meaningful
+					unsigned int IsThrough(Triangle3D$::RayPacket const& packet, unsigned int mask) const;
+					/// @brief Build the triangle and write its setup and attribute records
+					void Build(Resources const& res, Triangle3D$::SetupRecord& setup, Triangle3D$::AttributeRecord& attributes);
 					void PrintTriangle(Utils::LogLevel level = Utils::Log$::INFO_LEVEL) const;
-#ifdef __CUDA_RUNTIME_H__  
-					__device__
-#endif
-					void WriteToPixel(size_t x, size_t y, FrameBuffer& frame_buffer, double nearest_dist, Object* cuda_objects = nullptr) const;
+
+					/// @brief World coordinates of the 3 vertices, used by the shadow maps
+					inline void WorldVertices(double* xs, double* ys, double* zs) const
+					{
+						xs[0] = _w_v1_x; xs[1] = _w_v2_x; xs[2] = _w_v3_x;
+						ys[0] = _w_v1_y; ys[1] = _w_v2_y; ys[2] = _w_v3_y;
+						zs[0] = _w_v1_z; zs[1] = _w_v2_z; zs[2] = _w_v3_z;
+					}
 
 					Maths::Vector MinWorldBounding() const;
 					Maths::Vector MaxWorldBounding() const;
-					Maths::Vector MinScreenBounding() const;
-					Maths::Vector MaxScreenBounding() const;
 
 				};
 			} // namespace __
@@ -4,6 +4,7 @@
 #include "kamanri/utils/list.hpp"
 #include "kamanri/utils/memory.hpp"
 #include "kamanri/renderer/world/__/triangle3d.hpp"
+#include "kamanri/renderer/world/__/shadow_map.hpp"
 #include "kamanri/maths/all.hpp"
 #endif
 namespace Kamanri
@@ -15,6 +16,9 @@ namespace Kamanri
             using RGB = unsigned long;
             namespace BlinnPhongReflectionModel$
             {
+                /// @brief Max count of pixels shaded by one WriteToPixels call, their geometric terms are kept on the stack
+                constexpr size_t SHADING_BATCH_SIZE = 32;
+
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
@@ -92,6 +96,12 @@ namespace Kamanri
                     return CombineRGB(r, g, b);
                 }
 
+                /// @brief Distance beyond which a light of the power adds less than one level to any color channel, as RGBMul truncates
+                inline double AttenuationRadius(double power)
+                {
+                    return sqrt(power * 0xFF / (4 * Kamanri::Maths::PI));
+                }
+
                 class PointLight
                 {
 
@@ -100,10 +110,13 @@ namespace Kamanri
                     Kamanri::Maths::Vector location_model_view_transformed;
                     double power;
                     RGB color;
+                    /// @brief Points farther than it are not lit, so the light is culled from them
+                    double radius = DBL_MAX;
 
                     PointLight() = default;
-                    PointLight(Kamanri::Maths::Vector location, double power, RGB color):
-                        location(location), location_model_view_transformed(location), power(power), color(color)
+                    /// @param radius 0 to use AttenuationRadius(power), which culls nothing visible
+                    PointLight(Kamanri::Maths::Vector location, double power, RGB color, double radius = 0):
+                        location(location), location_model_view_transformed(location), power(power), color(color), radius(radius > 0 ? radius : AttenuationRadius(power))
                     {}
 
                 };
@@ -111,14 +124,28 @@ namespace Kamanri
                 struct PointLightBufferItem
                 {
                     bool is_specular = false;
-                    bool is_exposed = true;
+                    /// @brief Fraction of the light reaching the point, 0 or 1 by the ray queries, filtered by the shadow maps
+                    double exposure = 1;
                     double specular_factor;
                     double distance = DBL_MAX;
                     PointLightBufferItem() = default;
-                    PointLightBufferItem(bool is_exposed, double distance):
-                        is_exposed(is_exposed), distance(distance)
+                    PointLightBufferItem(double exposure, double distance):
+                        exposure(exposure), distance(distance)
                     {}
                 };
+
+                /// @brief Lights which may reach the pixels of a screen tile, and the light buffer of the batch of its pixels being shaded. Only for CPU.
+                class TileLights
+                {
+                    public:
+                    /// @brief Indexes of the point lights, ascending
+                    std::vector<size_t> light_indexes;
+                    /// @brief SHADING_BATCH_SIZE items for every light of light_indexes, light by light
+                    std::vector<PointLightBufferItem> items;
+
+                    inline PointLightBufferItem& Item(size_t slot, size_t k) { return items[slot * SHADING_BATCH_SIZE + k]; }
+                    inline PointLightBufferItem const& Item(size_t slot, size_t k) const { return items[slot * SHADING_BATCH_SIZE + k]; }
+                };
             } // namespace BlinnPhongReflectionModel$
 		}
 	}
@@ -13,6 +13,10 @@ namespace Kamanri
             {
                 // declare a bounding box
                 class BoundingBox;
+                namespace BoundingBox$
+                {
+                    class Statistics;
+                }
             }
 
             class BlinnPhongReflectionModel
@@ -22,9 +26,10 @@ namespace Kamanri
                 std::vector<Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLight> _point_lights;
                 Kamanri::Utils::List<Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLight> _cuda_point_lights;
 
-                // Note that its size is buffer_size * _point_lights.size()
-                Kamanri::Utils::P<Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem[]> _lights_buffer;
+                /// @brief Light buffer of CUDA, _point_lights.size() items for every pixel. The CPU keeps the items of the batch of pixels being shaded only.
                 Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem* _cuda_lights_buffer;
+                /// @brief Cube shadow map of every light, empty if the shadows are found by ray queries
+                std::vector<Kamanri::Renderer::World::__::ShadowMap> _shadow_maps;
                 size_t _screen_width;
                 size_t _screen_height;
 
@@ -34,10 +39,11 @@ namespace Kamanri
 
                 bool _is_use_cuda;
 
+                /// @brief Write the distance to the light and whether the point is specular to the light buffer item
 #ifdef __CUDA_RUNTIME_H__  
                 __device__
 #endif
-					void __BuildPerTriangleLightPixel(size_t x, size_t y, Kamanri::Renderer::World::__::Triangle3D& triangle, size_t point_light_index, Kamanri::Renderer::World::FrameBuffer& buffer);
+					void __BuildSpecularLightPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem& light_buffer_item, size_t point_light_index, Kamanri::Renderer::World::SurfacePoint const& point);
 
                 public:
                 // BlinnPhongReflectionModel() = default;
@@ -48,24 +54,56 @@ namespace Kamanri
                 BlinnPhongReflectionModel& operator=(BlinnPhongReflectionModel const& other);
                 BlinnPhongReflectionModel& operator=(BlinnPhongReflectionModel&& other);
                 void ModelViewTransform(Kamanri::Maths::SMatrix const& matrix);
+                /// @brief Change the reflection factors, take effect from the next shading pass
+                void SetFactors(double specular_min_cos, double diffuse_factor, double ambient_factor);
+                /// @brief Find the shadows by cube shadow maps whose faces have resolution * resolution texels instead of ray queries, 0 to use ray queries. Only for CPU.
+                void SetShadowMapResolution(size_t resolution);
+                inline bool IsShadowMapped() const { return !_shadow_maps.empty(); }
+                /// @brief Count of faces of all shadow maps, each can be built independently
+                inline size_t ShadowMapFaceCount() const { return _shadow_maps.size() * Kamanri::Renderer::World::__::ShadowMap$::FACE_COUNT; }
+                /// @brief Rasterize the depths of the face, faces of a light are indexed from light_index * FACE_COUNT
+                void BuildShadowMapFace(size_t face_index, std::vector<Kamanri::Renderer::World::__::Triangle3D> const& triangles);
+                inline size_t PointLightCount() const { return _point_lights.size(); }
                 inline size_t ScreenWidth() { return _screen_width; }
                 inline size_t ScreenHeight() { return _screen_height; }
+                /// @brief Items of the pixel in the light buffer of CUDA, one for each light. Only for CUDA.
 #ifdef __CUDA_RUNTIME_H__  
                 __device__
 #endif
-                    void InitLightBufferPixel(size_t x, size_t y, Kamanri::Renderer::World::FrameBuffer& buffer);
+                    inline Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem* CUDALightBufferPixel(size_t x, size_t y) { return _cuda_lights_buffer + (y * _screen_width + x) * _cuda_point_lights.size; }
+                /// @brief Find the lights whose radius reaches the box of the points of a screen tile, and size the light buffer of its batches. Only for CPU.
+                void CullLights(double const* min, double const* max, Kamanri::Renderer::World::BlinnPhongReflectionModel$::TileLights& tile_lights) const;
 #ifdef __CUDA_RUNTIME_H__  
+                /// @brief Reset the items of a pixel, one for each light. Only for CUDA.
                 __device__
+                    void InitLightBufferPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem* light_buffer_items);
 #endif
-                    void __BuildPerTrianglePixel(size_t x, size_t y, Kamanri::Renderer::World::__::Triangle3D& triangle, Kamanri::Renderer::World::FrameBuffer& buffer);
+                /// @brief Reset the items of the pixel k of the batch, one for each light of the tile
+                void InitLightBufferPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::TileLights& tile_lights, size_t k);
 #ifdef __CUDA_RUNTIME_H__  
+                /// @brief Trace the segments from the pixel to every light. Only for CUDA.
                 __device__
+					void __BuildShadowPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem* light_buffer_items, Kamanri::Utils::List<Kamanri::Renderer::World::__::Triangle3D> triangles, Kamanri::Renderer::World::__::BoundingBox* boxes, Kamanri::Renderer::World::SurfacePoint& point, Kamanri::Renderer::World::__::BoundingBox$::Statistics* statistics = nullptr);
 #endif
-					void __BuildShadowPixel(size_t x, size_t y, Kamanri::Utils::List<Kamanri::Renderer::World::__::Triangle3D> triangles, Kamanri::Renderer::World::__::BoundingBox* boxes, Kamanri::Renderer::World::FrameBuffer& buffer);
+                /**
+                 * @brief __BuildShadowPixel of the count pixels of a batch over the lights of the tile, the segments to a light are traced by packets of Triangle3D$::RAY_PACKET_SIZE.
+                 * Points beyond the radius of the light or behind its surface are not traced. Only for CPU.
+                 * @param occluder_cache The last occluder found of every light, kept by the caller for a screen tile and tested before the traversal.
+                 * Triangle3D$::INEXIST_INDEX if none, it is only a hint so any index is safe.
+                 */
+                void __BuildShadowPixels(size_t count, Kamanri::Renderer::World::SurfacePoint* points, Kamanri::Utils::List<Kamanri::Renderer::World::__::Triangle3D> triangles, Kamanri::Renderer::World::__::BoundingBox* boxes, Kamanri::Renderer::World::BlinnPhongReflectionModel$::TileLights& tile_lights, size_t* occluder_cache, Kamanri::Renderer::World::__::BoundingBox$::Statistics* statistics = nullptr);
+                /// @brief Look up the shadow maps of the lights of the tile for the pixel k of the batch instead of tracing, constant time for each light
+                void __LookupShadowPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::TileLights& tile_lights, size_t k, Kamanri::Renderer::World::SurfacePoint& point);
 #ifdef __CUDA_RUNTIME_H__  
+                /// @brief Shade the pixel over every light. Only for CUDA.
                 __device__
+                    void WriteToPixel(Kamanri::Renderer::World::BlinnPhongReflectionModel$::PointLightBufferItem const* light_buffer_items, Kamanri::Renderer::World::SurfacePoint& point, Kamanri::Renderer::World::RGB& pixel);
 #endif
-                    void WriteToPixel(size_t x, size_t y, Kamanri::Renderer::World::FrameBuffer& buffer, Kamanri::Renderer::World::RGB& pixel);
+                /**
+                 * @brief Shade at most SHADING_BATCH_SIZE pixels of a tile as WriteToPixel does, only over the lights of the tile.
+                 * The geometric terms of every light are computed over the batch as structure of arrays, so they can be vectorized.
+                 */
+                void WriteToPixels(size_t count, Kamanri::Renderer::World::SurfacePoint const* points, Kamanri::Renderer::World::RGB* const* pixels, Kamanri::Renderer::World::BlinnPhongReflectionModel$::TileLights const& tile_lights);
 
             };
 
@@ -4,6 +4,15 @@
 #endif
 namespace Kamanri
 {
+	namespace Utils
+	{
+		namespace Thread
+		{
+			// declare a thread pool
+			class ThreadPool;
+		}
+	}
+
 	namespace Renderer
 	{
 		namespace World
@@ -18,6 +27,9 @@ namespace Kamanri
 				Kamanri::Renderer::World::__::Resources* _p_resources = nullptr;
 
 				Kamanri::Renderer::World::BlinnPhongReflectionModel* _p_bpr_model = nullptr;
+
+				/// @brief Workers to transform vertices, serial if null
+				Kamanri::Utils::Thread::ThreadPool* _p_thread_pool = nullptr;
 				/////////////////////////////////
 
 				// need 4d vector
@@ -66,7 +78,7 @@ namespace Kamanri
 				Camera(Camera&& camera);
 				Camera& operator=(Camera const& other);
 				Camera& operator=(Camera&& other);
-				void __SetRefs(Kamanri::Renderer::World::__::Resources& resources, Kamanri::Renderer::World::BlinnPhongReflectionModel& bpr_model);
+				void __SetRefs(Kamanri::Renderer::World::__::Resources& resources, Kamanri::Renderer::World::BlinnPhongReflectionModel& bpr_model, Kamanri::Utils::Thread::ThreadPool* thread_pool = nullptr);
 				int Transform(bool is_transform_bpr_model = true);
 				/**
 				 * @brief Inverse the upper vector when the upper of direction changed.
@@ -1,5 +1,8 @@
 #pragma once
 #ifndef SWIG
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
 #include "kamanri/maths/all.hpp"
 #endif
 
@@ -9,11 +12,96 @@ namespace Kamanri
 	{
 		namespace World
 		{
+			namespace FrameBuffer$
+			{
+				/// @brief Depth of the pixels which no triangle covers
+				constexpr float EMPTY_DEPTH = -FLT_MAX;
+				constexpr std::uint32_t ALPHA_OPAQUE = 0xff000000;
+
+#ifdef __CUDA_RUNTIME_H__
+				__host__ __device__
+#endif
+				inline std::uint32_t EncodeSnorm16(double value)
+				{
+					value = value < -1 ? -1 : (value > 1 ? 1 : value);
+					return (std::uint32_t)((value * 0.5 + 0.5) * 65535 + 0.5);
+				}
+
+				/// @brief Encode a unit normal by the octahedral mapping, 16 bits for each of the 2 components
+#ifdef __CUDA_RUNTIME_H__
+				__host__ __device__
+#endif
+				inline std::uint32_t EncodeNormal(double x, double y, double z)
+				{
+					auto l1_norm = fabs(x) + fabs(y) + fabs(z);
+					if (l1_norm == 0) return EncodeSnorm16(0) | (EncodeSnorm16(0) << 16);
+					auto u = x / l1_norm;
+					auto v = y / l1_norm;
+					if (z < 0)
+					{
+						// fold the lower hemisphere over the diagonals
+						auto folded_u = (1 - fabs(v)) * (u >= 0 ? 1 : -1);
+						auto folded_v = (1 - fabs(u)) * (v >= 0 ? 1 : -1);
+						u = folded_u;
+						v = folded_v;
+					}
+					return EncodeSnorm16(u) | (EncodeSnorm16(v) << 16);
+				}
+
+				/// @brief Decode a normal encoded by EncodeNormal, the result is unitized
+#ifdef __CUDA_RUNTIME_H__
+				__host__ __device__
+#endif
+				inline void DecodeNormal(std::uint32_t code, double& x, double& y, double& z)
+				{
+					x = (code & 0xffff) / 65535.0 * 2 - 1;
+					y = (code >> 16) / 65535.0 * 2 - 1;
+					z = 1 - fabs(x) - fabs(y);
+					if (z < 0)
+					{
+						auto t = -z;
+						x += x >= 0 ? -t : t;
+						y += y >= 0 ? -t : t;
+					}
+					auto length = sqrt(x * x + y * y + z * z);
+					x /= length;
+					y /= length;
+					z /= length;
+				}
+			} // namespace FrameBuffer$
+
+			/// @brief The nearest triangle found so far by the visibility query of a pixel
+			class VisibilitySample
+			{
+				public:
+				/// @brief The world z of the nearest point, -DBL_MAX if nothing covers the pixel
+				double depth;
+				/// @brief The index of the nearest triangle
+				size_t triangle_index;
+			};
 
+			/**
+			 * @brief G-buffer entry of a pixel, 16 bytes. The depth and the triangle are written by the visibility pass,
+			 * the normal and the albedo are resolved from the triangle right after it.
+			 * The location is not kept, the shading pass recomputes it from the triangle.
+			 */
 			class FrameBuffer
 			{
 				public:
-				/////////// update in triangle3D
+				/// @brief The world z, FrameBuffer$::EMPTY_DEPTH if nothing covers the pixel
+				float depth;
+				/// @brief The located triangle index
+				std::uint32_t triangle_index;
+				/// @brief The vertex normal encoded by FrameBuffer$::EncodeNormal
+				std::uint32_t normal;
+				/// @brief The albedo as 0xAARRGGBB
+				std::uint32_t color;
+			};
+
+			/// @brief Surface point of a pixel decoded from its frame buffer, only lives while the pixel is shaded
+			class SurfacePoint
+			{
+				public:
 				/// @brief the located triangle index
 				size_t triangle_index;
 				/// the point location
@@ -22,14 +110,6 @@ namespace Kamanri
 				Kamanri::Maths::Vector vertex_normal;
 				/// RGB color reflect
 				unsigned int color;
-				// /////// update in bpr model
-				double power;
-				unsigned int r;
-				unsigned int g;
-				unsigned int b;
-				unsigned int specular_color;
-				unsigned int diffuse_color;
-				unsigned int ambient_color;
 			};
 
 
@@ -37,4 +117,4 @@ namespace Kamanri
 
 	} // namespace Renderer
 
-} // namespace Kamanri
\ No newline at end of file
+} // namespace Kamanri
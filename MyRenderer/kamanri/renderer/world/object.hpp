@@ -4,6 +4,7 @@
 #include "kamanri/maths/vector.hpp"
 #include "kamanri/maths/smatrix.hpp"
 #include "kamanri/renderer/tga_image.hpp"
+#include "kamanri/renderer/texture.hpp"
 #include "kamanri/utils/result_declare.hpp"
 #endif
 namespace Kamanri
@@ -15,7 +16,7 @@ namespace Kamanri
 		{
 			namespace __
 			{
-				class Triangle3D;
+				class Resources;
 			} // namespace __
 			
 
@@ -26,24 +27,29 @@ namespace Kamanri
 			class Object
 			{
 				private:
-					std::vector<Kamanri::Maths::Vector>* _pvertices = nullptr;
+					Kamanri::Renderer::World::__::Resources* _p_resources = nullptr;
 					size_t _v_offset;
 					size_t _v_length;
 					size_t _t_offset;
 					size_t _t_length;
 
 					Kamanri::Renderer::TGAImage _img;
+					/// @brief Mipmapped copy of _img used to sample
+					Kamanri::Renderer::Texture _texture;
 				public:
 					// Object() = default;
-					Object(std::vector<Kamanri::Maths::Vector>& vertices, size_t v_offset, size_t v_length, size_t t_offset, size_t t_length, std::string tga_image_name, bool is_use_cuda = false);
-					void __UpdateTriangleRef(std::vector<Kamanri::Renderer::World::__::Triangle3D>& triangles, std::vector<Object>& objects, size_t index);
+					Object(Kamanri::Renderer::World::__::Resources& resources, size_t v_offset, size_t v_length, size_t t_offset, size_t t_length, std::string tga_image_name, bool is_use_cuda = false);
 #ifdef __CUDA_RUNTIME_H__  
 					__device__
 #endif
 					inline Kamanri::Renderer::TGAImage& GetImage() { return _img; }
+#ifdef __CUDA_RUNTIME_H__  
+					__device__
+#endif
+					inline Kamanri::Renderer::Texture const& GetTexture() const { return _texture; }
 					Kamanri::Utils::DefaultResult Transform(Kamanri::Maths::SMatrix const& transform_matrix) const;
 
-					inline void DeleteCUDA() { _img.DeleteCUDA(); }
+					inline void DeleteCUDA() { _img.DeleteCUDA(); _texture.DeleteCUDA(); }
 			};
 			
 			
@@ -7,6 +7,8 @@
 #include "object.hpp"
 #include "__/all.hpp"
 #include "kamanri/maths/all.hpp"
+#include "kamanri/utils/memory.hpp"
+#include "kamanri/utils/thread.hpp"
 #endif
 
 namespace Kamanri
@@ -19,6 +21,7 @@ namespace Kamanri
 			namespace World3D$
 			{
 				constexpr int CODE_UNHANDLED_EXCEPTION = 0;
+				constexpr int CODE_INDEX_OUT_OF_BOUND = 100;
 			} // namespace World3D$
 		}
 	}
@@ -26,8 +26,25 @@ namespace Kamanri
 
 				World3D* _cuda_world;
 
+				/// @brief Workers of the tile-parallel CPU build, only created when worker_count > 1
+				Kamanri::Utils::P<Kamanri::Utils::Thread::ThreadPool> _thread_pool;
+
+				/// @brief Indexes of triangles which may cover every screen tile, only used by triangle rasterization
+				std::vector<std::vector<size_t>> _tile_triangles;
+				/// @brief Statistics of bounding box queries of every tile
+				std::vector<Kamanri::Renderer::World::__::BoundingBox$::Statistics> _tile_statistics;
+				/// @brief The last shadow ray occluder of every light for every tile, reset by every shading pass
+				std::vector<size_t> _tile_occluders;
+
+				void __BinTriangles();
+				void __BuildForTile(size_t tile_index);
+				void __RasterizeTile(size_t x_begin, size_t y_begin, size_t x_end, size_t y_end, size_t tile_index, Kamanri::Renderer::World::__::BoundingBox$::Statistics* statistics);
+				void __LogStatistics(Kamanri::Renderer::World::__::BoundingBox$::Statistics const& statistics);
+				void __ShadeTile(size_t tile_index);
+				void __BuildShadowMaps();
+
 			public:
-				World3D(Kamanri::Renderer::World::Camera&& camera, Kamanri::Renderer::World::BlinnPhongReflectionModel&& model, bool is_shadow_mapping = true, bool is_use_cuda = false);
+				World3D(Kamanri::Renderer::World::Camera&& camera, Kamanri::Renderer::World::BlinnPhongReflectionModel&& model, bool is_shadow_mapping = true, bool is_use_cuda = false, unsigned int worker_count = 1, bool is_triangle_rasterization = false, unsigned int shadow_map_resolution = 0);
 				~World3D();
 				World3D& operator=(World3D const& other);
 				World3D& operator=(World3D&& other);
@@ -35,11 +52,15 @@ namespace Kamanri
 				Kamanri::Utils::Result<Object *> AddObjModel(Kamanri::Renderer::ObjModel const &model);
 				World3D& AddObjModel(Kamanri::Renderer::ObjModel const &model, Kamanri::Maths::SMatrix const& transform_matrix);
 				World3D& Commit();
+				/// @brief Run the visibility pass into the G-buffer, then the shading pass
 				void Build();
+				/// @brief Run the shading pass over the G-buffer of the last build, e.g. after the reflection model is changed
+				void Shade();
+				Kamanri::Renderer::World::BlinnPhongReflectionModel& GetReflectionModel() { return _environment.bpr_model; }
 #ifdef __CUDA_RUNTIME_H__  
 				__device__
 #endif
-				void __BuildForPixel(size_t x, size_t y);
+				void __BuildForPixel(size_t x, size_t y, Kamanri::Renderer::World::__::BoundingBox$::Statistics* statistics = nullptr);
 				Kamanri::Renderer::World::FrameBuffer const& GetFrameBuffer(int x, int y);
 				inline DWORD* Bitmap() { return _buffers.GetBitmapBufferPtr(); }
 			};
@@ -5,6 +5,7 @@
 #include "imexport.hpp"
 #include "list.hpp"
 #include "log.hpp"
+#include "mapped_file.hpp"
 #include "memory.hpp"
 #include "range.hpp"
 #include "resource_pool.hpp"
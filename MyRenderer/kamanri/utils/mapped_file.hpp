@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+
+namespace Kamanri
+{
+	namespace Utils
+	{
+		/**
+		 * @brief Read-only memory mapping of a whole file, the file is unmapped when destructed.
+		 * 
+		 */
+		class MappedFile
+		{
+			public:
+			explicit MappedFile(std::string const& file_name);
+			~MappedFile();
+			MappedFile(MappedFile const& other) = delete;
+			MappedFile& operator=(MappedFile const& other) = delete;
+
+			/// @brief Whether the file is opened, an empty file is opened with nullptr data
+			inline bool IsOpen() const { return _is_open; }
+			inline char const* Data() const { return _data; }
+			inline size_t Size() const { return _size; }
+
+			private:
+			bool _is_open = false;
+			char const* _data = nullptr;
+			size_t _size = 0;
+#ifdef _WIN32
+			void* _file = nullptr;
+			void* _mapping = nullptr;
+#endif
+		};
+	} // namespace Utils
+	
+} // namespace Kamanri
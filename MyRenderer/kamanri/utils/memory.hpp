@@ -1,5 +1,8 @@
 #pragma once
 #include <memory>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
 
 namespace Kamanri
 {
@@ -44,6 +47,40 @@ namespace Kamanri
 			return P<T[]>(new_p_);
 		}
 
+		/// @brief Allocator of std::vector whose data is aligned to ALIGNMENT bytes (e.g. a cache line)
+		template <typename T, size_t ALIGNMENT = 64>
+		class AlignedAllocator
+		{
+			public:
+			using value_type = T;
+			template <typename U>
+			struct rebind { using other = AlignedAllocator<U, ALIGNMENT>; };
+
+			AlignedAllocator() = default;
+			template <typename U>
+			AlignedAllocator(AlignedAllocator<U, ALIGNMENT> const&) {}
+
+			T* allocate(size_t size)
+			{
+				// the original pointer is stored just before the aligned memory
+				auto raw = (byte*)malloc(size * sizeof(T) + ALIGNMENT + sizeof(void*));
+				if (raw == nullptr) throw std::bad_alloc();
+				auto aligned = (byte*)(((uintptr_t)(raw + sizeof(void*)) + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+				((void**)aligned)[-1] = raw;
+				return (T*)aligned;
+			}
+
+			void deallocate(T* p, size_t)
+			{
+				free(((void**)p)[-1]);
+			}
+
+			template <typename U>
+			bool operator==(AlignedAllocator<U, ALIGNMENT> const&) const { return true; }
+			template <typename U>
+			bool operator!=(AlignedAllocator<U, ALIGNMENT> const&) const { return false; }
+		};
+
 	}
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <queue>
 #include <memory>
@@ -8,6 +9,7 @@
 #include <condition_variable>
 #include <future>
 #include <functional>
+#include <type_traits>
 #include <stdexcept>
 #include "log.hpp"
 
@@ -25,8 +27,13 @@ namespace Kamanri
             public:
                 ThreadPool(size_t);                                                                            //构造函数
                 template <class F, class... Args>                                                              //类模板
-                auto EnQueue(F &&f, Args &&...args) -> std::future<typename std::result_of<F(Args...)>::type>; //任务入队
+                auto EnQueue(F &&f, Args &&...args) -> std::future<std::invoke_result_t<F, Args...>>;          //任务入队
                 auto Join() -> void;
+                inline size_t WorkerCount() const { return workers.size(); }                                   // 工作线程数
+                template <class F>
+                void ParallelFor(size_t count, F const& func);                                                // 并行执行 func(0) ... func(count - 1) 并等待全部完成
+                template <class F>
+                void ParallelFor(size_t count, size_t chunk_size, F const& func);                             // 同上, 但每个任务按顺序执行连续的 chunk_size 个 func
                 ~ThreadPool();                                                                                 //析构函数
 
             private:
@@ -45,10 +52,10 @@ namespace Kamanri
             // 添加新的任务到任务队列
             template <class F, class... Args>
             auto ThreadPool::EnQueue(F &&f, Args &&...args)
-                -> std::future<typename std::result_of<F(Args...)>::type>
+                -> std::future<std::invoke_result_t<F, Args...>>
             {
                 // 获取函数返回值类型
-                using return_type = typename std::result_of<F(Args...)>::type;
+                using return_type = std::invoke_result_t<F, Args...>;
 
                 // 创建一个指向任务的只能指针
                 auto task = std::make_shared<std::packaged_task<return_type()>>(
@@ -67,6 +74,38 @@ namespace Kamanri
                 return res;
             }
 
+            // 把 count 个任务加入任务队列, 并等待它们全部执行完毕
+            // 注意 Join() 只等待任务队列为空, 而不是等待任务执行完, 所以这里使用 future 等待
+            template <class F>
+            void ThreadPool::ParallelFor(size_t count, F const& func)
+            {
+                std::vector<std::future<void>> futures;
+                futures.reserve(count);
+                for (size_t i = 0; i < count; i++)
+                {
+                    futures.push_back(EnQueue(func, i));
+                }
+                for (auto& future : futures)
+                {
+                    future.get();
+                }
+            }
+
+            // 任务很多且每个任务很小时, 分块以减少入队和 future 的开销
+            template <class F>
+            void ThreadPool::ParallelFor(size_t count, size_t chunk_size, F const& func)
+            {
+                auto chunk_count = (count + chunk_size - 1) / chunk_size;
+                ParallelFor(chunk_count, [&](size_t chunk_index)
+                {
+                    auto end = std::min(count, (chunk_index + 1) * chunk_size);
+                    for (size_t i = chunk_index * chunk_size; i < end; i++)
+                    {
+                        func(i);
+                    }
+                });
+            }
+
             
         }
     }